@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "arena.h"
+
+/* Alignment of arena allocations. */
+#define ARENA_ALIGN (sizeof(long double) > sizeof(void *) ? sizeof(long double) : sizeof(void *))
+
+/* Round size up to ARENA_ALIGN. */
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/* Get data of block. */
+#define BLOCK_DATA(block) ((char *) (block) + ARENA_ROUND(sizeof(arena_block)))
+
+/* Create arena with first block of size bytes at least and one reference.
+   Return NULL, if memory wasn't allocated. */
+arena *arena_create(size_t size)
+{
+    if (size < ARENA_MIN_BLOCK)
+        size = ARENA_MIN_BLOCK;
+    size = ARENA_ROUND(size);
+
+    /* Arena header, the first block header and data are allocated together. */
+    char *mem = malloc(ARENA_ROUND(sizeof(arena)) + ARENA_ROUND(sizeof(arena_block)) + size);
+    if (!mem)
+        return NULL;
+
+    arena *a = (arena *) mem;
+    a->head = (arena_block *) (mem + ARENA_ROUND(sizeof(arena)));
+    a->head->next = NULL;
+    a->head->size = size;
+    a->head->used = 0;
+    a->refs = 1;
+    a->parent = NULL;
+
+    return a;
+}
+
+/* Allocate size bytes from arena. Memory is aligned for any type.
+   Return NULL, if memory wasn't allocated. */
+void *arena_alloc(arena *mem, size_t size)
+{
+    assert(mem != NULL);
+
+    size = ARENA_ROUND(size ? size : 1);
+
+    if (mem->head->size - mem->head->used < size)
+    {
+        /* Blocks grow twice, so count of allocations is logarithmic of arena size. */
+        size_t block_size = mem->head->size * 2;
+        if (block_size < size)
+            block_size = size;
+
+        arena_block *block = malloc(ARENA_ROUND(sizeof(arena_block)) + block_size);
+        if (!block)
+            return NULL;
+
+        block->next = mem->head;
+        block->size = block_size;
+        block->used = 0;
+        mem->head = block;
+    }
+
+    void *ptr = BLOCK_DATA(mem->head) + mem->head->used;
+    mem->head->used += size;
+
+    return ptr;
+}
+
+/* Copy len symbols of string s to arena. Return NULL, if memory wasn't allocated. */
+char *arena_strndup(arena *mem, const char *s, size_t len)
+{
+    assert(s != NULL);
+
+    char *str = arena_alloc(mem, len + 1);
+    if (!str)
+        return NULL;
+
+    memcpy(str, s, len);
+    str[len] = '\0';
+
+    return str;
+}
+
+/* Add owner of arena. */
+void arena_ref(arena *mem)
+{
+    assert(mem != NULL);
+    mem->refs++;
+}
+
+/* Remove owner of arena. Memory is freed, when the last owner releases it. */
+void arena_release(arena *mem)
+{
+    if (!mem || --mem->refs > 0)
+        return;
+
+    /* The first block is allocated together with arena. */
+    arena_block *block, *next;
+    arena *parent = mem->parent;
+    for (block = mem->head; block->next; block = next)
+    {
+        next = block->next;
+        free(block);
+    }
+
+    free(mem);
+    arena_release(parent);
+}
+
+/* Keep parent arena, while mem is alive. mem must have no parent yet. */
+void arena_set_parent(arena *mem, arena *parent)
+{
+    assert(mem != NULL);
+    assert(parent != NULL);
+    assert(mem->parent == NULL);
+
+    arena_ref(parent);
+    mem->parent = parent;
+}
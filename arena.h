@@ -0,0 +1,45 @@
+#ifndef UNIX_SHELL_ARENA_H
+#define UNIX_SHELL_ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_MIN_BLOCK 4096 /* minimal size of arena block */
+
+/* Block of arena memory. */
+typedef struct arena_block
+{
+    struct arena_block *next;   /* previous filled block */
+    size_t size;                /* size of data */
+    size_t used;                /* used bytes of data */
+} arena_block;
+
+/* Region of memory, which is freed in one call.
+   Used for parsed line and jobs, created from it. */
+typedef struct arena
+{
+    arena_block *head;          /* current block, data follows it */
+    int refs;                   /* count of owners of arena */
+    struct arena *parent;       /* arena, which memory is referenced from this one, or NULL */
+} arena;
+
+/* Create arena with first block of size bytes at least and one reference.
+   Return NULL, if memory wasn't allocated. */
+arena *arena_create(size_t size);
+
+/* Allocate size bytes from arena. Memory is aligned for any type.
+   Return NULL, if memory wasn't allocated. */
+void *arena_alloc(arena *mem, size_t size);
+
+/* Copy len symbols of string s to arena. Return NULL, if memory wasn't allocated. */
+char *arena_strndup(arena *mem, const char *s, size_t len);
+
+/* Add owner of arena. */
+void arena_ref(arena *mem);
+
+/* Remove owner of arena. Memory is freed, when the last owner releases it. */
+void arena_release(arena *mem);
+
+/* Keep parent arena, while mem is alive. mem must have no parent yet. */
+void arena_set_parent(arena *mem, arena *parent);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef UNIX_SHELL_AST_H
+#define UNIX_SHELL_AST_H
+
+#include "arena.h"
+
+/* Kinds of redirections. */
+#define REDIR_IN     0 /* < file */
+#define REDIR_OUT    1 /* > file */
+#define REDIR_APPEND 2 /* >> file */
+
+/* Redirection of command stream to file. */
+typedef struct redirect
+{
+    struct redirect *next;      /* next redirection of command */
+    int kind;                   /* one of REDIR_* */
+    char *file;                 /* name of file */
+    int dynamic;                /* true if name has expansions */
+    size_t offset;              /* offset of name in line, if it's dynamic */
+} redirect;
+
+/* Word of command after expansion. */
+typedef struct word
+{
+    struct word *next;          /* next word of command */
+    char *text;                 /* value of word, points to line, if possible.
+                                   NULL, if dynamic word was expanded to nothing */
+    int fields;                 /* count of args in text, which are separated by '\0'.
+                                   Unquoted output of command substitution is split to several */
+    int dynamic;                /* true if word has expansions, so it's expanded again for cached line */
+    size_t offset;              /* offset of word in line, if it's dynamic */
+} word;
+
+/* Process substitution <(command) or >(command), which is replaced by path of pipe to command. */
+typedef struct substitution
+{
+    struct substitution *next;  /* next substitution of command */
+    int kind;                   /* REDIR_IN for <(command), REDIR_OUT for >(command) */
+    char *arg;                  /* word of command in argv, which is replaced by path */
+    struct ast_command *command;/* substituted command */
+} substitution;
+
+/* Simple command of pipeline. */
+typedef struct ast_command
+{
+    struct ast_command *next;   /* next command in pipeline */
+    word *words;                /* words of command */
+    int argc;                   /* count of words with text */
+    char **argv;                /* words for exec, NULL terminated */
+    redirect *redirects;        /* redirections in order of line */
+    substitution *substs;       /* process substitutions in order of line */
+    int dynamic;                /* true if any word, redirection or substituted command is dynamic */
+} ast_command;
+
+/* Commands, connected by pipes. */
+typedef struct pipeline
+{
+    struct pipeline *next;      /* next pipeline in list */
+    ast_command *first_command; /* commands of pipeline */
+    int background;             /* true if pipeline ends with & */
+    char *text;                 /* text of pipeline, used for messages */
+} pipeline;
+
+/* Pipelines of line, separated by ; or &. */
+typedef struct cmd_list
+{
+    pipeline *first_pipeline;   /* pipelines in order of line */
+    arena *mem;                 /* memory of list and its strings */
+    char *source;               /* copy of line for expansion of dynamic words, NULL if there aren't them */
+    size_t len;                 /* length of source */
+} cmd_list;
+
+#endif
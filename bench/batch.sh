@@ -0,0 +1,33 @@
+#!/bin/sh
+# Measure startup time and per-line overhead of non-interactive mode.
+# Usage: bench/batch.sh path/to/unix_shell [runs] [lines]
+
+SHELL_BIN=${1:?usage: $0 path/to/unix_shell [runs] [lines]}
+RUNS=${2:-1000}
+LINES=${3:-100000}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+now() { date +%s%N; }
+
+# Startup: empty command string, so only init and exit are measured.
+begin=$(now)
+i=0
+while [ "$i" -lt "$RUNS" ]; do
+    "$SHELL_BIN" -c '' || exit 1
+    i=$((i + 1))
+done
+end=$(now)
+echo "startup:  $(( (end - begin) / RUNS / 1000 )) us/run ($RUNS runs)"
+
+# Per line: builtin without process, so only reading and parsing are measured.
+i=0
+while [ "$i" -lt "$LINES" ]; do
+    echo "set"
+    i=$((i + 1))
+done > "$SCRIPT"
+
+begin=$(now)
+"$SHELL_BIN" "$SCRIPT" > /dev/null || exit 1
+end=$(now)
+echo "per line: $(( (end - begin) / LINES )) ns/line ($LINES lines)"
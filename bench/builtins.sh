@@ -0,0 +1,38 @@
+#!/bin/sh
+# Compare in-process utilities of the shell with the same external programs.
+# Usage: bench/builtins.sh path/to/unix_shell [lines] [runs]
+
+SHELL_BIN=${1:?usage: $0 path/to/unix_shell [lines] [runs]}
+LINES=${2:-20000}
+RUNS=${3:-3}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+now() { date +%s%N; }
+
+# Print fastest run of script made of LINES copies of command $2, labelled $1.
+measure() {
+    awk -v lines="$LINES" -v cmd="$2" 'BEGIN { for (i = 0; i < lines; i++) print cmd }' > "$SCRIPT"
+    best=
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        begin=$(now)
+        "$SHELL_BIN" "$SCRIPT" > /dev/null || exit 1
+        end=$(now)
+        ns=$((end - begin))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+            best=$ns
+        fi
+        i=$((i + 1))
+    done
+    echo "$1: $(( best / LINES )) ns/command"
+}
+
+measure "echo (builtin)" "echo x"
+measure "echo (external)" "/bin/echo x"
+measure "true (builtin)" "true"
+measure "true (external)" "/bin/true"
+measure "test (builtin)" "test -f /etc/passwd"
+measure "test (external)" "/usr/bin/test -f /etc/passwd"
+measure "printf (builtin)" "printf \"%05d\" 42"
+measure "printf (external)" "/usr/bin/printf \"%05d\" 42"
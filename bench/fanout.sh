@@ -0,0 +1,37 @@
+#!/bin/sh
+# Compare output fan-out of several redirections with a pipeline through external tee,
+# which copies all data through its own buffers.
+# Usage: bench/fanout.sh path/to/unix_shell [megabytes] [runs]
+
+SHELL_BIN=${1:?usage: $0 path/to/unix_shell [megabytes] [runs]}
+MEGABYTES=${2:-512}
+RUNS=${3:-3}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+now() { date +%s%N; }
+
+# Print throughput of the fastest run of command $2, labelled $1.
+measure() {
+    best=
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        rm -f "$DIR"/a "$DIR"/b
+        begin=$(now)
+        "$SHELL_BIN" -c "$2" || exit 1
+        end=$(now)
+        ns=$((end - begin))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+            best=$ns
+        fi
+        i=$((i + 1))
+    done
+    echo "$1: $(( MEGABYTES * 1000000000 / best )) MB/s"
+}
+
+SOURCE="head -c $((MEGABYTES * 1024 * 1024)) /dev/zero"
+TEE=$(command -v tee)
+measure "two files, tee" "$SOURCE | $TEE $DIR/a > $DIR/b"
+measure "two files, fanout" "$SOURCE > $DIR/a > $DIR/b"
+measure "file and pipe, tee" "$SOURCE | $TEE $DIR/a | wc -c > /dev/null"
+measure "file and pipe, fanout" "$SOURCE > $DIR/a | wc -c > /dev/null"
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Measure throughput of pipelines of cat: utilities of shell on threads with ring buffers
+# against external programs connected by pipes.
+# Usage: bench/pipeline.sh path/to/unix_shell [megabytes] [runs]
+
+SHELL_BIN=${1:?usage: $0 path/to/unix_shell [megabytes] [runs]}
+MEGABYTES=${2:-1024}
+RUNS=${3:-3}
+DATA=$(mktemp)
+trap 'rm -f "$DATA"' EXIT
+
+now() { date +%s%N; }
+
+head -c "$((MEGABYTES * 1024 * 1024))" /dev/zero > "$DATA"
+
+# Print throughput of the fastest run of pipeline $2, labelled $1.
+measure() {
+    best=
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        begin=$(now)
+        "$SHELL_BIN" -c "$2" || exit 1
+        end=$(now)
+        ns=$((end - begin))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+            best=$ns
+        fi
+        i=$((i + 1))
+    done
+    echo "$1: $(( MEGABYTES * 1000000000 / best )) MB/s"
+}
+
+CAT=$(command -v cat)
+measure "builtin cat | cat | cat | cat" "cat $DATA | cat | cat | cat > /dev/null"
+measure "external cat | cat | cat | cat" "$CAT $DATA | $CAT | $CAT | $CAT > /dev/null"
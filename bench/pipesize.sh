@@ -0,0 +1,38 @@
+#!/bin/sh
+# Measure throughput of pipelines with different capacities of pipes: default of kernel,
+# fixed sizes of pipesize= prefix and pipes of pipesize=auto, which grow through relays.
+# Usage: bench/pipesize.sh path/to/unix_shell [megabytes] [runs]
+
+SHELL_BIN=${1:?usage: $0 path/to/unix_shell [megabytes] [runs]}
+MEGABYTES=${2:-256}
+RUNS=${3:-3}
+DATA=$(mktemp)
+trap 'rm -f "$DATA"' EXIT
+
+now() { date +%s%N; }
+
+# Lines of numbers, compressed fast, so decompression isn't the only bottleneck.
+seq 1 100000000 | head -c "$((MEGABYTES * 1024 * 1024))" | gzip -1 > "$DATA"
+
+# Print throughput of the fastest run of pipeline $2 with each prefix of pipesize, labelled $1.
+measure() {
+    for prefix in "" pipesize=16K pipesize=256K pipesize=1M pipesize=auto; do
+        best=
+        i=0
+        while [ "$i" -lt "$RUNS" ]; do
+            begin=$(now)
+            "$SHELL_BIN" -c "$prefix $2" || exit 1
+            end=$(now)
+            ns=$((end - begin))
+            if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+                best=$ns
+            fi
+            i=$((i + 1))
+        done
+        echo "$1 ${prefix:-default}: $(( MEGABYTES * 1000000000 / best )) MB/s"
+    done
+}
+
+CAT=$(command -v cat)
+measure "decompress | parse | aggregate" "gzip -dc $DATA | tr 0-9 a-j | wc -l > /dev/null"
+measure "cat | cat | cat" "head -c $((MEGABYTES * 1024 * 1024)) /dev/zero | $CAT | $CAT | wc -c > /dev/null"
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Compare loadable builtin normpath with external realpath. Scripts load the builtin,
+# run it alone and in pipeline, and unload it.
+# Usage: bench/plugin.sh path/to/unix_shell path/to/normpath.so [lines] [runs]
+
+SHELL_BIN=${1:?usage: $0 path/to/unix_shell path/to/normpath.so [lines] [runs]}
+PLUGIN=${2:?usage: $0 path/to/unix_shell path/to/normpath.so [lines] [runs]}
+LINES=${3:-20000}
+RUNS=${4:-3}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+now() { date +%s%N; }
+
+# Print fastest run of script made of LINES copies of command $2, labelled $1.
+measure() {
+    {
+        echo "enable -f $PLUGIN normpath"
+        awk -v lines="$LINES" -v cmd="$2" 'BEGIN { for (i = 0; i < lines; i++) print cmd }'
+        echo "enable -d normpath"
+    } > "$SCRIPT"
+    best=
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        begin=$(now)
+        "$SHELL_BIN" "$SCRIPT" > /dev/null || exit 1
+        end=$(now)
+        ns=$((end - begin))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+            best=$ns
+        fi
+        i=$((i + 1))
+    done
+    echo "$1: $(( best / LINES )) ns/command"
+}
+
+# Loaded builtin gives the same paths as realpath without symbolic links.
+expected=$(realpath -m -s /usr/./lib/../bin//x)
+actual=$("$SHELL_BIN" -c "enable -f $PLUGIN normpath; echo /usr/./lib/../bin//x | normpath | cat; enable -d normpath")
+if [ "$expected" != "$actual" ]; then
+    echo "normpath: expected $expected, got $actual" >&2
+    exit 1
+fi
+
+# Builtin with args doesn't read input, so it runs in the shell without fork even on input of device.
+spawns=$("$SHELL_BIN" -c "enable -f $PLUGIN normpath; stats -r; normpath /usr/./lib/../bin//x; stats; enable -d normpath" < /dev/null \
+         | awk '$1 == "spawn" { print $2 }')
+if [ "$spawns" != 0 ]; then
+    echo "normpath: expected to run in the shell, got ${spawns:-no} spawns" >&2
+    exit 1
+fi
+
+measure "normpath (builtin)" "normpath /usr/./lib/../bin//x"
+measure "normpath (external)" "realpath -m -s /usr/./lib/../bin//x"
+measure "normpath | cat (builtin)" "echo /usr/./lib/../bin//x | normpath | cat"
+measure "normpath | cat (external)" "echo /usr/./lib/../bin//x | xargs realpath -m -s | cat"
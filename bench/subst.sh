@@ -0,0 +1,37 @@
+#!/bin/sh
+# Compare command substitutions of utilities of the shell, which write to memory without fork,
+# with substitutions of external programs, which write to pipe.
+# Usage: bench/subst.sh path/to/unix_shell [lines] [runs]
+
+SHELL_BIN=${1:?usage: $0 path/to/unix_shell [lines] [runs]}
+LINES=${2:-5000}
+RUNS=${3:-3}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+now() { date +%s%N; }
+
+# Print fastest run of script made of LINES copies of command $2, labelled $1.
+measure() {
+    awk -v lines="$LINES" -v cmd="$2" 'BEGIN { for (i = 0; i < lines; i++) print cmd }' > "$SCRIPT"
+    best=
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        begin=$(now)
+        "$SHELL_BIN" "$SCRIPT" > /dev/null || exit 1
+        end=$(now)
+        ns=$((end - begin))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+            best=$ns
+        fi
+        i=$((i + 1))
+    done
+    echo "$1: $(( best / LINES )) ns/line"
+}
+
+measure "no substitution" "echo /tmp"
+measure "\$(pwd) (builtin)" "echo \$(pwd)"
+measure "\$(pwd) (external)" "echo \$(/bin/pwd)"
+measure "\$(echo a b c) (builtin)" "echo \$(echo a b c)"
+measure "\$(echo a b c) (external)" "echo \$(/bin/echo a b c)"
+measure "\$(seq 1000) (external)" "echo \$(seq 1000)"
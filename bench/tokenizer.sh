@@ -0,0 +1,45 @@
+#!/bin/sh
+# Measure throughput of reading and parsing large generated scripts without executing them.
+# Usage: bench/tokenizer.sh path/to/unix_shell [lines] [runs]
+# Scalar tokenizer is built with -DTOKENIZER_NO_SIMD, AVX2 one with -mavx2.
+
+SHELL_BIN=${1:?usage: $0 path/to/unix_shell [lines] [runs]}
+LINES=${2:-200000}
+RUNS=${3:-5}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+now() { date +%s%N; }
+
+# Mix of long plain words, quotes, escapes, expansions, pipes and redirections.
+awk -v lines="$LINES" 'BEGIN {
+    for (i = 0; i < lines; i++)
+    {
+        if (i % 4 == 0)
+            printf "/usr/bin/some-long-command-name --option-number-%d=value /path/to/some/file/%d.txt | grep -v pattern > /tmp/out%d.log\n", i, i, i;
+        else if (i % 4 == 1)
+            printf "echo \"quoted string with spaces number %d\" and\\ escaped\\ words \"$HOME/dir\" tail; true\n", i;
+        else if (i % 4 == 2)
+            printf "cmd a b c d e f g h i j k l m n o p q r s t u v w x y z %d < /dev/null >> /tmp/append.log &\n", i;
+        else
+            printf "printf \"%%s\\\\n\" aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa%d bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb\n", i;
+    }
+}' > "$SCRIPT"
+
+BYTES=$(wc -c < "$SCRIPT")
+
+# The fastest run is reported, because it's the least disturbed by other load.
+best=
+i=0
+while [ "$i" -lt "$RUNS" ]; do
+    begin=$(now)
+    "$SHELL_BIN" -o noexec "$SCRIPT" || exit 1
+    end=$(now)
+    ns=$((end - begin))
+    if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+        best=$ns
+    fi
+    i=$((i + 1))
+done
+
+echo "tokenizer: $(( BYTES * 1000 / best )) MB/s, $(( best / LINES )) ns/line ($LINES lines, $BYTES bytes, best of $RUNS runs)"
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "board.h"
+#include "shell_board.h"
+#include "options.h"
+
+static shell_board *board = NULL;      /* mapped board of the shell, or NULL */
+static char board_path[64];             /* path of board file */
+
+/* Create board file and map it. Return 0, if success. */
+static int board_open();
+
+/* Write fields of value except seq to slot under its seqlock. */
+static void write_slot(board_slot *slot, const board_slot *value);
+
+/* Publish state of job j to board, if board option is set. Board is created at the first update
+   and removed after the option is reset. It's called after flags of processes of j are changed. */
+void board_job(job *j)
+{
+    board_slot value;
+    struct timespec now, mono;
+    process *p;
+
+    if (!get_option(OPT_BOARD))
+    {
+        board_close();
+        return;
+    }
+    if (!j || (!board && board_open()))
+        return;
+
+    memset(&value, 0, sizeof(value));
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    /* Job gets a slot at its first update. Start time is moved back by time since start of its first process. */
+    if (j->board_slot)
+        value.start = board->slots[j->board_slot - 1].start;
+    else
+    {
+        for (unsigned i = 0; i < BOARD_SLOTS && !j->board_slot; ++i)
+            if (board->slots[i].state == BOARD_FREE)
+                j->board_slot = (int) i + 1;
+        if (!j->board_slot)
+        {
+            atomic_fetch_add(&board->overflows, 1);
+            return;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        value.start = (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+        if (j->first_process && j->first_process->usage.begin)
+            value.start -= (long long) ((unsigned long long) mono.tv_sec * 1000000000ULL
+                                        + (unsigned long long) mono.tv_nsec - j->first_process->usage.begin);
+    }
+
+    if (job_is_completed(j))
+    {
+        value.state = BOARD_COMPLETED;
+        value.status = job_exit_status(j);
+    }
+    else
+        value.state = job_is_stopped(j) ? BOARD_STOPPED : BOARD_RUNNING;
+
+    value.jid = j->jid;
+    value.pgid = (int) j->pgid;
+    for (p = j->first_process; p; p = p->next)
+    {
+        value.processes++;
+        if (p->completed && p->usage.user >= 0 && p->usage.sys >= 0)
+            value.cpu += p->usage.user + p->usage.sys;
+    }
+    strncpy(value.command, j->command ? j->command : "", BOARD_COMMAND_SIZE - 1);
+
+    write_slot(&board->slots[j->board_slot - 1], &value);
+}
+
+/* Free slot of job j, which is removed from job list. */
+void board_remove(job *j)
+{
+    board_slot value;
+
+    if (!board || !j->board_slot)
+        return;
+
+    memset(&value, 0, sizeof(value));
+    write_slot(&board->slots[j->board_slot - 1], &value);
+    j->board_slot = 0;
+}
+
+/* Unmap and remove board. */
+void board_close()
+{
+    if (!board)
+        return;
+
+    /* Slots of jobs belong to this board only. */
+    for (job *j = get_job_list_head(); j; j = j->next)
+        j->board_slot = 0;
+
+    munmap(board, sizeof(shell_board));
+    unlink(board_path);
+    board = NULL;
+}
+
+/* Unmap board in child process, so it doesn't change board of the shell. */
+void board_detach()
+{
+    if (board)
+        munmap(board, sizeof(shell_board));
+    board = NULL;
+}
+
+/* Create board file and map it. Return 0, if success. */
+static int board_open()
+{
+    int fd;
+    void *mem;
+
+    snprintf(board_path, sizeof(board_path), "%s/%s%d", BOARD_DIR, BOARD_PREFIX, (int) getpid());
+    if ((fd = open(board_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+    {
+        perror(board_path);
+        set_option("board", 0);
+        return -1;
+    }
+
+    /* New file is filled by zeros, so all slots are free. */
+    if (ftruncate(fd, sizeof(shell_board)) == -1
+        || (mem = mmap(NULL, sizeof(shell_board), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror(board_path);
+        close(fd);
+        unlink(board_path);
+        set_option("board", 0);
+        return -1;
+    }
+    close(fd);
+
+    board = mem;
+    board->version = BOARD_VERSION;
+    board->pid = (int) getpid();
+    board->slot_count = BOARD_SLOTS;
+
+    /* Readers check magic, so it's written after other fields of header. */
+    atomic_thread_fence(memory_order_release);
+    board->magic = BOARD_MAGIC;
+
+    return 0;
+}
+
+/* Write fields of value except seq to slot under its seqlock. */
+static void write_slot(board_slot *slot, const board_slot *value)
+{
+    unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    /* Odd seq tells readers to retry, fence keeps it before changes of fields. */
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy((char *) slot + offsetof(board_slot, state), (const char *) value + offsetof(board_slot, state),
+           sizeof(board_slot) - offsetof(board_slot, state));
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
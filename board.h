@@ -0,0 +1,19 @@
+#ifndef UNIX_SHELL_BOARD_H
+#define UNIX_SHELL_BOARD_H
+
+#include "jobs.h"
+
+/* Publish state of job j to board, if board option is set. Board is created at the first update
+   and removed after the option is reset. It's called after flags of processes of j are changed. */
+void board_job(job *j);
+
+/* Free slot of job j, which is removed from job list. */
+void board_remove(job *j);
+
+/* Unmap and remove board. */
+void board_close();
+
+/* Unmap board in child process, so it doesn't change board of the shell. */
+void board_detach();
+
+#endif
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "builtins.h"
+#include "plugins.h"
+
+static const builtin **entries = NULL;  /* registered builtins */
+static size_t entry_count = 0;          /* count of registered builtins */
+static size_t entry_capacity = 0;       /* size of entries */
+static const builtin **table = NULL;    /* perfect hash table: each builtin has own slot */
+static size_t table_size = 0;           /* count of slots of table, power of 2 */
+static uint32_t table_seed = 0;         /* seed of hash, which gives no collisions in table */
+
+/* Hash name with seed. */
+static uint32_t builtin_hash(const char *name, uint32_t seed);
+
+/* Add builtin b to entries without rebuilding of table. Return 0, if success. */
+static int add_entry(const builtin *b);
+
+/* Find size and seed of table, which put registered builtins to different slots, and fill it.
+   Return 0, if success. */
+static int build_table();
+
+/* Add builtins of list, terminated by entry with NULL name, to registry.
+   Builtin replaces registered one with the same name. Entries must live until they are removed.
+   Return 0, if success. */
+int register_builtins(const builtin *list)
+{
+    assert(list != NULL);
+
+    for (; list->name; ++list)
+        if (add_entry(list))
+            return -1;
+
+    return build_table();
+}
+
+/* Add builtin b to registry like register_builtins. Return 0, if success. */
+int register_builtin(const builtin *b)
+{
+    assert(b != NULL);
+
+    return add_entry(b) ? -1 : build_table();
+}
+
+/* Remove builtin name from registry. Return 1, if removed. */
+int unregister_builtin(const char *name)
+{
+    assert(name != NULL);
+
+    for (size_t i = 0; i < entry_count; ++i)
+        if (!strcmp(entries[i]->name, name))
+        {
+            entries[i] = entries[--entry_count];
+
+            /* Smaller set of names has no collisions with the same seed. */
+            size_t slot = builtin_hash(name, table_seed) & (table_size - 1);
+            table[slot] = NULL;
+            return 1;
+        }
+
+    return 0;
+}
+
+/* Find builtin name by perfect hash. Return NULL, if name isn't builtin.
+   name must be non null. */
+const builtin *find_builtin(const char *name)
+{
+    assert(name != NULL);
+
+    if (!table)
+        return NULL;
+
+    /* Only one name may be in the slot, so one comparison is enough. */
+    const builtin *b = table[builtin_hash(name, table_seed) & (table_size - 1)];
+    return b && !strcmp(b->name, name) ? b : NULL;
+}
+
+/* Execute builtin b with args argv and streams io. Return result of its exec. */
+int run_builtin(const builtin *b, const char *argv[], const builtin_streams *io)
+{
+    assert(b != NULL);
+
+    return b->kind == BUILTIN_PLUGIN ? run_plugin(b, argv, io) : b->exec(argv, io);
+}
+
+/* Execute builtin b with args argv. Read input from infile_local and write output to outfile_local. */
+int exec_builtin(const builtin *b, const char *argv[], int infile_local, int outfile_local)
+{
+    assert(b != NULL);
+
+    builtin_streams io = {infile_local, outfile_local, NULL, NULL};
+    return run_builtin(b, argv, &io);
+}
+
+/* Remove all builtins. */
+void clear_builtins()
+{
+    free(entries);
+    free(table);
+    entries = table = NULL;
+    entry_count = entry_capacity = table_size = 0;
+    table_seed = 0;
+}
+
+/* Add builtin b to entries without rebuilding of table. Return 0, if success. */
+static int add_entry(const builtin *b)
+{
+    size_t i;
+
+    for (i = 0; i < entry_count && strcmp(entries[i]->name, b->name); ++i);
+
+    if (i == entry_count)
+    {
+        if (entry_count == entry_capacity)
+        {
+            size_t capacity = entry_capacity ? entry_capacity * 2 : BUILTIN_TABLE_MIN;
+            const builtin **grown = realloc(entries, capacity * sizeof(builtin *));
+
+            if (!grown)
+                return -1;
+            entries = grown;
+            entry_capacity = capacity;
+        }
+        entry_count++;
+    }
+    entries[i] = b;
+
+    return 0;
+}
+
+/* Hash name with seed. */
+static uint32_t builtin_hash(const char *name, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+
+    for (; *name; ++name)
+        hash = (hash ^ (unsigned char) *name) * 16777619u;
+
+    return hash ^ (hash >> 15);
+}
+
+/* Find size and seed of table, which put registered builtins to different slots, and fill it.
+   Return 0, if success. */
+static int build_table()
+{
+    size_t size = BUILTIN_TABLE_MIN;
+    const builtin **slots;
+
+    /* Sparse table needs less seeds to be tried. */
+    while (size < entry_count * 4)
+        size *= 2;
+
+    while (1)
+    {
+        if (!(slots = malloc(size * sizeof(builtin *))))
+            return -1;
+
+        for (uint32_t seed = 0; seed < BUILTIN_SEED_TRIES; ++seed)
+        {
+            size_t i;
+
+            memset(slots, 0, size * sizeof(builtin *));
+            for (i = 0; i < entry_count; ++i)
+            {
+                size_t slot = builtin_hash(entries[i]->name, seed) & (size - 1);
+                if (slots[slot])
+                    break;
+                slots[slot] = entries[i];
+            }
+
+            if (i == entry_count)
+            {
+                free(table);
+                table = slots;
+                table_size = size;
+                table_seed = seed;
+                return 0;
+            }
+        }
+
+        free(slots);
+        size *= 2;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef UNIX_SHELL_BUILTINS_H
+#define UNIX_SHELL_BUILTINS_H
+
+#include "ring.h"
+
+#define BUILTIN_INNER       1    /* inner command, which changes state of shell on main thread */
+#define BUILTIN_UTIL        2    /* utility, which may run on thread of shell or in child process */
+#define BUILTIN_PLUGIN      3    /* utility of shared object, loaded by enable -f, which uses descriptors only */
+#define BUILTIN_TABLE_MIN   32   /* minimal count of slots of builtin table, power of 2 */
+#define BUILTIN_SEED_TRIES  4096 /* seeds of hash tried for table size, before the table grows */
+
+/* Check builtin b, which may be NULL, is inner command or utility. Loaded builtins are utilities too. */
+#define BUILTIN_IS_INNER(b) ((b) && (b)->kind == BUILTIN_INNER)
+#define BUILTIN_IS_UTIL(b)  ((b) && ((b)->kind == BUILTIN_UTIL || (b)->kind == BUILTIN_PLUGIN))
+
+/* Check builtin b, which may be NULL, accepts ring buffers as streams. */
+#define BUILTIN_USES_RINGS(b) ((b) && (b)->kind == BUILTIN_UTIL)
+
+/* Streams of builtin. Ring buffer is used instead of descriptor, if it isn't NULL. */
+typedef struct builtin_streams
+{
+    int in, out;                /* input and output descriptors */
+    ring *in_ring, *out_ring;   /* input and output ring buffers of thread, only for utilities */
+} builtin_streams;
+
+/* Command, which is executed by the shell itself. */
+typedef struct builtin
+{
+    const char *name;   /* name of command */
+    int kind;           /* BUILTIN_INNER, BUILTIN_UTIL or BUILTIN_PLUGIN */
+
+    /* Execute builtin with args argv and streams io.
+       Inner command returns EXEC_SUCCESS, EXEC_FAILED or MAY_EXIT. Utility returns exit status.
+       It is NULL for loaded builtins, which are run by run_plugin. */
+    int (*exec)(const char *argv[], const builtin_streams *io);
+} builtin;
+
+/* Add builtins of list, terminated by entry with NULL name, to registry.
+   Builtin replaces registered one with the same name. Entries must live until they are removed.
+   Return 0, if success. */
+int register_builtins(const builtin *list);
+
+/* Add builtin b to registry like register_builtins. Return 0, if success. */
+int register_builtin(const builtin *b);
+
+/* Remove builtin name from registry. Return 1, if removed. */
+int unregister_builtin(const char *name);
+
+/* Find builtin name by perfect hash. Return NULL, if name isn't builtin.
+   name must be non null. */
+const builtin *find_builtin(const char *name);
+
+/* Execute builtin b with args argv and streams io. Return result of its exec. */
+int run_builtin(const builtin *b, const char *argv[], const builtin_streams *io);
+
+/* Execute builtin b with args argv. Read input from infile_local and write output to outfile_local. */
+int exec_builtin(const builtin *b, const char *argv[], int infile_local, int outfile_local);
+
+/* Remove all builtins. */
+void clear_builtins();
+
+#endif
@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "capture.h"
+#include "workers.h"
+
+/* Output of command substitution, which is read by thread. */
+struct capture
+{
+    pthread_t thread;       /* reader of pipe */
+    int in;                 /* reading end of pipe */
+    char *data;             /* buffer of output */
+    size_t size;            /* size of buffer */
+    size_t len;             /* length of output */
+};
+
+static int memory_fd = -1;  /* file in memory for output of builtins, or -1 */
+
+/* Body of reader thread. Read pipe of capture to its buffer until end of file. */
+static void *run_capture(void *arg);
+
+/* Read all data of fd to *data, which grows by doubling, from offset *len. *size is size of *data.
+   Return 0, if success. Or -1, if memory can't be allocated. */
+static int read_all(int fd, char **data, size_t *size, size_t *len);
+
+/* Start reading of new pipe to *c and set *fd to its writing end for commands.
+   Return 0, if success. Or errno. */
+int capture_start(capture **c, int *fd)
+{
+    int fds[2], err;
+
+    if (!(*c = malloc(sizeof(capture))))
+        return ENOMEM;
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        err = errno;
+        free(*c);
+        return err;
+    }
+    (*c)->in = fds[0];
+    (*c)->data = NULL;
+    (*c)->size = (*c)->len = 0;
+
+    err = start_shell_thread(run_capture, *c, &(*c)->thread);
+
+    if (err)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        free(*c);
+        return err;
+    }
+
+    *fd = fds[1];
+    return 0;
+}
+
+/* Wait for end of file of pipe of c after all its writers closed it and free c.
+   Set *data to output, which caller frees, or NULL if it's empty. Return size of output. */
+size_t capture_finish(capture *c, char **data)
+{
+    size_t len;
+
+    pthread_join(c->thread, NULL);
+    close(c->in);
+
+    *data = c->data;
+    len = c->len;
+    free(c);
+
+    if (!len)
+    {
+        free(*data);
+        *data = NULL;
+    }
+
+    return len;
+}
+
+/* Return descriptor of file in memory, which builtins inside the shell write output to,
+   or -1 if it can't be created. The file is reused, capture_memory() empties it. */
+int capture_memory_fd()
+{
+    if (memory_fd == -1)
+        memory_fd = memfd_create("capture", MFD_CLOEXEC);
+
+    return memory_fd;
+}
+
+/* Move output, written to file of capture_memory_fd(), to *data, which caller frees,
+   or set it to NULL if output is empty. Return size of output. */
+size_t capture_memory(char **data)
+{
+    size_t size = 0, len = 0;
+
+    /* Builtin writes from the beginning of empty file, so it's read from there too. */
+    *data = NULL;
+    if (lseek(memory_fd, 0, SEEK_SET) == 0)
+        read_all(memory_fd, data, &size, &len);
+    if (!len)
+    {
+        free(*data);
+        *data = NULL;
+    }
+
+    if (ftruncate(memory_fd, 0) < 0 || lseek(memory_fd, 0, SEEK_SET) < 0)
+    {
+        /* Broken file is replaced by new one at the next call. */
+        close(memory_fd);
+        memory_fd = -1;
+    }
+
+    return len;
+}
+
+/* Body of reader thread. Read pipe of capture to its buffer until end of file. */
+static void *run_capture(void *arg)
+{
+    capture *c = arg;
+    char rest[4096];
+    ssize_t n;
+
+    /* Output, which doesn't fit to memory, is dropped, but writers aren't blocked. */
+    if (read_all(c->in, &c->data, &c->size, &c->len))
+        while ((n = read(c->in, rest, sizeof(rest))) > 0 || (n < 0 && errno == EINTR));
+
+    return NULL;
+}
+
+/* Read all data of fd to *data, which grows by doubling, from offset *len. *size is size of *data.
+   Return 0, if success. Or -1, if memory can't be allocated. */
+static int read_all(int fd, char **data, size_t *size, size_t *len)
+{
+    ssize_t n;
+    char *grown;
+
+    while (1)
+    {
+        if (*size - *len < CAPTURE_READ_SIZE)
+        {
+            size_t new_size = *size ? *size * 2 : CAPTURE_READ_SIZE;
+
+            if (!(grown = realloc(*data, new_size)))
+                return -1;
+            *data = grown;
+            *size = new_size;
+        }
+
+        if ((n = read(fd, *data + *len, *size - *len)) > 0)
+            *len += (size_t) n;
+        else if (n == 0 || errno != EINTR)
+            return 0;
+    }
+}
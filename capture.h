@@ -0,0 +1,28 @@
+#ifndef UNIX_SHELL_CAPTURE_H
+#define UNIX_SHELL_CAPTURE_H
+
+#include <stddef.h>
+
+#define CAPTURE_READ_SIZE (64 * 1024) /* minimal free space of buffer for one read */
+
+/* Output of command substitution, which thread of shell reads from pipe into growable buffer,
+   so command never blocks on full pipe, while the shell waits for it. */
+typedef struct capture capture;
+
+/* Start reading of new pipe to *c and set *fd to its writing end for commands.
+   Return 0, if success. Or errno. */
+int capture_start(capture **c, int *fd);
+
+/* Wait for end of file of pipe of c after all its writers closed it and free c.
+   Set *data to output, which caller frees, or NULL if it's empty. Return size of output. */
+size_t capture_finish(capture *c, char **data);
+
+/* Return descriptor of file in memory, which builtins inside the shell write output to,
+   or -1 if it can't be created. The file is reused, capture_memory() empties it. */
+int capture_memory_fd();
+
+/* Move output, written to file of capture_memory_fd(), to *data, which caller frees,
+   or set it to NULL if output is empty. Return size of output. */
+size_t capture_memory(char **data);
+
+#endif
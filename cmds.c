@@ -1,259 +1,605 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 #include <assert.h>
 #include "cmds.h"
 #include "jobs.h"
 #include "shell.h"
+#include "spawn.h"
+#include "options.h"
+#include "pathcache.h"
+#include "parsecache.h"
+#include "plugins.h"
+#include "stats.h"
+#include "trace.h"
+#include "monitor.h"
 
-/* Exec inner command.
-   Notify, this commands not executed in forked process.
-   Fall, if name == NULL. */
-int command_is_inner(const char* name)
+/* exit [status] */
+static int inner_exit(const char *argv[], const builtin_streams *io);
+
+/* cd [directory] */
+static int inner_cd(const char *argv[], const builtin_streams *io);
+
+/* jobs [-l] */
+static int inner_jobs(const char *argv[], const builtin_streams *io);
+
+/* bg [pid] */
+static int inner_bg(const char *argv[], const builtin_streams *io);
+
+/* fg [pid] */
+static int inner_fg(const char *argv[], const builtin_streams *io);
+
+/* set [-o option[=value]] [+o option] */
+static int inner_set(const char *argv[], const builtin_streams *io);
+
+/* spawnstat [-r] */
+static int inner_spawnstat(const char *argv[], const builtin_streams *io);
+
+/* hash [-r] [-d] [command...] */
+static int inner_hash(const char *argv[], const builtin_streams *io);
+
+/* parsecache [-r] */
+static int inner_parsecache(const char *argv[], const builtin_streams *io);
+
+/* enable [-f library name...] [-d name...] */
+static int inner_enable(const char *argv[], const builtin_streams *io);
+
+/* time */
+static int inner_time(const char *argv[], const builtin_streams *io);
+
+/* stats [-r] [-j] */
+static int inner_stats(const char *argv[], const builtin_streams *io);
+
+/* trace [file | -f fd | -d] */
+static int inner_trace(const char *argv[], const builtin_streams *io);
+
+/* monitor [-f fd | -u socket | -d] */
+static int inner_monitor(const char *argv[], const builtin_streams *io);
+
+/* Inner commands of shell: cd, exit, jobs, bg, fg, set, spawnstat, hash, parsecache, enable, time, stats, trace
+   and monitor.
+   They run on main thread, because they change state of shell.
+   The list is terminated by entry with NULL name. */
+const builtin inner_builtins[] =
+{
+    {"exit",       BUILTIN_INNER, inner_exit},
+    {"cd",         BUILTIN_INNER, inner_cd},
+    {"jobs",       BUILTIN_INNER, inner_jobs},
+    {"bg",         BUILTIN_INNER, inner_bg},
+    {"fg",         BUILTIN_INNER, inner_fg},
+    {"set",        BUILTIN_INNER, inner_set},
+    {"spawnstat",  BUILTIN_INNER, inner_spawnstat},
+    {"hash",       BUILTIN_INNER, inner_hash},
+    {"parsecache", BUILTIN_INNER, inner_parsecache},
+    {"enable",     BUILTIN_INNER, inner_enable},
+    {"time",       BUILTIN_INNER, inner_time},
+    {"stats",      BUILTIN_INNER, inner_stats},
+    {"trace",      BUILTIN_INNER, inner_trace},
+    {"monitor",    BUILTIN_INNER, inner_monitor},
+    {NULL,         0,             NULL}
+};
+
+/* exit [status] */
+static int inner_exit(const char *argv[], const builtin_streams *io)
 {
-    assert(name != NULL);
-    return !strcmp(name, "cd") || !strcmp(name, "exit") || !strcmp(name, "jobs") || !strcmp(name, "bg") || !strcmp(name, "fg");
+    (void) argv;
+    (void) io;
+
+    /* Return code for exit from shell. */
+    return MAY_EXIT;
 }
 
-/* Exec inner command. Notify, this commands not executed in forked process. */
-int exec_inner(const char *name, const char *argv[], int infile_local, int outfile_local)
+/* cd [directory] */
+static int inner_cd(const char *argv[], const builtin_streams *io)
 {
-    assert(name != NULL);
-    assert(argv != NULL);
+    int size = 0;
+    int i = 1;
+
+    (void) io;
+
+    /* Check args. */
+    while(argv[i++])
+        size++;
 
-    if(!strcmp(name, "exit"))
-        /* Return code for exit from shell. */
-        return MAY_EXIT;
-    else if(!strcmp(name, "cd"))
+    if(size > 1)
     {
-        int size = 0;
-        int i = 1;
+        fprintf(stderr, "%s: Too many args!\n", argv[1]);
+        fflush(stderr);
+        return EXEC_FAILED;
+    }
 
-        /* Check args. */
-        while(argv[i++])
-            size++;
+    int status = set_directory(argv[1]);
 
-        if(size > 1)
-        {
-            fprintf(stderr, "%s: Too many args!\n", argv[1]);
+    /* Check status of last command. */
+    switch(status)
+    {
+        case DIR_EXIST:
+            /* Invitation shows the new directory. */
+            update_invite_string();
+            return EXEC_SUCCESS;
+        case DIR_NOT_EXIST:
+            fprintf(stderr, "%s: No such file or directory!\n", argv[1]);
             fflush(stderr);
             return EXEC_FAILED;
-        }
+        case CANT_OPEN_DIR:
+            fprintf(stderr, "%s: Can't open dir!\n", argv[1]);
+            fflush(stderr);
+            return EXEC_FAILED;
+        case DIR_IS_FILE:
+            fprintf(stderr, "%s: Not a directory!\n", argv[1]);
+            fflush(stderr);
+            return EXEC_FAILED;
+        default:
+            return EXEC_FAILED;
+    }
+}
+
+/* jobs [-l] */
+static int inner_jobs(const char *argv[], const builtin_streams *io)
+{
+    int stdin_fd;
+    int stdout_fd;
+
+    /* Show jobs with resources of their processes. */
+    if(argv[1] && !strcmp(argv[1], "-l"))
+    {
+        print_job_list_usage(io->out);
+        return EXEC_SUCCESS;
+    }
 
-        int status = set_directory(argv[1]);
+    if((stdin_fd = dup(STDIN_FILENO)) == -1 || (stdout_fd = dup(STDOUT_FILENO)) == -1)
+    {
+        perror("jobs: dup");
+        shell_exit(EXEC_FAILED);
+    }
 
-        /* Check status of last command. */
-        switch(status)
+    if (io->in != STDIN_FILENO)
+    {
+        if(dup2(io->in, STDIN_FILENO) == -1)
         {
-            case DIR_EXIST:
-                return EXEC_SUCCESS;
-            case DIR_NOT_EXIST:
-                fprintf(stderr, "%s: No such file or directory!\n", argv[1]);
-                fflush(stderr);
-                return EXEC_FAILED;
-            case CANT_OPEN_DIR:
-                fprintf(stderr, "%s: Can't open dir!\n", argv[1]);
-                fflush(stderr);
-                return EXEC_FAILED;
-            case DIR_IS_FILE:
-                fprintf(stderr, "%s: Not a directory!\n", argv[1]);
-                fflush(stderr);
-                return EXEC_FAILED;
-            default:
-                return EXEC_FAILED;
+            perror("jobs: dup");
+            shell_exit(EXEC_FAILED);
         }
-    }else if(!strcmp(name, "jobs"))
+        close(io->in);
+    }
+    if (io->out != STDOUT_FILENO)
     {
-        int stdin_fd;
-        int stdout_fd;
-
-        if((stdin_fd = dup(STDIN_FILENO)) == -1 || (stdout_fd = dup(STDOUT_FILENO)) == -1)
+        if(dup2(io->out, STDOUT_FILENO) == -1)
         {
             perror("jobs: dup");
             shell_exit(EXEC_FAILED);
         }
+        close(io->out);
+    }
+
+    /* Show all executed jobs, but not terminated, jobs. */
+    do_job_notification(1);
 
-        if (infile_local != STDIN_FILENO)
+    if (io->in != STDIN_FILENO)
+    {
+        if(dup2(stdin_fd, STDIN_FILENO) == -1)
         {
-            if(dup2(infile_local, STDIN_FILENO) == -1)
-            {
-                perror("jobs: dup");
-                shell_exit(EXEC_FAILED);
-            }
-            close(infile_local);
+            perror("jobs: dup");
+            shell_exit(EXEC_FAILED);
         }
-        if (outfile_local != STDOUT_FILENO)
+        close(stdin_fd);
+    }
+    if (io->out != STDOUT_FILENO)
+    {
+        if(dup2(stdout_fd, STDOUT_FILENO) == -1)
         {
-            if(dup2(outfile_local, STDOUT_FILENO) == -1)
-            {
-                perror("jobs: dup");
-                shell_exit(EXEC_FAILED);
-            }
-            close(outfile_local);
+            perror("jobs: dup");
+            shell_exit(EXEC_FAILED);
         }
+        close(stdout_fd);
+    }
+
+    return EXEC_SUCCESS;
+}
 
-        /* Show all executed jobs, but not terminated, jobs. */
-        do_job_notification(1);
+/* bg [pid] */
+static int inner_bg(const char *argv[], const builtin_streams *io)
+{
+    int size = 0;
+    int i = 1;
+
+    (void) io;
+
+    /* Check args. */
+    while(argv[i++])
+        size++;
+
+    if(get_last_job_index() == 0)
+    {
+        fprintf(stderr, "Not enough jobs to run in bg!\n");
+        fflush(stderr);
+        return EXEC_FAILED;
+    }
 
-        if (infile_local != STDIN_FILENO)
+    /* Get last job at begin.
+       We choose pre last index, because of last is bg. */
+    job* jobs = find_job_jid(get_last_job_index() - 1);
+
+    if(size > 1)
+    {
+        fprintf(stderr, "%s: Too many args!\n", argv[1]);
+        fflush(stderr);
+        return EXEC_FAILED;
+    }else if(size == 1)
+    {
+        pid_t pid = (pid_t)strtol(argv[1], NULL, 10);
+
+        /* Check is the parsed PID correct. */
+        if(!pid || errno == ERANGE)
         {
-            if(dup2(stdin_fd, STDIN_FILENO) == -1)
-            {
-                perror("jobs: dup");
-                shell_exit(EXEC_FAILED);
-            }
-            close(stdin_fd);
+            fprintf(stderr, "Invalid pid!\n");
+            fflush(stderr);
+            return EXEC_FAILED;
         }
-        if (outfile_local != STDOUT_FILENO)
+        jobs = find_job_pgid(-pid);
+        /* Try to find job by pid. */
+        if(!jobs)
         {
-            if(dup2(stdout_fd, STDOUT_FILENO) == -1)
-            {
-                perror("jobs: dup");
-                shell_exit(EXEC_FAILED);
-            }
-            close(stdout_fd);
+            fprintf(stderr, "%d - no such job!\n", pid);
+            fflush(stderr);
+            return EXEC_FAILED;
         }
+    }
 
-        return EXEC_SUCCESS;
-    }else if(!strcmp(name, "bg"))
+    if(job_is_completed(jobs) && size == 1)
     {
-        int size = 0;
-        int i = 1;
-
-        /* Check args. */
-        while(argv[i++])
-            size++;
+        fprintf(stderr, "This job is terminated!\n");
+        return EXEC_FAILED;
+    } else if(job_is_completed(jobs))
+    {
+        jobs = NULL;
+        for (int j = get_last_job_index() - 1; j >= 0; --j)
+            if(!job_is_completed(find_job_jid(j)))
+                jobs = find_job_jid(j);
 
-        if(get_last_job_index() == 0)
+        if(!jobs)
         {
-            fprintf(stderr, "Not enough jobs to run in bg!\n");
-            fflush(stderr);
+            fprintf(stderr, "No such running jobs!\n");
             return EXEC_FAILED;
         }
+    }
+
+    /* Remove bg job from list. We no longer need this job. */
+    remove_job(current_job->pgid);
+    current_job = NULL;
+    continue_job(jobs, 0);
+
+    return EXEC_SUCCESS;
+}
+
+/* fg [pid] */
+static int inner_fg(const char *argv[], const builtin_streams *io)
+{
+    int size = 0;
+    int i = 1;
+
+    (void) io;
+
+    /* Check args. */
+    while(argv[i++])
+        size++;
+
+    if(get_last_job_index() == 0)
+    {
+        fprintf(stderr, "Not enough jobs to move to fg!\n");
+        fflush(stderr);
+        return EXEC_FAILED;
+    }
 
-        /* Get last job at begin.
-           We choose pre last index, because of last is bg. */
-        job* jobs = find_job_jid(get_last_job_index() - 1);
+    /* Get last job at begin.
+       We choose pre last index, because of last is bg. */
+    job* jobs = find_job_jid(get_last_job_index() - 1);
 
-        if(size > 1)
+    if(size > 1)
+    {
+        fprintf(stderr, "%s: Too many args!\n", argv[1]);
+        fflush(stderr);
+        return EXEC_FAILED;
+    }else if(size == 1)
+    {
+        pid_t pid = (pid_t)strtol(argv[1], NULL, 10);
+
+        /* Check is the parsed PID correct. */
+        if(!pid || errno == ERANGE)
         {
-            fprintf(stderr, "%s: Too many args!\n", argv[1]);
+            fprintf(stderr, "Invalid pid!\n");
             fflush(stderr);
             return EXEC_FAILED;
-        }else if(size == 1)
+        }
+        jobs = find_job_pgid(-pid);
+        /* Try to find job by pid. */
+        if(!jobs)
         {
-            pid_t pid = (pid_t)strtol(argv[1], NULL, 10);
-
-            /* Check is the parsed PID correct. */
-            if(!pid || errno == ERANGE)
-            {
-                fprintf(stderr, "Invalid pid!\n");
-                fflush(stderr);
-                return EXEC_FAILED;
-            }
-            jobs = find_job_pgid(-pid);
-            /* Try to find job by pid. */
-            if(!jobs)
-            {
-                fprintf(stderr, "%d - no such job!\n", pid);
-                fflush(stderr);
-                return EXEC_FAILED;
-            }
+            fprintf(stderr, "%d - no such job!\n", pid);
+            fflush(stderr);
+            return EXEC_FAILED;
         }
+    }
+
+    if(job_is_completed(jobs) && size == 1)
+    {
+        fprintf(stderr, "This job is terminated!\n");
+        return EXEC_FAILED;
+    } else if(job_is_completed(jobs))
+    {
+        jobs = NULL;
+        for (int j = get_last_job_index() - 1; j >= 0; --j)
+            if(!job_is_completed(find_job_jid(j)))
+                jobs = find_job_jid(j);
 
-        if(job_is_completed(jobs) && size == 1)
+        if(!jobs)
         {
-            fprintf(stderr, "This job is terminated!\n");
+            fprintf(stderr, "No such running jobs!\n");
             return EXEC_FAILED;
-        } else if(job_is_completed(jobs))
-        {
-            jobs = NULL;
-            for (int j = get_last_job_index() - 1; j >= 0; --j)
-                if(!job_is_completed(find_job_jid(j)))
-                    jobs = find_job_jid(j);
-
-            if(!jobs)
-            {
-                fprintf(stderr, "No such running jobs!\n");
-                return EXEC_FAILED;
-            }
         }
+    }
 
-        /* Remove bg job from list. We no longer need this job. */
-        remove_job(current_job->pgid);
-        current_job = NULL;
-        continue_job(jobs, 0);
+    printf("%s\n", jobs->command);
+    fflush(stdout);
+    /* Remove fg job from list. We no longer need this job. */
+    remove_job(current_job->pgid);
+    continue_job(jobs, 1);
 
-        return EXEC_SUCCESS;
-    }else if(!strcmp(name, "fg"))
-    {
-        int size = 0;
-        int i = 1;
+    return EXEC_SUCCESS;
+}
 
-        /* Check args. */
-        while(argv[i++])
-            size++;
+/* set [-o option[=value]] [+o option] */
+static int inner_set(const char *argv[], const builtin_streams *io)
+{
+    /* Show all options. */
+    if(!argv[1])
+    {
+        print_options(io->out);
+        return EXEC_SUCCESS;
+    }
 
-        if(get_last_job_index() == 0)
+    /* Set options by pairs -o name[=value] or +o name. */
+    for (int i = 1; argv[i]; i += 2)
+    {
+        if((strcmp(argv[i], "-o") != 0 && strcmp(argv[i], "+o") != 0) || !argv[i + 1])
         {
-            fprintf(stderr, "Not enough jobs to move to fg!\n");
+            fprintf(stderr, "Usage: set [-o option[=value]] [+o option]\n");
             fflush(stderr);
             return EXEC_FAILED;
         }
 
-        /* Get last job at begin.
-           We choose pre last index, because of last is bg. */
-        job* jobs = find_job_jid(get_last_job_index() - 1);
-
-        if(size > 1)
+        if(set_option(argv[i + 1], argv[i][0] == '-'))
         {
-            fprintf(stderr, "%s: Too many args!\n", argv[1]);
+            fprintf(stderr, "%s: Invalid option!\n", argv[i + 1]);
             fflush(stderr);
             return EXEC_FAILED;
-        }else if(size == 1)
-        {
-            pid_t pid = (pid_t)strtol(argv[1], NULL, 10);
-
-            /* Check is the parsed PID correct. */
-            if(!pid || errno == ERANGE)
-            {
-                fprintf(stderr, "Invalid pid!\n");
-                fflush(stderr);
-                return EXEC_FAILED;
-            }
-            jobs = find_job_pgid(-pid);
-            /* Try to find job by pid. */
-            if(!jobs)
-            {
-                fprintf(stderr, "%d - no such job!\n", pid);
-                fflush(stderr);
-                return EXEC_FAILED;
-            }
         }
+    }
 
-        if(job_is_completed(jobs) && size == 1)
-        {
-            fprintf(stderr, "This job is terminated!\n");
-            return EXEC_FAILED;
-        } else if(job_is_completed(jobs))
+    return EXEC_SUCCESS;
+}
+
+/* spawnstat [-r] */
+static int inner_spawnstat(const char *argv[], const builtin_streams *io)
+{
+    /* Reset counters with -r flag. */
+    if(argv[1] && !strcmp(argv[1], "-r"))
+        reset_spawn_stats();
+    else
+        print_spawn_stats(io->out);
+
+    return EXEC_SUCCESS;
+}
+
+/* hash [-r] [-d] [command...] */
+static int inner_hash(const char *argv[], const builtin_streams *io)
+{
+    /* Show all cached commands. */
+    if(!argv[1])
+    {
+        print_path_cache(io->out);
+        return EXEC_SUCCESS;
+    }
+
+    /* Forget all commands. */
+    if(!strcmp(argv[1], "-r"))
+    {
+        clear_path_cache();
+        return EXEC_SUCCESS;
+    }
+
+    int status = EXEC_SUCCESS;
+
+    /* Forget commands from args with -d flag. Or find and remember them. */
+    int forget = !strcmp(argv[1], "-d");
+    for (int i = forget ? 2 : 1; argv[i]; ++i)
+        if((forget && !forget_command_path(argv[i])) || (!forget && !find_command_path(argv[i])))
         {
-            jobs = NULL;
-            for (int j = get_last_job_index() - 1; j >= 0; --j)
-                if(!job_is_completed(find_job_jid(j)))
-                    jobs = find_job_jid(j);
-
-            if(!jobs)
-            {
-                fprintf(stderr, "No such running jobs!\n");
-                return EXEC_FAILED;
-            }
+            fprintf(stderr, "hash: %s: not found\n", argv[i]);
+            fflush(stderr);
+            status = EXEC_FAILED;
         }
 
-        printf("%s\n", jobs->command);
-        fflush(stdout);
-        /* Remove fg job from list. We no longer need this job. */
-        remove_job(current_job->pgid);
-        continue_job(jobs, 1);
+    return status;
+}
+
+/* parsecache [-r] */
+static int inner_parsecache(const char *argv[], const builtin_streams *io)
+{
+    /* Forget all lines and reset counters with -r flag. */
+    if(argv[1] && !strcmp(argv[1], "-r"))
+        clear_parse_cache();
+    else
+        print_parse_cache(io->out);
+
+    return EXEC_SUCCESS;
+}
+
+/* enable [-f library name...] [-d name...] */
+static int inner_enable(const char *argv[], const builtin_streams *io)
+{
+    int status = EXEC_SUCCESS;
 
+    /* Show loaded builtins. */
+    if(!argv[1])
+    {
+        print_plugins(io->out);
         return EXEC_SUCCESS;
-    }else
-        return NOT_INNER_COMMAND;
+    }
+
+    /* Load builtins from shared object with -f flag. */
+    if(!strcmp(argv[1], "-f") && argv[2] && argv[3])
+    {
+        for (int i = 3; argv[i]; ++i)
+            if(load_plugin(argv[2], argv[i]))
+                status = EXEC_FAILED;
+        return status;
+    }
+
+    /* Unload builtins with -d flag. */
+    if(!strcmp(argv[1], "-d") && argv[2])
+    {
+        for (int i = 2; argv[i]; ++i)
+            if(unload_plugin(argv[i]))
+                status = EXEC_FAILED;
+        return status;
+    }
+
+    fprintf(stderr, "enable: usage: enable [-f library name...] [-d name...]\n");
+    fflush(stderr);
+    return EXEC_FAILED;
+}
+
+/* time */
+static int inner_time(const char *argv[], const builtin_streams *io)
+{
+    static const int who[2] = {RUSAGE_SELF, RUSAGE_CHILDREN};
+    static const char *labels[2] = {"shell", "children"};
+    struct rusage ru;
+    proc_usage usage;
+
+    (void) argv;
+
+    /* Pipeline with time prefix is reported by its job, so only resources of shell are left. */
+    print_usage_header(io->out);
+    for (int i = 0; i < 2; ++i)
+    {
+        usage_clear(&usage);
+        if(!getrusage(who[i], &ru))
+            usage_end(&usage, &ru);
+        print_usage(io->out, labels[i], &usage, NULL);
+    }
+
+    return EXEC_SUCCESS;
+}
+
+/* stats [-r] [-j] */
+static int inner_stats(const char *argv[], const builtin_streams *io)
+{
+    /* Clear histograms with -r flag. Dump them as JSON with -j flag. */
+    if(argv[1] && !strcmp(argv[1], "-r"))
+        reset_stats();
+    else if(argv[1] && !strcmp(argv[1], "-j"))
+        print_stats_json(io->out);
+    else
+        print_stats(io->out);
+
+    return EXEC_SUCCESS;
+}
+
+/* trace [file | -f fd | -d] */
+static int inner_trace(const char *argv[], const builtin_streams *io)
+{
+    int fd, err;
+    char *end;
+
+    /* Show state of tracing. */
+    if(!argv[1])
+    {
+        print_trace_state(io->out);
+        return EXEC_SUCCESS;
+    }
+
+    /* Stop tracing with -d flag. */
+    if(!strcmp(argv[1], "-d") && !argv[2])
+    {
+        trace_stop();
+        return EXEC_SUCCESS;
+    }
+
+    /* Trace to copy of opened descriptor with -f flag. Or to file, which is truncated. */
+    if(!strcmp(argv[1], "-f") && argv[2] && !argv[3])
+    {
+        fd = (int) strtol(argv[2], &end, 10);
+        fd = *end || end == argv[2] ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    }
+    else if(argv[1][0] != '-' && !argv[2])
+        fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    else
+    {
+        fprintf(stderr, "trace: usage: trace [file | -f fd | -d]\n");
+        fflush(stderr);
+        return EXEC_FAILED;
+    }
+
+    if(fd == -1 || (err = trace_start(fd)))
+    {
+        fprintf(stderr, "trace: %s: %s\n", argv[argv[2] ? 2 : 1], strerror(fd == -1 ? errno : err));
+        fflush(stderr);
+        if(fd != -1)
+            close(fd);
+        return EXEC_FAILED;
+    }
+
+    return EXEC_SUCCESS;
+}
+
+/* monitor [-f fd | -u socket | -d] */
+static int inner_monitor(const char *argv[], const builtin_streams *io)
+{
+    int fd, err;
+    char *end;
+
+    /* Show state of monitor. */
+    if(!argv[1])
+    {
+        print_monitor_state(io->out);
+        return EXEC_SUCCESS;
+    }
+
+    /* Stop monitor with -d flag. */
+    if(!strcmp(argv[1], "-d") && !argv[2])
+    {
+        monitor_stop();
+        return EXEC_SUCCESS;
+    }
+
+    /* Send records to copy of opened descriptor with -f flag. Or to unix socket with -u flag. */
+    if(!strcmp(argv[1], "-f") && argv[2] && !argv[3])
+    {
+        fd = (int) strtol(argv[2], &end, 10);
+        fd = *end || end == argv[2] ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    }
+    else if(!strcmp(argv[1], "-u") && argv[2] && !argv[3])
+        fd = monitor_connect(argv[2]);
+    else
+    {
+        fprintf(stderr, "monitor: usage: monitor [-f fd | -u socket | -d]\n");
+        fflush(stderr);
+        return EXEC_FAILED;
+    }
+
+    if(fd == -1 || (err = monitor_start(fd)))
+    {
+        fprintf(stderr, "monitor: %s: %s\n", argv[2], strerror(fd == -1 ? errno : err));
+        fflush(stderr);
+        if(fd != -1)
+            close(fd);
+        return EXEC_FAILED;
+    }
+
+    return EXEC_SUCCESS;
 }
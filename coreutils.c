@@ -0,0 +1,961 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "coreutils.h"
+
+#define UTIL_COPY_CHUNK ((size_t) 1 << 30) /* maximal size of one kernel copy */
+
+/* Buffered output of utility. */
+typedef struct out_buffer
+{
+    int fd;                         /* descriptor of output */
+    ring *ring;                     /* ring buffer of output or NULL, if fd is used */
+    size_t used;                    /* count of buffered bytes */
+    int failed;                     /* errno of failed write or 0 */
+    char data[UTIL_BUFFER_SIZE];    /* buffered bytes */
+} out_buffer;
+
+/* Args of test utility. */
+typedef struct test_args
+{
+    const char **argv;  /* args without name and closing ] */
+    int argc;           /* count of args */
+    int pos;            /* index of current arg */
+    int error;          /* true if expression is invalid */
+} test_args;
+
+/* Run utility, which prints only to buffer, with args argv and streams io. Flush the buffer after it.
+   Return exit status of utility. */
+static int exec_buffered(int (*util)(const char *argv[], out_buffer *out), const char *argv[],
+                         const builtin_streams *io);
+
+/* Write all len bytes of data to fd. Return 0, if success. Or errno. */
+static int write_all(int fd, const char *data, size_t len);
+
+/* Write buffered bytes of out. Return 0, if success. */
+static int out_flush(out_buffer *out);
+
+/* Append len bytes of s to out. */
+static void out_write(out_buffer *out, const char *s, size_t len);
+
+/* Append symbol c to out. */
+static void out_char(out_buffer *out, char c);
+
+/* Print escape sequence, which follows backslash at s, to out.
+   Octal numbers have 0 prefix, if zero_octal is set, like in echo.
+   Set *stop to 1 on \c. Return count of used symbols after backslash. */
+static size_t out_escape(out_buffer *out, const char *s, int zero_octal, int *stop);
+
+/* true */
+static int exec_true(const char *argv[], const builtin_streams *io);
+
+/* false */
+static int exec_false(const char *argv[], const builtin_streams *io);
+
+/* echo [-neE] [string...] */
+static int exec_echo(const char *argv[], const builtin_streams *io);
+static int util_echo(const char *argv[], out_buffer *out);
+
+/* printf format [argument...] */
+static int exec_printf(const char *argv[], const builtin_streams *io);
+static int util_printf(const char *argv[], out_buffer *out);
+
+/* Print one conversion of printf from spec of len symbols with argument arg to out.
+   Return 0, if success. Or 1, if argument is invalid. */
+static int printf_conversion(out_buffer *out, const char *spec, size_t len, const char *arg);
+
+/* Format arg by format of printf with conversion conv to buf of size bytes.
+   Set *end to the end of parsed number. Return result of snprintf. */
+static int format_arg(char *buf, size_t size, const char *format, char conv, const char *arg, char **end);
+
+/* pwd */
+static int exec_pwd(const char *argv[], const builtin_streams *io);
+static int util_pwd(const char *argv[], out_buffer *out);
+
+/* test expression, [ expression ] */
+static int util_test(const char *argv[], const builtin_streams *io);
+
+/* Evaluate -o expression of test args. */
+static int test_or(test_args *t);
+
+/* Evaluate -a expression of test args. */
+static int test_and(test_args *t);
+
+/* Evaluate ! expression of test args. */
+static int test_not(test_args *t);
+
+/* Evaluate primary expression of test args. */
+static int test_primary(test_args *t);
+
+/* Evaluate unary test op for arg. */
+static int test_unary(test_args *t, const char *op, const char *arg);
+
+/* Evaluate binary test op for args a and b. Return -1, if op is unknown. */
+static int test_binary(test_args *t, const char *a, const char *op, const char *b);
+
+/* Parse integer arg of test. Set error of t, if arg isn't integer. */
+static long long test_integer(test_args *t, const char *arg);
+
+/* cat [-u] [file...] */
+static int util_cat(const char *argv[], const builtin_streams *io);
+
+/* Copy all data from in or in_ring, if it isn't NULL, to output of io.
+   Return 0, if success. Or errno. */
+static int copy_stream(int in, ring *in_ring, const builtin_streams *io);
+
+/* Copy all data from in to out. Files are copied by kernel without user buffer.
+   Return 0, if success. Or errno. */
+static int copy_fd(int in, int out);
+
+/* Utilities, which are executed inside shell: echo, printf, pwd, true, false, test, [ and cat.
+   Utility may run on any thread. Lost reader of output gives UTIL_BROKEN_PIPE silently.
+   The list is terminated by entry with NULL name. */
+const builtin util_builtins[] =
+{
+    {"echo",   BUILTIN_UTIL, exec_echo},
+    {"printf", BUILTIN_UTIL, exec_printf},
+    {"pwd",    BUILTIN_UTIL, exec_pwd},
+    {"true",   BUILTIN_UTIL, exec_true},
+    {"false",  BUILTIN_UTIL, exec_false},
+    {"test",   BUILTIN_UTIL, util_test},
+    {"[",      BUILTIN_UTIL, util_test},
+    {"cat",    BUILTIN_UTIL, util_cat},
+    {NULL,     0,            NULL}
+};
+
+/* Check utility with args argv would wait for terminal input from infile_local.
+   Such utilities are executed in child process, so they may be stopped by the user. */
+int util_reads_terminal(const char *argv[], int infile_local)
+{
+    assert(argv != NULL);
+
+    if (strcmp(argv[0], "cat") || !isatty(infile_local))
+        return 0;
+
+    /* cat reads input without files or with - file. */
+    int files = 0;
+    for (int i = 1; argv[i]; ++i)
+        if (!strcmp(argv[i], "-"))
+            return 1;
+        else if (strcmp(argv[i], "-u"))
+            files++;
+
+    return !files;
+}
+
+/* Check utility with args argv completes without waiting for a writer or a device,
+   because it reads only regular files, including infile_local. Only such utilities run inside the shell itself. */
+int util_is_bounded(const char *argv[], int infile_local)
+{
+    assert(argv != NULL);
+
+    struct stat st;
+    int files = 0;
+
+    if (strcmp(argv[0], "cat"))
+        return 1;
+
+    /* FIFO, terminal, socket or device may never end. Files, which can't be opened, give errors at once. */
+    for (int i = 1; argv[i]; ++i)
+    {
+        if (!strcmp(argv[i], "-u"))
+            continue;
+        files++;
+        if (strcmp(argv[i], "-") ? !stat(argv[i], &st) : !fstat(infile_local, &st))
+            if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode))
+                return 0;
+    }
+    if (!files && !fstat(infile_local, &st) && !S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode))
+        return 0;
+
+    return 1;
+}
+
+/* Run utility, which prints only to buffer, with args argv and streams io. Flush the buffer after it.
+   Return exit status of utility. */
+static int exec_buffered(int (*util)(const char *argv[], out_buffer *out), const char *argv[],
+                         const builtin_streams *io)
+{
+    assert(argv != NULL);
+    assert(argv[0] != NULL);
+    assert(io != NULL);
+
+    out_buffer out;
+    int status;
+
+    out.fd = io->out;
+    out.ring = io->out_ring;
+    out.used = 0;
+    out.failed = 0;
+
+    status = util(argv, &out);
+
+    if (out_flush(&out) == EPIPE)
+        return UTIL_BROKEN_PIPE;
+    else if (out.failed)
+    {
+        fprintf(stderr, "%s: write error: %s\n", argv[0], strerror(out.failed));
+        fflush(stderr);
+        return EXIT_FAILURE;
+    }
+
+    return status;
+}
+
+/* Write all len bytes of data to fd. Return 0, if success. Or errno. */
+static int write_all(int fd, const char *data, size_t len)
+{
+    ssize_t r;
+
+    while (len)
+    {
+        if ((r = write(fd, data, len)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        data += r;
+        len -= (size_t) r;
+    }
+
+    return 0;
+}
+
+/* Write buffered bytes of out. Return 0, if success. */
+static int out_flush(out_buffer *out)
+{
+    if (!out->failed && out->used)
+        out->failed = out->ring ? ring_write(out->ring, out->data, out->used)
+                                : write_all(out->fd, out->data, out->used);
+    out->used = 0;
+
+    return out->failed;
+}
+
+/* Append len bytes of s to out. */
+static void out_write(out_buffer *out, const char *s, size_t len)
+{
+    size_t n;
+
+    while (len)
+    {
+        if (out->used == UTIL_BUFFER_SIZE)
+            out_flush(out);
+
+        n = UTIL_BUFFER_SIZE - out->used < len ? UTIL_BUFFER_SIZE - out->used : len;
+        memcpy(out->data + out->used, s, n);
+        out->used += n;
+        s += n;
+        len -= n;
+    }
+}
+
+/* Append symbol c to out. */
+static void out_char(out_buffer *out, char c)
+{
+    if (out->used == UTIL_BUFFER_SIZE)
+        out_flush(out);
+    out->data[out->used++] = c;
+}
+
+/* Print escape sequence, which follows backslash at s, to out.
+   Octal numbers have 0 prefix, if zero_octal is set, like in echo.
+   Set *stop to 1 on \c. Return count of used symbols after backslash. */
+static size_t out_escape(out_buffer *out, const char *s, int zero_octal, int *stop)
+{
+    size_t n = 0;
+    int value = 0;
+
+    switch (*s)
+    {
+        case 'a': out_char(out, '\a'); return 1;
+        case 'b': out_char(out, '\b'); return 1;
+        case 'f': out_char(out, '\f'); return 1;
+        case 'n': out_char(out, '\n'); return 1;
+        case 'r': out_char(out, '\r'); return 1;
+        case 't': out_char(out, '\t'); return 1;
+        case 'v': out_char(out, '\v'); return 1;
+        case '\\': out_char(out, '\\'); return 1;
+        case 'c':
+            *stop = 1;
+            return 1;
+        default:
+            break;
+    }
+
+    /* Octal number of up to 3 digits. */
+    if (zero_octal ? *s == '0' : (*s >= '0' && *s <= '7'))
+    {
+        if (zero_octal)
+            n++;
+        for (int digits = 0; digits < 3 && s[n] >= '0' && s[n] <= '7'; ++digits, ++n)
+            value = value * 8 + (s[n] - '0');
+        out_char(out, (char) value);
+        return n;
+    }
+
+    /* Unknown sequence is printed as is. */
+    out_char(out, '\\');
+    return 0;
+}
+
+/* true */
+static int exec_true(const char *argv[], const builtin_streams *io)
+{
+    (void) argv;
+    (void) io;
+    return EXIT_SUCCESS;
+}
+
+/* false */
+static int exec_false(const char *argv[], const builtin_streams *io)
+{
+    (void) argv;
+    (void) io;
+    return EXIT_FAILURE;
+}
+
+/* echo [-neE] [string...] */
+static int exec_echo(const char *argv[], const builtin_streams *io)
+{
+    return exec_buffered(util_echo, argv, io);
+}
+
+/* echo [-neE] [string...] */
+static int util_echo(const char *argv[], out_buffer *out)
+{
+    int newline = 1, escapes = 0, stop = 0, i;
+
+    /* Only args of n, e and E letters are options. */
+    for (i = 1; argv[i] && argv[i][0] == '-' && argv[i][1] && strspn(argv[i] + 1, "neE") == strlen(argv[i] + 1); ++i)
+        for (const char *o = argv[i] + 1; *o; ++o)
+        {
+            if (*o == 'n')
+                newline = 0;
+            else
+                escapes = *o == 'e';
+        }
+
+    for (int first = i; argv[i] && !stop; ++i)
+    {
+        if (i > first)
+            out_char(out, ' ');
+
+        if (!escapes)
+        {
+            out_write(out, argv[i], strlen(argv[i]));
+            continue;
+        }
+
+        for (const char *s = argv[i]; *s && !stop; ++s)
+            if (*s == '\\' && s[1])
+                s += out_escape(out, s + 1, 1, &stop);
+            else
+                out_char(out, *s);
+    }
+
+    if (newline && !stop)
+        out_char(out, '\n');
+
+    return EXIT_SUCCESS;
+}
+
+/* printf format [argument...] */
+static int exec_printf(const char *argv[], const builtin_streams *io)
+{
+    return exec_buffered(util_printf, argv, io);
+}
+
+/* printf format [argument...] */
+static int util_printf(const char *argv[], out_buffer *out)
+{
+    const char *format, *s, *spec;
+    int arg, status = EXIT_SUCCESS, stop = 0, used;
+    char star[32];
+
+    if (!argv[1])
+    {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        fflush(stderr);
+        return 2;
+    }
+    format = argv[1];
+    arg = 2;
+
+    /* Format is reused, while arguments remain. */
+    do
+    {
+        used = 0;
+        for (s = format; *s && !stop; ++s)
+        {
+            if (*s == '\\' && s[1])
+            {
+                s += out_escape(out, s + 1, 0, &stop);
+                continue;
+            }
+            if (*s != '%')
+            {
+                out_char(out, *s);
+                continue;
+            }
+            if (s[1] == '%')
+            {
+                out_char(out, '%');
+                s++;
+                continue;
+            }
+
+            /* Find conversion: flags, width, precision and specifier. */
+            spec = s++;
+            s += strspn(s, "-+ #0");
+            if (*s == '*')
+            {
+                /* Width is taken from argument. */
+                snprintf(star, sizeof(star), "%d", argv[arg] ? atoi(argv[arg++]) : 0);
+                used = 1;
+                s++;
+            } else
+            {
+                star[0] = '\0';
+                s += strspn(s, "0123456789");
+            }
+            if (*s == '.')
+            {
+                s++;
+                s += strspn(s, "0123456789");
+            }
+
+            if (!*s || !strchr("diouxXcsbeEfgG", *s))
+            {
+                fprintf(stderr, "printf: %.*s: invalid conversion\n", (int) (s - spec + (*s != 0)), spec);
+                fflush(stderr);
+                return EXIT_FAILURE;
+            }
+
+            if (*s == 'b')
+            {
+                /* String with escapes. */
+                for (const char *b = argv[arg] ? argv[arg] : ""; *b && !stop; ++b)
+                    if (*b == '\\' && b[1])
+                        b += out_escape(out, b + 1, 1, &stop);
+                    else
+                        out_char(out, *b);
+            } else if (star[0])
+            {
+                /* Replace * by width value in spec. */
+                char buf[64];
+                const char *width = strchr(spec, '*');
+                int n = snprintf(buf, sizeof(buf), "%.*s%s%.*s", (int) (width - spec), spec, star,
+                                 (int) (s - width), width + 1);
+                if (n > 0 && (size_t) n < sizeof(buf) && printf_conversion(out, buf, (size_t) n, argv[arg]))
+                    status = EXIT_FAILURE;
+            } else if (printf_conversion(out, spec, (size_t) (s - spec + 1), argv[arg]))
+                status = EXIT_FAILURE;
+
+            if (argv[arg])
+                arg++;
+            used = 1;
+        }
+    } while (argv[arg] && used && !stop);
+
+    return status;
+}
+
+/* Print one conversion of printf from spec of len symbols with argument arg to out.
+   Return 0, if success. Or 1, if argument is invalid. */
+static int printf_conversion(out_buffer *out, const char *spec, size_t len, const char *arg)
+{
+    char format[64], small[256];
+    char conv = spec[len - 1];
+    char *end = NULL, *text = small;
+    int n, status = 0;
+
+    if (len + 2 >= sizeof(format))
+        return 1;
+    if (!arg)
+        arg = "";
+
+    /* Integers are printed as long long, so length modifier is added. */
+    if (strchr("diouxX", conv))
+    {
+        memcpy(format, spec, len - 1);
+        memcpy(format + len - 1, "ll", 2);
+        format[len + 1] = conv;
+        format[len + 2] = '\0';
+    } else
+    {
+        memcpy(format, spec, len);
+        format[len] = '\0';
+    }
+
+    errno = 0;
+    n = format_arg(small, sizeof(small), format, conv, arg, &end);
+    if (end && (*end || errno == ERANGE))
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        fflush(stderr);
+        status = 1;
+    }
+    if (n < 0)
+        return 1;
+
+    /* Long strings need bigger buffer. */
+    if ((size_t) n >= sizeof(small))
+    {
+        if (!(text = malloc((size_t) n + 1)))
+        {
+            perror("printf: malloc");
+            return 1;
+        }
+        format_arg(text, (size_t) n + 1, format, conv, arg, &end);
+    }
+
+    out_write(out, text, (size_t) n);
+    if (text != small)
+        free(text);
+
+    return status;
+}
+
+/* Format arg by format of printf with conversion conv to buf of size bytes.
+   Set *end to the end of parsed number. Return result of snprintf. */
+static int format_arg(char *buf, size_t size, const char *format, char conv, const char *arg, char **end)
+{
+    /* 'c argument means code of symbol c. */
+    int symbol = *arg == '\'' || *arg == '"';
+
+    *end = NULL;
+    if (conv == 'd' || conv == 'i')
+        return snprintf(buf, size, format, symbol ? (long long) (unsigned char) arg[1] : strtoll(arg, end, 0));
+    if (strchr("ouxX", conv))
+        return snprintf(buf, size, format, symbol ? (unsigned long long) (unsigned char) arg[1] : strtoull(arg, end, 0));
+    if (strchr("eEfgG", conv))
+        return snprintf(buf, size, format, symbol ? (double) (unsigned char) arg[1] : strtod(arg, end));
+    if (conv == 'c')
+        return snprintf(buf, size, format, *arg);
+    return snprintf(buf, size, format, arg);
+}
+
+/* pwd */
+static int exec_pwd(const char *argv[], const builtin_streams *io)
+{
+    return exec_buffered(util_pwd, argv, io);
+}
+
+/* pwd */
+static int util_pwd(const char *argv[], out_buffer *out)
+{
+    char dir[PATH_MAX];
+
+    (void) argv;
+    if (!getcwd(dir, sizeof(dir)))
+    {
+        perror("pwd");
+        return EXIT_FAILURE;
+    }
+
+    out_write(out, dir, strlen(dir));
+    out_char(out, '\n');
+
+    return EXIT_SUCCESS;
+}
+
+/* test expression, [ expression ] */
+static int util_test(const char *argv[], const builtin_streams *io)
+{
+    test_args t;
+    int result;
+
+    (void) io;
+
+    t.argv = argv + 1;
+    t.pos = 0;
+    t.error = 0;
+    for (t.argc = 0; t.argv[t.argc]; ++t.argc);
+
+    /* [ needs closing ]. */
+    if (!strcmp(argv[0], "["))
+    {
+        if (!t.argc || strcmp(t.argv[t.argc - 1], "]"))
+        {
+            fprintf(stderr, "[: missing ]\n");
+            fflush(stderr);
+            return 2;
+        }
+        t.argc--;
+    }
+
+    /* Empty expression is false. */
+    if (!t.argc)
+        return EXIT_FAILURE;
+
+    result = test_or(&t);
+    if (!t.error && t.pos < t.argc)
+    {
+        fprintf(stderr, "%s: %s: unexpected argument\n", argv[0], t.argv[t.pos]);
+        t.error = 1;
+    }
+    if (t.error)
+    {
+        fflush(stderr);
+        return 2;
+    }
+
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Evaluate -o expression of test args. */
+static int test_or(test_args *t)
+{
+    int result = test_and(t);
+
+    while (!t->error && t->pos < t->argc && !strcmp(t->argv[t->pos], "-o"))
+    {
+        t->pos++;
+        result = test_and(t) || result;
+    }
+
+    return result;
+}
+
+/* Evaluate -a expression of test args. */
+static int test_and(test_args *t)
+{
+    int result = test_not(t);
+
+    while (!t->error && t->pos < t->argc && !strcmp(t->argv[t->pos], "-a"))
+    {
+        t->pos++;
+        result = test_not(t) && result;
+    }
+
+    return result;
+}
+
+/* Evaluate ! expression of test args. */
+static int test_not(test_args *t)
+{
+    /* Single ! is a string. */
+    if (t->pos + 1 < t->argc && !strcmp(t->argv[t->pos], "!"))
+    {
+        t->pos++;
+        return !test_not(t);
+    }
+
+    return test_primary(t);
+}
+
+/* Evaluate primary expression of test args. */
+static int test_primary(test_args *t)
+{
+    const char *arg;
+    int result;
+
+    if (t->pos >= t->argc)
+    {
+        fprintf(stderr, "test: argument expected\n");
+        t->error = 1;
+        return 0;
+    }
+    arg = t->argv[t->pos];
+
+    /* Binary operators have priority, so "-f = -f" compares strings. */
+    if (t->pos + 2 < t->argc && (result = test_binary(t, arg, t->argv[t->pos + 1], t->argv[t->pos + 2])) != -1)
+    {
+        t->pos += 3;
+        return result;
+    }
+
+    if (!strcmp(arg, "(") && t->pos + 1 < t->argc)
+    {
+        t->pos++;
+        result = test_or(t);
+        if (t->pos >= t->argc || strcmp(t->argv[t->pos], ")"))
+        {
+            if (!t->error)
+                fprintf(stderr, "test: ) expected\n");
+            t->error = 1;
+            return 0;
+        }
+        t->pos++;
+        return result;
+    }
+
+    /* Unary operator with operand. */
+    if (arg[0] == '-' && arg[1] && !arg[2] && strchr("bcdefghLnprsStuwxz", arg[1]) && t->pos + 1 < t->argc)
+    {
+        t->pos += 2;
+        return test_unary(t, arg, t->argv[t->pos - 1]);
+    }
+
+    /* Single string is true, if it isn't empty. */
+    t->pos++;
+    return arg[0] != '\0';
+}
+
+/* Evaluate unary test op for arg. */
+static int test_unary(test_args *t, const char *op, const char *arg)
+{
+    struct stat st;
+
+    switch (op[1])
+    {
+        case 'n':
+            return arg[0] != '\0';
+        case 'z':
+            return arg[0] == '\0';
+        case 't':
+            return isatty((int) test_integer(t, arg));
+        case 'r':
+            return !access(arg, R_OK);
+        case 'w':
+            return !access(arg, W_OK);
+        case 'x':
+            return !access(arg, X_OK);
+        case 'h':
+        case 'L':
+            return !lstat(arg, &st) && S_ISLNK(st.st_mode);
+        default:
+            break;
+    }
+
+    if (stat(arg, &st))
+        return 0;
+
+    switch (op[1])
+    {
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'e': return 1;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        default: return 0;
+    }
+}
+
+/* Evaluate binary test op for args a and b. Return -1, if op is unknown. */
+static int test_binary(test_args *t, const char *a, const char *op, const char *b)
+{
+    struct stat sa, sb;
+
+    if (!strcmp(op, "=") || !strcmp(op, "=="))
+        return !strcmp(a, b);
+    if (!strcmp(op, "!="))
+        return strcmp(a, b) != 0;
+    if (!strcmp(op, "<"))
+        return strcmp(a, b) < 0;
+    if (!strcmp(op, ">"))
+        return strcmp(a, b) > 0;
+
+    if (!strcmp(op, "-eq"))
+        return test_integer(t, a) == test_integer(t, b);
+    if (!strcmp(op, "-ne"))
+        return test_integer(t, a) != test_integer(t, b);
+    if (!strcmp(op, "-lt"))
+        return test_integer(t, a) < test_integer(t, b);
+    if (!strcmp(op, "-le"))
+        return test_integer(t, a) <= test_integer(t, b);
+    if (!strcmp(op, "-gt"))
+        return test_integer(t, a) > test_integer(t, b);
+    if (!strcmp(op, "-ge"))
+        return test_integer(t, a) >= test_integer(t, b);
+
+    if (!strcmp(op, "-nt") || !strcmp(op, "-ot") || !strcmp(op, "-ef"))
+    {
+        int ha = !stat(a, &sa), hb = !stat(b, &sb);
+
+        if (!strcmp(op, "-ef"))
+            return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+
+        /* Existing file is newer than missing one. */
+        if (!ha || !hb)
+            return !strcmp(op, "-nt") ? ha && !hb : !ha && hb;
+        if (sa.st_mtim.tv_sec != sb.st_mtim.tv_sec)
+            return !strcmp(op, "-nt") ? sa.st_mtim.tv_sec > sb.st_mtim.tv_sec : sa.st_mtim.tv_sec < sb.st_mtim.tv_sec;
+        return !strcmp(op, "-nt") ? sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec : sa.st_mtim.tv_nsec < sb.st_mtim.tv_nsec;
+    }
+
+    return -1;
+}
+
+/* Parse integer arg of test. Set error of t, if arg isn't integer. */
+static long long test_integer(test_args *t, const char *arg)
+{
+    char *end;
+    long long value;
+
+    errno = 0;
+    value = strtoll(arg, &end, 10);
+    while (*end == ' ' || *end == '\t')
+        end++;
+
+    if (end == arg || *end || errno == ERANGE)
+    {
+        if (!t->error)
+            fprintf(stderr, "test: %s: integer expression expected\n", arg);
+        t->error = 1;
+        return 0;
+    }
+
+    return value;
+}
+
+/* cat [-u] [file...] */
+static int util_cat(const char *argv[], const builtin_streams *io)
+{
+    int status = EXIT_SUCCESS, files = 0, fd, err;
+
+    for (int i = 1; argv[i]; ++i)
+    {
+        /* Output isn't buffered by the shell anyway. */
+        if (!strcmp(argv[i], "-u"))
+            continue;
+        if (argv[i][0] == '-' && argv[i][1])
+        {
+            fprintf(stderr, "cat: %s: unsupported option\n", argv[i]);
+            fflush(stderr);
+            return EXIT_FAILURE;
+        }
+        files++;
+    }
+
+    for (int i = 1; argv[i] || !files; ++i)
+    {
+        const char *name = files ? argv[i] : "-";
+
+        if (files && !strcmp(name, "-u"))
+            continue;
+
+        if (!strcmp(name, "-"))
+            fd = io->in;
+        else if ((fd = open(name, O_RDONLY | O_CLOEXEC)) == -1)
+        {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        if ((err = copy_stream(fd, fd == io->in ? io->in_ring : NULL, io)) == EPIPE)
+        {
+            /* Nobody reads the rest of files. */
+            if (fd != io->in)
+                close(fd);
+            return UTIL_BROKEN_PIPE;
+        } else if (err)
+        {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(err));
+            status = EXIT_FAILURE;
+        }
+
+        if (fd != io->in)
+            close(fd);
+        if (!files)
+            break;
+    }
+
+    fflush(stderr);
+    return status;
+}
+
+/* Copy all data from in or in_ring, if it isn't NULL, to output of io.
+   Return 0, if success. Or errno. */
+static int copy_stream(int in, ring *in_ring, const builtin_streams *io)
+{
+    const char *data;
+    char *space;
+    size_t n;
+    ssize_t r;
+    int err;
+
+    if (!in_ring && !io->out_ring)
+        return copy_fd(in, io->out);
+
+    /* Data of ring is written from the ring itself. */
+    if (in_ring)
+    {
+        while ((n = ring_read_begin(in_ring, &data)))
+        {
+            err = io->out_ring ? ring_write(io->out_ring, data, n) : write_all(io->out, data, n);
+            if (err)
+                return err;
+            ring_read_end(in_ring, n);
+        }
+        return 0;
+    }
+
+    /* Data of descriptor is read directly to free space of output ring. */
+    while ((n = ring_write_begin(io->out_ring, &space)))
+    {
+        if ((r = read(in, space, n)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        if (!r)
+            return 0;
+        ring_write_end(io->out_ring, (size_t) r);
+    }
+
+    return EPIPE;
+}
+
+/* Copy all data from in to out. Files are copied by kernel without user buffer.
+   Return 0, if success. Or errno. */
+static int copy_fd(int in, int out)
+{
+    struct stat in_st, out_st;
+    char buf[UTIL_BUFFER_SIZE];
+    ssize_t r;
+    int err;
+
+    if (!fstat(in, &in_st) && S_ISREG(in_st.st_mode))
+    {
+        /* File to file may be copied by reference of file system. */
+        if (!fstat(out, &out_st) && S_ISREG(out_st.st_mode))
+        {
+            while ((r = copy_file_range(in, NULL, out, NULL, UTIL_COPY_CHUNK, 0)) > 0);
+            if (!r)
+                return 0;
+
+            /* Other ways continue from the current offset. */
+            if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP && errno != EBADF)
+                return errno;
+        }
+
+        /* File to pipe, socket or other file. */
+        while ((r = sendfile(out, in, NULL, UTIL_COPY_CHUNK)) > 0);
+        if (!r)
+            return 0;
+        if (errno != EINVAL && errno != ENOSYS)
+            return errno;
+    }
+
+    while (1)
+    {
+        if ((r = read(in, buf, sizeof(buf))) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        if (!r)
+            return 0;
+        if ((err = write_all(out, buf, (size_t) r)))
+            return err;
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef UNIX_SHELL_COREUTILS_H
+#define UNIX_SHELL_COREUTILS_H
+
+#include <signal.h>
+#include "builtins.h"
+
+#define UTIL_BUFFER_SIZE (64 * 1024) /* size of output buffer and copy chunk of utilities */
+#define UTIL_BROKEN_PIPE (128 + SIGPIPE) /* status of utility, whose reader exited, like after SIGPIPE */
+
+/* Utilities, which are executed inside shell: echo, printf, pwd, true, false, test, [ and cat.
+   Utility may run on any thread. Lost reader of output gives UTIL_BROKEN_PIPE silently.
+   The list is terminated by entry with NULL name. */
+extern const builtin util_builtins[];
+
+/* Check utility with args argv would wait for terminal input from infile_local.
+   Such utilities are executed in child process, so they may be stopped by the user. */
+int util_reads_terminal(const char *argv[], int infile_local);
+
+/* Check utility with args argv completes without waiting for a writer or a device,
+   because it reads only regular files, including infile_local. Only such utilities run inside the shell itself. */
+int util_is_bounded(const char *argv[], int infile_local);
+
+#endif
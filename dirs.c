@@ -193,9 +193,9 @@ static void cd(const char *path)
     chdir(path);
 }
 
-/* Init home directory of shell.
+/* Init home directory of shell. Go to home directory, if go_home = 1.
    begin must be non null. */
-void init_home(char *begin)
+void init_home(char *begin, int go_home)
 {
     assert(begin != NULL);
 
@@ -203,7 +203,8 @@ void init_home(char *begin)
     if ((home_dir = getenv("HOME")))
     {
         found_home_var = 1;
-        cd(home_dir);
+        if (go_home)
+            cd(home_dir);
     }
     else
     {
@@ -234,7 +235,8 @@ void init_home(char *begin)
 
         strcpy(home_dir, newdir);
 
-        cd(newdir);
+        if (go_home)
+            cd(newdir);
 
         free(newdir);
     }
@@ -16,9 +16,9 @@
 #define DIR_EXIST         -259
 #define DIR_IS_FILE       -260
 
-/* Init home directory of shell.
+/* Init home directory of shell. Go to home directory, if go_home = 1.
    begin must be non null. */
-void  init_home(char *begin);
+void  init_home(char *begin, int go_home);
 
 /* Set current working directory to path, with validation of dir. */
 int   set_directory(const char* dir);
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include "events.h"
+#include "shell.h"
+
+static int epoll_fd = -1;   /* epoll instance for input waiting */
+static int signal_fd = -1;  /* signalfd of SIGCHLD */
+static int watched_fd = -1; /* input fd, added to epoll_fd */
+static int wake_fd = -1;    /* eventfd, which is written by completed threads of utilities */
+
+/* Read all pending signals from signal_fd. Return count of read signals. */
+static int drain_signals();
+
+/* Reset counter of wake_fd. Return count of wakes. */
+static int drain_wakes();
+
+/* Init event loop of shell. SIGCHLD is blocked and read from signalfd,
+   so children are reaped synchronously, not in signal handler.
+   Return 0, if success. */
+int init_event_loop()
+{
+    sigset_t mask;
+    struct epoll_event ev;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+    {
+        perror("sigprocmask");
+        return -1;
+    }
+
+    if ((signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+    {
+        perror("signalfd");
+        return -1;
+    }
+
+    if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    if ((wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    {
+        perror("eventfd");
+        return -1;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = signal_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) < 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    ev.data.fd = wake_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) < 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Wait until fd is ready for reading.
+   Notify the user about changed jobs while waiting.
+   Return 1, if fd is ready. Or 0, if waiting failed. */
+int wait_for_input(int fd)
+{
+    struct epoll_event ev[3];
+    int n;
+
+    if (fd != watched_fd)
+    {
+        if (watched_fd != -1)
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watched_fd, NULL);
+
+        ev[0].events = EPOLLIN;
+        ev[0].data.fd = fd;
+
+        /* Regular files can't be polled, they are always ready. */
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev[0]) < 0)
+            return errno == EPERM;
+        watched_fd = fd;
+    }
+
+    while (1)
+    {
+        if ((n = epoll_wait(epoll_fd, ev, 3, -1)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            return 0;
+        }
+
+        int ready = 0;
+        for (int i = 0; i < n; ++i)
+            if (ev[i].data.fd == signal_fd || ev[i].data.fd == wake_fd)
+            {
+                /* Children or threads changed state, so reap them and notify the user. */
+                drain_signals();
+                drain_wakes();
+                do_job_notification(0);
+            } else
+                ready = 1;
+
+        if (ready)
+            return 1;
+    }
+}
+
+/* Wait for SIGCHLD or completion of utility thread not longer than timeout milliseconds (-1 is infinity).
+   Return 1, if children or threads changed state, 0 on timeout, -1 on error. */
+int wait_for_children(int timeout)
+{
+    struct pollfd pfd[2];
+    int n;
+
+    pfd[0].fd = signal_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = wake_fd;
+    pfd[1].events = POLLIN;
+
+    do
+        n = poll(pfd, 2, timeout);
+    while (n < 0 && errno == EINTR);
+
+    if (n < 0)
+    {
+        perror("poll");
+        return -1;
+    }
+
+    return n ? drain_signals() + drain_wakes() > 0 : 0;
+}
+
+/* Wake the event loop from thread of utility, which has completed. */
+void wake_event_loop()
+{
+    eventfd_t one = 1;
+
+    /* Counter can't overflow by count of threads, so nothing is lost. */
+    if (wake_fd != -1 && write(wake_fd, &one, sizeof(one)) < 0)
+        perror("eventfd");
+}
+
+/* Close descriptors of event loop. */
+void close_event_loop()
+{
+    if (epoll_fd != -1)
+        close(epoll_fd);
+    if (signal_fd != -1)
+        close(signal_fd);
+    if (wake_fd != -1)
+        close(wake_fd);
+    epoll_fd = signal_fd = watched_fd = wake_fd = -1;
+}
+
+/* Read all pending signals from signal_fd. Return count of read signals. */
+static int drain_signals()
+{
+    struct signalfd_siginfo info[16];
+    ssize_t n;
+    int count = 0;
+
+    /* Signals are merged, so one record may mean many children. */
+    while ((n = read(signal_fd, info, sizeof(info))) > 0)
+        count += (int) ((size_t) n / sizeof(struct signalfd_siginfo));
+
+    return count;
+}
+
+/* Reset counter of wake_fd. Return count of wakes. */
+static int drain_wakes()
+{
+    eventfd_t count;
+
+    return read(wake_fd, &count, sizeof(count)) == sizeof(count) ? (int) count : 0;
+}
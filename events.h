@@ -0,0 +1,24 @@
+#ifndef UNIX_SHELL_EVENTS_H
+#define UNIX_SHELL_EVENTS_H
+
+/* Init event loop of shell. SIGCHLD is blocked and read from signalfd,
+   so children are reaped synchronously, not in signal handler.
+   Return 0, if success. */
+int init_event_loop();
+
+/* Wait until fd is ready for reading.
+   Notify the user about changed jobs while waiting.
+   Return 1, if fd is ready. Or 0, if waiting failed. */
+int wait_for_input(int fd);
+
+/* Wait for SIGCHLD or completion of utility thread not longer than timeout milliseconds (-1 is infinity).
+   Return 1, if children or threads changed state, 0 on timeout, -1 on error. */
+int wait_for_children(int timeout);
+
+/* Wake the event loop from thread of utility, which has completed. */
+void wake_event_loop();
+
+/* Close descriptors of event loop. */
+void close_event_loop();
+
+#endif
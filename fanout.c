@@ -0,0 +1,264 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "fanout.h"
+#include "stats.h"
+#include "workers.h"
+
+/* Body of relay thread. Copy data of fanout f to its targets until end of file or errors of all targets. */
+static void *run_fanout(void *arg);
+
+/* Move len bytes, which are in pipe from, to descriptor to. Files, which splice can't write to,
+   like opened with O_APPEND, are written through buf. Target -1 or target after error discards data.
+   Return 0, if success. Or -1, if target failed. */
+static int move_data(int from, int to, size_t len, char *buf);
+
+/* Close target i of fanout f after its error. */
+static void drop_target(fanout *f, int i);
+
+/* Release fanout f by one of its owners. The last one frees it. */
+static void release_fanout(fanout *f);
+
+/* Start fanout of data to count descriptors of targets and add it to list. Fanout owns targets, if success.
+   Set *out to writing end of pipe for command. Return 0, if success. Or errno. */
+int start_fanout(fanout **list, const int *targets, int count, int *out)
+{
+    int in[2], opened, err = 0;
+    long capacity;
+    pthread_t thread;
+
+    /* Struct, buffer, pipes and targets are allocated together. */
+    fanout *f = malloc(sizeof(fanout) + FANOUT_CHUNK + (size_t) count * (sizeof(int[2]) + sizeof(int)));
+
+    if (!f)
+        return ENOMEM;
+    f->buf = (char *) (f + 1);
+    f->mids = (int (*)[2]) (f->buf + FANOUT_CHUNK);
+    f->targets = (int *) (f->mids + count);
+    f->count = count;
+    f->chunk = FANOUT_CHUNK;
+    atomic_init(&f->done, 0);
+    atomic_init(&f->refs, 2);
+    for (int i = 0; i < count; ++i)
+        f->targets[i] = targets[i];
+
+    if ((f->event = eventfd(0, EFD_CLOEXEC)) < 0)
+    {
+        free(f);
+        return errno;
+    }
+    if (pipe2(in, O_CLOEXEC) < 0)
+    {
+        err = errno;
+        close(f->event);
+        free(f);
+        return err;
+    }
+    f->in = in[0];
+
+    /* Duplicated data must fit to each pipe at once, so chunk is limited by their capacities. */
+    for (opened = 0; opened < count - 1; ++opened)
+    {
+        if (pipe2(f->mids[opened], O_CLOEXEC) < 0)
+        {
+            err = errno;
+            break;
+        }
+        if ((capacity = fcntl(f->mids[opened][1], F_GETPIPE_SZ)) > 0 && (size_t) capacity < f->chunk)
+            f->chunk = (size_t) capacity;
+    }
+
+    if (!err)
+        err = start_shell_thread(run_fanout, f, &thread);
+
+    if (err)
+    {
+        for (int i = 0; i < opened; ++i)
+        {
+            close(f->mids[i][0]);
+            close(f->mids[i][1]);
+        }
+        close(in[0]);
+        close(in[1]);
+        close(f->event);
+        free(f);
+        return err;
+    }
+
+    /* Relay ends itself, when the command closes its output. */
+    pthread_detach(thread);
+    *out = in[1];
+    f->next = *list;
+    *list = f;
+
+    return 0;
+}
+
+/* Wait up to FANOUT_SETTLE_TIMEOUT until fanouts of list write all data of their commands, after commands completed.
+   Descendant of command, which keeps its output, holds relay longer, so the shell doesn't wait for it. */
+void wait_fanouts(fanout *list)
+{
+    unsigned long long now, deadline = monotonic_ns() + FANOUT_SETTLE_TIMEOUT * 1000000ULL;
+    struct pollfd pfd;
+
+    /* Relay signals its eventfd, when it ends, so the shell sleeps until then. */
+    for (; list; list = list->next)
+        while (!atomic_load(&list->done))
+        {
+            if ((now = monotonic_ns()) >= deadline)
+                return;
+            pfd.fd = list->event;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, (int) ((deadline - now + 999999) / 1000000)) < 0 && errno != EINTR)
+                return;
+        }
+}
+
+/* Release fanouts of list by job. Fanouts of running relays are freed by their threads. */
+void release_fanouts(fanout *list)
+{
+    fanout *next;
+
+    for (; list; list = next)
+    {
+        next = list->next;
+        release_fanout(list);
+    }
+}
+
+/* Body of relay thread. Copy data of fanout f to its targets until end of file or errors of all targets. */
+static void *run_fanout(void *arg)
+{
+    fanout *f = arg;
+    int last = f->count - 1, files = last;
+    ssize_t n = 1, copied;
+
+    /* Data is duplicated to pipe of each file, which is left, and the last target consumes original. */
+    while (files && n > 0)
+    {
+        n = -1;
+        for (int i = 0; i < last && n; ++i)
+        {
+            if (f->targets[i] == -1)
+                continue;
+            while ((copied = tee(f->in, f->mids[i][1], n < 0 ? f->chunk : (size_t) n, 0)) < 0 && errno == EINTR);
+            if (n < 0)
+                n = copied;
+            else if (copied != n)
+            {
+                /* Pipe of file is empty and takes the chunk, so partial copy is left in it. */
+                if (copied > 0)
+                    move_data(f->mids[i][0], -1, (size_t) copied, f->buf);
+                drop_target(f, i);
+                files--;
+            }
+        }
+        if (n <= 0)
+            break;
+
+        for (int i = 0; i < last; ++i)
+            if (f->targets[i] != -1 && move_data(f->mids[i][0], f->targets[i], (size_t) n, f->buf))
+            {
+                drop_target(f, i);
+                files--;
+            }
+        if (move_data(f->in, f->targets[last], (size_t) n, f->buf) && f->targets[last] != -1)
+            drop_target(f, last);
+    }
+
+    /* The last target is left only, so data is moved without duplication. */
+    while (!files && n > 0 && f->targets[last] != -1)
+    {
+        while ((n = splice(f->in, NULL, f->targets[last], NULL, f->chunk, SPLICE_F_MOVE)) < 0 && errno == EINTR);
+        if (n < 0 && errno == EINVAL && (n = read(f->in, f->buf, f->chunk)) > 0)
+            n = move_data(-1, f->targets[last], (size_t) n, f->buf) ? -1 : n;
+        if (n < 0)
+            drop_target(f, last);
+    }
+
+    /* Command gets broken pipe, if all targets failed. */
+    close(f->in);
+    for (int i = 0; i < f->count; ++i)
+    {
+        if (f->targets[i] != -1)
+            close(f->targets[i]);
+        if (i < last)
+        {
+            close(f->mids[i][0]);
+            close(f->mids[i][1]);
+        }
+    }
+
+    atomic_store(&f->done, 1);
+    while (eventfd_write(f->event, 1) < 0 && errno == EINTR);
+    release_fanout(f);
+
+    return NULL;
+}
+
+/* Move len bytes, which are in pipe from, to descriptor to. Files, which splice can't write to,
+   like opened with O_APPEND, are written through buf. Target -1 or target after error discards data.
+   Return 0, if success. Or -1, if target failed. */
+static int move_data(int from, int to, size_t len, char *buf)
+{
+    int failed = to == -1;
+    ssize_t n, written;
+
+    while (len)
+    {
+        n = -1;
+        if (!failed && from != -1)
+            while ((n = splice(from, NULL, to, NULL, len, SPLICE_F_MOVE)) < 0 && errno == EINTR);
+
+        /* Data, which wasn't spliced, is read to buffer: buf already holds it, if from is -1. */
+        if (n < 0 && (failed || errno == EINVAL))
+        {
+            if (from != -1)
+                while ((n = read(from, buf, len < FANOUT_CHUNK ? len : FANOUT_CHUNK)) < 0 && errno == EINTR);
+            else
+                n = (ssize_t) len;
+            for (written = 0; n > 0 && !failed && written < n;)
+            {
+                ssize_t w = write(to, buf + written, (size_t) (n - written));
+                if (w >= 0)
+                    written += w;
+                else if (errno != EINTR)
+                    failed = 1;
+            }
+        }
+        else if (n < 0)
+        {
+            /* Error of target, the rest of data is discarded. */
+            failed = 1;
+            continue;
+        }
+
+        if (n <= 0)
+            break;
+        len -= (size_t) n;
+    }
+
+    return failed && to != -1 ? -1 : 0;
+}
+
+/* Close target i of fanout f after its error. */
+static void drop_target(fanout *f, int i)
+{
+    close(f->targets[i]);
+    f->targets[i] = -1;
+}
+
+/* Release fanout f by one of its owners. The last one frees it. */
+static void release_fanout(fanout *f)
+{
+    if (atomic_fetch_sub(&f->refs, 1) == 1)
+    {
+        close(f->event);
+        free(f);
+    }
+}
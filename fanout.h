@@ -0,0 +1,37 @@
+#ifndef UNIX_SHELL_FANOUT_H
+#define UNIX_SHELL_FANOUT_H
+
+#include <stdatomic.h>
+
+#define FANOUT_CHUNK         (64 * 1024) /* maximal bytes, which are duplicated at once */
+#define FANOUT_SETTLE_TIMEOUT 1000       /* milliseconds to wait for relays of completed command */
+
+/* Relay, which copies output of command from pipe to several targets like >a >b | next.
+   Thread of shell duplicates data with tee to pipe of each file and moves it with splice,
+   so data isn't copied to the shell. */
+typedef struct fanout
+{
+    struct fanout *next;    /* next fanout of job */
+    int in;                 /* reading end of pipe of command, owned by thread */
+    int count;              /* count of targets */
+    int *targets;           /* descriptors of targets, the last one consumes data of in. -1 after error of target */
+    int (*mids)[2];         /* pipes, which hold duplicated data for targets except the last one */
+    size_t chunk;           /* bytes, which fit to each pipe of mids */
+    char *buf;              /* FANOUT_CHUNK bytes for files, which splice can't write to */
+    atomic_int done;        /* true if all data was written to targets */
+    int event;              /* eventfd, which thread signals after done is set */
+    atomic_int refs;        /* count of owners: job and thread */
+} fanout;
+
+/* Start fanout of data to count descriptors of targets and add it to list. Fanout owns targets, if success.
+   Set *out to writing end of pipe for command. Return 0, if success. Or errno. */
+int start_fanout(fanout **list, const int *targets, int count, int *out);
+
+/* Wait up to FANOUT_SETTLE_TIMEOUT until fanouts of list write all data of their commands, after commands completed.
+   Descendant of command, which keeps its output, holds relay longer, so the shell doesn't wait for it. */
+void wait_fanouts(fanout *list);
+
+/* Release fanouts of list by job. Fanouts of running relays are freed by their threads. */
+void release_fanouts(fanout *list);
+
+#endif
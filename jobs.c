@@ -1,23 +1,81 @@
+#define _GNU_SOURCE
 #include <fcntl.h>
+#include <limits.h>
 #include <assert.h>
 #include "jobs.h"
 #include "shell.h"
+#include "events.h"
+#include "workers.h"
+#include "stats.h"
+#include "trace.h"
+#include "monitor.h"
+#include "board.h"
+
+#define PID_MAP_EMPTY     0  /* keys of free and removed slots of pid_map */
+#define PID_MAP_REMOVED  -1
+#define PID_MAP_MIN_SIZE  64 /* initial capacity of pid_map */
+
+/* Open addressing hash map from pid to pointer. */
+typedef struct pid_map
+{
+    pid_t *keys;        /* pids of slots */
+    void **values;      /* values of slots */
+    size_t capacity;    /* count of slots, power of 2 */
+    size_t used;        /* count of busy and removed slots */
+    size_t count;       /* count of busy slots */
+} pid_map;
+
+static job **job_table = NULL;  /* jobs in order of their indexes */
+static int job_count = 0;       /* count of jobs in job_table */
+static int job_capacity = 0;    /* size of job_table */
+static pid_map pgid_index;      /* map from pgid to job */
+static pid_map pid_index;       /* map from pid to process */
+static int outer_jobs = 0;      /* count of jobs in job_table, which aren't only inner commands */
+static int first_dropped = -1;  /* lowest empty slot of job_table left by drop_job(), or -1 */
+
+/* Find slot of pid in map. Return index of slot with key or of free slot. */
+static size_t pid_map_slot(pid_map *map, pid_t pid);
+
+/* Find value of pid in map. Return NULL, if not found. */
+static void *pid_map_get(pid_map *map, pid_t pid);
+
+/* Put value of pid to map. Return 0, if success. */
+static int pid_map_put(pid_map *map, pid_t pid, void *value);
+
+/* Remove pid from map. */
+static void pid_map_remove(pid_map *map, pid_t pid);
+
+/* Reap status of any child without blocking like waitpid, which is used with WUNTRACED and WNOHANG.
+   Resources of completed child are stored to its process. Return pid of child, 0 or -1 like waitpid. */
+static pid_t wait_child(int *status);
+
+/* Free memory of map. */
+static void pid_map_free(pid_map *map);
+
+/* Parse capacity of pipe from bytes with optional suffix K or M to *size. Return 0, if success. */
+static int parse_pipe_size(const char *value, long *size);
+
+/* Create processes of substitutions of command cmd with owner and append them to *link.
+   Args of owner are copied, so their words of substitutions are replaced at launch. Return 0, if success. */
+static int fill_substitutions(job *jobs, process *owner, ast_command *cmd, process ***link);
+
+/* Put job and its launched processes to indexes. */
+static int index_job(job *jobs);
+
+/* Remove job with its processes from indexes and job table. */
+static void unlink_job(job *jobs);
 
-/* Head of job list. */
-job *head_job_list = NULL;
+/* Remove job with its processes from indexes and leave empty slot in job table,
+   which compact_jobs() removes. Job list isn't walked until then. */
+static void drop_job(job *jobs);
+
+/* Remove empty slots of job table by one pass, renumbering and relinking next jobs. */
+static void compact_jobs();
 
 /* Check job contains only inner commands. */
 int job_is_inner(job* jobs)
 {
-    if(!jobs)
-        return 0;
-
-    process *p;
-    for (p = jobs->first_process; p; p = p->next)
-        if(!command_is_inner(p->argv[0]))
-            return 0;
-
-    return 1;
+    return jobs && !jobs->outer_count;
 }
 
 /* Clear job list. */
@@ -28,56 +86,68 @@ void clear_job_list(int kill_jobs)
     {
         j = find_job_jid(i);
         if(kill_jobs && !job_is_inner(j))
-            kill(-j->pgid, SIGTERM);
+            signal_job(j, SIGTERM);
 
-        remove_job(j->pgid);
+        unlink_job(j);
+
+        /* Running threads still use memory of their jobs. */
+        if(!job_has_workers(j))
+            free_job(j);
     }
+
+    free(job_table);
+    job_table = NULL;
+    job_capacity = 0;
+    pid_map_free(&pgid_index);
+    pid_map_free(&pid_index);
 }
 
 /* Find the job with the indicated pgid. */
 job *find_job_pgid(pid_t pgid)
 {
-    job *j;
+    if(pgid > 0)
+        return pid_map_get(&pgid_index, pgid);
 
-    for (j = get_job_list_head(); j; j = j->next)
-        if (j->pgid == pgid)
-            return j;
+    /* Jobs of inner commands haven't process group, so they aren't indexed. */
+    for (int i = 0; i < job_count; ++i)
+        if (job_table[i]->pgid == pgid)
+            return job_table[i];
     return NULL;
 }
 
 /* Return last index of job in list. */
 int get_last_job_index()
 {
-    int i = 0;
-    job *j;
-
-    for (j = get_job_list_head(); j; j = j->next, ++i);
-
-    return i - 1;
+    return job_count - 1;
 }
 
 /* Get head of job list. */
 job *get_job_list_head()
 {
-    return head_job_list;
+    return job_count ? job_table[0] : NULL;
 }
 
 /* Set head of job list. */
 void set_job_list_head(job* job1)
 {
-    head_job_list = job1;
+    /* Rebuild table from list of job1. */
+    while (job_count)
+        unlink_job(job_table[job_count - 1]);
+
+    job *next;
+    for (job *j = job1; j; j = next)
+    {
+        next = j->next;
+        add_job(j);
+    }
 }
 
 /* Get job by index in job list. */
 job *find_job_jid(int index)
 {
-    job *j;
-    int i = 0;
-
-    for (j = get_job_list_head(); j; j = j->next, i++)
-        if (i == index)
-            return j;
-    return NULL;
+    if (index < 0 || index >= job_count)
+        return NULL;
+    return job_table[index];
 }
 
 /* Return true if all processes in the job have stopped or completed. */
@@ -107,61 +177,153 @@ int job_is_completed(job *jobs)
     return 1;
 }
 
-/* Return index of job in list. */
-int get_job_index(pid_t pgid)
+/* Return exit status of job by status of its last process. */
+int job_exit_status(job *jobs)
 {
-    if(pgid < 0)
-        return -1;
+    if(!jobs || !jobs->first_process)
+        return 0;
 
-    int i = 0;
-    job *j;
+    process *p, *last = NULL;
+    int status = 0;
 
-    for (j = get_job_list_head(); j; j = j->next, ++i)
-        if (j->pgid == pgid)
-            return i;
+    /* Status of the first failed batch of last command is used, like in xargs. */
+    for (p = jobs->first_process; p && !p->owner; p = p->next)
+        if (!p->batch || !status)
+        {
+            if (!p->batch)
+                last = p;
+            status = p->status;
+        }
 
-    return -1;
+    if (!last)
+        return 0;
+
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 0;
 }
 
-/* Create job for foreground process. */
-job* create_new_job(pid_t pgid, char* name)
+/* Split args of process p, which are too long for exec, to batches.
+   Leading options of p are repeated in each batch.
+   Batches are added to job after p as new processes.
+   Return count of batches. */
+int split_arg_batches(job *jobs, process *p)
 {
+    assert(jobs != NULL);
+    assert(p != NULL);
+
+    extern char **environ;
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t limit, fixed_size, size, total;
+    int fixed, argc, begin, i, count = 0;
+    process *last = p, *batch;
+    char **argv = p->argv;
+
+    if (arg_max <= 0)
+        return 1;
+
+    /* Environment is passed to exec together with args. Keep margin like xargs. */
+    size = 2048;
+    for (char **env = environ; *env; ++env)
+        size += strlen(*env) + 1 + sizeof(char *);
+    if ((size_t) arg_max <= size)
+        return 1;
+    limit = (size_t) arg_max - size;
+
+    /* Command name and leading options are fixed. */
+    for (fixed = 1; argv[fixed] && argv[fixed][0] == '-'; ++fixed)
+        if (!strcmp(argv[fixed], "--"))
+        {
+            fixed++;
+            break;
+        }
 
-    job* new_job = malloc(sizeof(job));
+    fixed_size = sizeof(char *);
+    for (i = 0; i < fixed; ++i)
+        fixed_size += strlen(argv[i]) + 1 + sizeof(char *);
+    for (total = fixed_size, argc = fixed; argv[argc]; ++argc)
+        total += strlen(argv[argc]) + 1 + sizeof(char *);
 
-    if(!new_job)
+    if (total <= limit || argc == fixed)
+        return 1;
+
+    /* Cut args to batches. The first batch stays in p. */
+    for (begin = fixed; begin < argc; begin = i)
     {
-        perror("malloc");
-        return NULL;
+        size = fixed_size;
+        for (i = begin; i < argc; ++i)
+        {
+            size_t arg_size = strlen(argv[i]) + 1 + sizeof(char *);
+            if (i > begin && size + arg_size > limit)
+                break;
+            size += arg_size;
+        }
+
+        char **batch_argv = arena_alloc(jobs->mem, (size_t) (fixed + i - begin + 1) * sizeof(char *));
+        batch = count ? arena_alloc(jobs->mem, sizeof(process)) : p;
+        if (!batch_argv || !batch)
+        {
+            perror("malloc");
+            break;
+        }
+
+        memcpy(batch_argv, argv, (size_t) fixed * sizeof(char *));
+        memcpy(batch_argv + fixed, argv + begin, (size_t) (i - begin) * sizeof(char *));
+        batch_argv[fixed + i - begin] = NULL;
+
+        if (count)
+        {
+            memset(batch, 0, sizeof(process));
+            batch->batch = 1;
+            batch->job = jobs;
+            batch->next = last->next;
+            last->next = batch;
+            last = batch;
+        }
+        batch->argv = batch_argv;
+        count++;
     }
 
-    memset(new_job, 0, sizeof(job));
+    return count;
+}
 
-    new_job->command = malloc(sizeof(char) * (strlen(name) + 1));
+/* Return index of job in list. */
+int get_job_index(pid_t pgid)
+{
+    if(pgid < 0)
+        return -1;
+
+    job *j = find_job_pgid(pgid);
+
+    return j ? j->jid : -1;
+}
+
+/* Create job for foreground process in arena of parsed line.
+   name must be stored in mem. */
+job* create_new_job(pid_t pgid, char* name, arena *mem)
+{
+    assert(mem != NULL);
+
+    job* new_job = arena_alloc(mem, sizeof(job));
 
-    if(!new_job->command)
+    if(!new_job)
     {
         perror("malloc");
-        free(new_job);
         return NULL;
     }
 
-    memcpy(new_job->command, name, strlen(name) + 1);
-
-    /* Remove all \n in the end of name. */
-    for (int i = (int)strlen(name); i >= 0; --i)
-        if(new_job->command[i] == '\n')
-        {
-            new_job->command[i] = '\0';
-            if(i == 0 || new_job->command[i - 1] != '\n')
-                break;
-        }
+    memset(new_job, 0, sizeof(job));
 
+    /* Job keeps memory of line, until it's removed. */
+    arena_ref(mem);
+    new_job->mem = mem;
+    new_job->command = name;
     new_job->next = NULL;
     new_job->pgid = pgid;
     new_job->stderr_file = STDERR_FILENO;
     new_job->stdout_file = STDOUT_FILENO;
     new_job->stdin_file = STDIN_FILENO;
+    new_job->batch_in = new_job->batch_out = -1;
     new_job->tmodes = shell_tmodes;
 
     return new_job;
@@ -173,16 +335,34 @@ int add_job(job* jobs)
     if(!jobs)
         return 0;
 
-    job *j;
+    /* Grow job table. */
+    if(job_count == job_capacity)
+    {
+        int capacity = job_capacity ? job_capacity * 2 : 16;
+        job **table = realloc(job_table, (size_t) capacity * sizeof(job *));
 
-    for (j = get_job_list_head(); j; j = j->next)
-        if(!j->next)
-            break;
+        if(!table)
+        {
+            perror("realloc");
+            return 0;
+        }
+        job_table = table;
+        job_capacity = capacity;
+    }
 
-    if(j)
-        j->next = jobs;
-    else
-        set_job_list_head(jobs);
+    jobs->jid = job_count;
+    jobs->next = NULL;
+    if(job_count)
+        job_table[job_count - 1]->next = jobs;
+    job_table[job_count++] = jobs;
+    if(jobs->outer_count)
+        outer_jobs++;
+
+    if(index_job(jobs))
+    {
+        unlink_job(jobs);
+        return 0;
+    }
 
     return 1;
 }
@@ -190,27 +370,65 @@ int add_job(job* jobs)
 /* Remove job from job list. Return success, if removed. */
 int remove_job(pid_t pgid)
 {
-    if(pgid < 0 || !get_job_list_head())
+    if(pgid < 0)
         return 0;
 
-    job *j, *jlast = NULL;
+    job *j = find_job_pgid(pgid);
+
+    if(!j)
+        return 0;
 
-    for (j = get_job_list_head(); j; j = j->next)
+    unlink_job(j);
+    free_job(j);
+    return 1;
+}
+
+/* Record pid of launched process p of job.
+   The first process becomes the leader of process group of job. */
+void set_process_pid(job *jobs, process *p, pid_t pid)
+{
+    assert(jobs != NULL);
+    assert(p != NULL);
+
+    p->pid = pid;
+    p->job = jobs;
+    if (!jobs->pgid)
     {
-        if(j->pgid == pgid)
+        jobs->pgid = pid;
+        if (pid_map_put(&pgid_index, pid, jobs))
+            perror("malloc");
+    }
+
+    if (pid_map_put(&pid_index, pid, p))
+        perror("malloc");
+}
+
+/* Send signal sig to processes of job: to its process group under job control,
+   or to each running process, which stays in group of the shell without it.
+   Return 0, if success. Or -1 with errno, if signal reached no process. */
+int signal_job(job *jobs, int sig)
+{
+    assert(jobs != NULL);
+
+    int sent = 0, err = ESRCH;
+
+    if (shell_is_interactive)
+        return kill(-jobs->pgid, sig);
+
+    /* Utilities on threads of shell have no pid. */
+    for (process *p = jobs->first_process; p; p = p->next)
+        if (p->pid > 0 && !p->completed)
         {
-            job* next = j->next;
-            free_job(j);
-            if(jlast)
-                jlast->next = next;
+            if (!kill(p->pid, sig))
+                sent = 1;
             else
-                set_job_list_head(next);
-            return 1;
+                err = errno;
         }
-        jlast = j;
-    }
 
-    return 0;
+    if (sent)
+        return 0;
+    errno = err;
+    return -1;
 }
 
 /* Free memory of job. */
@@ -219,28 +437,26 @@ void free_job(job* jobs)
     if(!jobs)
         return;
 
-    if(jobs->first_process)
+    if(jobs->batch_in != -1)
+        close(jobs->batch_in);
+    if(jobs->batch_out != -1)
+        close(jobs->batch_out);
+
+    /* Counters of processes, which didn't complete, are dropped. */
+    for (process *p = jobs->first_process; p; p = p->next)
     {
-        process *p, *pnext;
-        for (p = jobs->first_process; p; p = pnext)
-        {
-            for (int i = 0; i < MAXARGS; ++i)
-                if(!p->argv[i])
-                    break;
-                else
-                    free(p->argv[i]);
-
-            pnext = p->next;
-            p->next = NULL;
-            free(p->argv);
-            free(p);
-        }
+        if (p->perf)
+            perf_collect(p->perf, NULL);
+        if (p->owner && p->subst_fd != -1)
+            close(p->subst_fd);
     }
 
-    if(jobs->command)
-        free(jobs->command);
+    board_remove(jobs);
+    release_meters(jobs->meters);
+    release_fanouts(jobs->fanouts);
 
-    free(jobs);
+    /* Job, its processes and their args are stored in arena of line. */
+    arena_release(jobs->mem);
 }
 
 /* Store the status of the process pid that was returned by waitpid.
@@ -253,45 +469,50 @@ int mark_process_status(pid_t pid, int status)
     if(pid > 0)
     {
         /* Update the record for the process. */
-        for(j = get_job_list_head(); j; j = j->next)
+        if((p = pid_map_get(&pid_index, pid)))
         {
-            for(p = j->first_process; p; p = p->next)
-                if(p->pid == pid)
+            j = p->job;
+            trace_process_end(p, status);
+            p->status = status;
+            if (WIFSTOPPED(status))
+            {
+                p->stopped = 1;
+                if(j->have_pipe)
                 {
-                    p->status = status;
-                    if (WIFSTOPPED(status))
+                    signal_job(j, SIGSTOP);
+                    for(p2 = j->first_process; p2; p2 = p2->next)
                     {
-                        p->stopped = 1;
-                        if(j->have_pipe)
-                        {
-                            kill(-j->pgid, SIGSTOP);
-                            for(p2 = j->first_process; p2; p2 = p2->next)
-                                p2->stopped = 1;
-                        }
+                        trace_process_end(p2, status);
+                        p2->stopped = 1;
                     }
-                    else
+                }
+            }
+            else
+            {
+                p->completed = 1;
+
+                /* Counters of process are final after its exit. */
+                if(p->perf)
+                    perf_collect(p->perf, j->perf);
+
+                /* Launch next batch of args instead of completed one. */
+                if(j->batch_in != -1)
+                    launch_pending_batches(j, 0);
+                /* Writers of pipeline die silently by SIGPIPE after the reader exits. */
+                if(WIFSIGNALED(status) && WTERMSIG(status) != SIGPIPE)
+                {
+                    if(invite_mode)
                     {
-                        p->completed = 1;
-                        if(WIFSIGNALED(status))
-                        {
-                            if(invite_mode)
-                            {
-                                fprintf(stdout, "\n");
-                                invite_mode = 0;
-                            }
-                            fprintf(stdout, "[%d] - %s: Terminated by signal %d.\n",
-                                    get_job_index(j->pgid), p->argv[0], WTERMSIG (p->status));
-                            fflush(stdout);
-                        }
-                        if(j->have_pipe)
-                        {
-                            kill(-j->pgid, SIGKILL);
-                            for(p2 = j->first_process; p2; p2 = p2->next)
-                                p2->completed = 1;
-                        }
+                        fprintf(stdout, "\n");
+                        invite_mode = 0;
                     }
-                    return 0;
+                    fprintf(stdout, "[%d] - %s: Terminated by signal %d.\n",
+                            j->jid, p->argv[0], WTERMSIG (p->status));
+                    fflush(stdout);
                 }
+            }
+            job_changed(j);
+            return 0;
         }
 
         fprintf(stderr, "No child process %d.\n", pid);
@@ -311,11 +532,7 @@ int mark_process_status(pid_t pid, int status)
 /* Check job list on containing non inner commands. */
 int job_list_is_inner()
 {
-    for(job *j = get_job_list_head(); j; j = j->next)
-        if(!job_is_inner(j))
-            return 0;
-
-    return 1;
+    return !outer_jobs;
 }
 
 /* Check for processes that have status information available,
@@ -325,13 +542,16 @@ void update_job_status()
     int status;
     pid_t pid;
 
+    /* Threads of utilities aren't children, they are joined separately. */
+    reap_workers();
+
     /* Return, because of we haven't child processes, if condition is true. */
     if(!get_job_list_head() || job_list_is_inner())
         return;
     
     /* Wait all child, also we close zombie processes. */
     do
-        pid = waitpid(WAIT_ANY, &status, WUNTRACED | WNOHANG);
+        pid = wait_child(&status);
     while (!mark_process_status(pid, status));
 }
 
@@ -339,13 +559,72 @@ void update_job_status()
 void format_job_info(job *jobs, const char *status)
 {
     if(status)
-        fprintf(stdout, "[%d] (%s): %s", get_job_index(jobs->pgid), status, jobs->command);
+        fprintf(stdout, "[%d] (%s): %s", jobs->jid, status, jobs->command);
     else
         /* Used for, if this job put in background. */
-        fprintf(stdout, "[%d] : %u" , get_job_index(jobs->pgid), jobs->pgid);
+        fprintf(stdout, "[%d] : %u" , jobs->jid, jobs->pgid);
     fflush(stdout);
 }
 
+/* Print resources of processes of job j and their sum to fd. */
+void print_job_usage(job *j, int fd)
+{
+    assert(j != NULL);
+
+    char pid[16];
+    proc_usage sum;
+
+    usage_clear(&sum);
+    print_usage_header(fd);
+    for (process *p = j->first_process; p; p = p->next)
+    {
+        /* Builtins run inside shell without own pid. */
+        if (p->pid)
+            snprintf(pid, sizeof(pid), "%d", (int) p->pid);
+        else
+            strcpy(pid, "shell");
+        print_usage(fd, pid, &p->usage, p->argv[0]);
+        usage_add(&sum, &p->usage);
+    }
+    print_usage(fd, "total", &sum, NULL);
+}
+
+/* Print reports of time and perfstat prefixes and meters of pipes of completed job j to its stderr. */
+void report_job(job *j)
+{
+    assert(j != NULL);
+
+    if (j->timed)
+        print_job_usage(j, j->stderr_file);
+    if (j->perf)
+        print_perf_totals(j->stderr_file, j->perf, j->command);
+    if (j->metered && j->meters)
+    {
+        settle_meters(j->meters);
+        print_meters(j->stderr_file, j->meters);
+    }
+}
+
+/* Print jobs with resources of their processes to fd. */
+void print_job_list_usage(int fd)
+{
+    /* Status of children is updated before the report. */
+    update_job_status();
+
+    for (int i = 0; i < job_count; ++i)
+    {
+        job *j = job_table[i];
+
+        if (!j || j == current_job)
+            continue;
+        dprintf(fd, "[%d] (%s): %s\n", j->jid,
+                job_is_completed(j) ? "completed" : job_is_stopped(j) ? "stopped" : "running", j->command);
+        print_job_usage(j, fd);
+        if (j->meters)
+            print_meters(fd, j->meters);
+    }
+}
+
 /* Notify the user about stopped or terminated jobs.
    Delete terminated jobs from the active job list. */
 void do_job_notification(int show_all)
@@ -363,6 +642,17 @@ void do_job_notification(int show_all)
         if(!strcmp(j->command, "jobs"))
             continue;
 
+        /* Non-interactive shell silently forgets completed background jobs. */
+        if (!shell_is_interactive && !show_all)
+        {
+            if (job_is_completed(j) && j != current_job)
+            {
+                drop_job(j);
+                free_job(j);
+            }
+            continue;
+        }
+
         /* If all processes have completed, tell the user the job has
            completed and delete it from the list of active jobs. */
         if (job_is_completed(j) && j != current_job)
@@ -371,7 +661,14 @@ void do_job_notification(int show_all)
                 fprintf(stdout, "\n");
 
             format_job_info(j, "completed");
-            remove_job(j->pgid);
+            if (j->timed || j->perf || j->metered)
+            {
+                fprintf(stdout, "\n");
+                fflush(stdout);
+                report_job(j);
+            }
+            drop_job(j);
+            free_job(j);
             printed = 1;
             invite_mode = 0;
         }
@@ -390,7 +687,10 @@ void do_job_notification(int show_all)
         }
         /* Don't say anything about jobs that are still running. */
     }
-    
+
+    /* Completed jobs leave the table at once, so reaping of many jobs takes linear time. */
+    compact_jobs();
+
     /* Make new line, if we printed something. */
     if(printed)
     {
@@ -399,34 +699,56 @@ void do_job_notification(int show_all)
     }
 }
 
-/* Create job from command array from parsed line. */
-void fill_job(job **jobs, int ncmds)
+/* Publish changed state of job j to monitor and board. */
+void job_changed(job *j)
 {
-    if(!jobs || !*jobs)
+    monitor_job(j);
+    board_job(j);
+}
+
+/* Create processes of job from pipeline of parsed line. */
+void fill_job(job **jobs, pipeline *pl)
+{
+    if(!jobs || !*jobs || !pl)
         return;
 
-    register int i, u;
-    process *first_process = NULL;
+    ast_command *cmd;
     process *p = NULL;
     process *p_last = NULL;
-    unsigned long size = 0;
+    process *substs = NULL, **subst_link = &substs;
 
-    for (i = 0; i < ncmds + 1; i++)
+    for (cmd = pl->first_command; cmd; cmd = cmd->next)
     {
-        size = 0;
-        for (u = 0; u < MAXARGS; ++u)
-        {
-            size++;
-            if (!cmds[i].cmdargs[u])
-                break;
-        }
-
         /* Avoid empty commands. */
-        if(size == 1)
+        if(!cmd->argc)
             continue;
 
-        /* Create new process. */
-        p_last = malloc(sizeof(process));
+        /* Prefixes time and perfstat of pipeline report resources of job. Single time is inner command.
+           Prefix pipesize=bytes or pipesize=auto sets capacity of pipes of job. */
+        char **argv = cmd->argv;
+        for (int argc = cmd->argc; cmd == pl->first_command && argc > 1; --argc, ++argv)
+            if(!strcmp(argv[0], "time"))
+                (*jobs)->timed = 1;
+            else if(!strcmp(argv[0], "pipesize=auto"))
+                (*jobs)->pipe_grow = 1;
+            else if(!strncmp(argv[0], "pipesize=", 9) && !parse_pipe_size(argv[0] + 9, &(*jobs)->pipe_size))
+                continue;
+            else if(!strcmp(argv[0], "perfstat") && !(*jobs)->perf)
+            {
+                if(!((*jobs)->perf = arena_alloc((*jobs)->mem, sizeof(perf_totals))))
+                {
+                    perror("malloc");
+                    free_job(*jobs);
+                    (*jobs) = NULL;
+                    return;
+                }
+                memset((*jobs)->perf, 0, sizeof(perf_totals));
+            }
+            else
+                break;
+
+        /* Create new process. Its args are stored in arena already. */
+        p_last = arena_alloc((*jobs)->mem, sizeof(process));
 
         if(!p_last)
         {
@@ -438,95 +760,50 @@ void fill_job(job **jobs, int ncmds)
 
         /* Set all fields of p_last to 0 or NULL. */
         memset(p_last, 0, sizeof(process));
+        p_last->job = *jobs;
+        p_last->argv = argv;
+        p_last->redirects = cmd->redirects;
 
-        /* Fill argv for p_last. */
-        p_last->argv = malloc(size * sizeof(char *));
-
-        if(!p_last->argv)
-        {
-            perror("malloc");
-            free_job(*jobs);
-            (*jobs) = NULL;
-            return;
-        }
-
-        for (unsigned long j = 0; j < size; ++j)
-            if (cmds[i].cmdargs[j])
-            {
-                /* copy arg string to p_last. */
-                p_last->argv[j] = malloc((strlen(cmds[i].cmdargs[j]) + 1) * sizeof(char));
-
-                if(!p_last->argv[j])
-                {
-                    perror("malloc");
-                    free_job(*jobs);
-                    (*jobs) = NULL;
-                    return;
-                }
-
-                memcpy(p_last->argv[j], cmds[i].cmdargs[j], strlen(cmds[i].cmdargs[j]) + 1);
-            }
-            else
-            {
-                /* The end of args in p_last. */
-                p_last->argv[j] = NULL;
-                break;
-            }
-
-        if (!first_process)
-            first_process = p_last;
+        /* Command is classified once, launch and reaping use the result. */
+        p_last->builtin = find_builtin(argv[0]);
+        if(!BUILTIN_IS_INNER(p_last->builtin))
+            (*jobs)->outer_count++;
 
         if (p)
             p->next = p_last;
+        else
+            (*jobs)->first_process = p_last;
         p = p_last;
 
-        /* Open input file, if user redirect STDIN. */
-        if (!i && infile)
+        if (cmd->substs && fill_substitutions(*jobs, p_last, cmd, &subst_link))
         {
-            int input = open(infile, O_RDONLY);
-            if (input != -1)
-                (*jobs)->stdin_file = input;
-            else
-            {
-                perror("Couldn't open input file");
-                free_job(*jobs);
-                (*jobs) = NULL;
-                return;
-            }
+            perror("malloc");
+            free_job(*jobs);
+            (*jobs) = NULL;
+            return;
         }
+    }
 
-        /* Open input file, if user redirect STDOUT. */
-        if (i == (ncmds - 1) && (outfile || appfile))
-        {
-            int output;
-            if (outfile)
-                /* Rewrite outfile. */
-                output = open(outfile, O_WRONLY | O_TRUNC | O_CREAT, (mode_t) 0644);/* READ-WRITE-NOT_EXECUTE */
-            else
-                /* Append to end of outfile. */
-                output = open(appfile, O_WRONLY | O_APPEND | O_CREAT, (mode_t) 0644);
+    /* Substitutions are members of job after its stages, so they are reaped and listed with it. */
+    if (p)
+        p->next = substs;
+}
 
-            if (output != -1)
-                (*jobs)->stdout_file = output;
-            else
-            {
-                perror("Couldn't open output file");
-                free_job(*jobs);
-                (*jobs) = NULL;
-                return;
-            }
-        }
-    }
-    /* Finally write created process chain to jobs. */
-    (*jobs)->first_process = first_process;
+/* Return the next stage of pipeline after process p, or NULL. Process substitutions aren't stages. */
+process *next_stage(process *p)
+{
+    return p->owner || !p->next || p->next->owner ? NULL : p->next;
 }
 
-/* Used only for SIGCHLD. */
-void notify_child(__attribute__((unused)) int signum)
+/* Close ends of pipes of process substitutions, which are kept for owner p. */
+void close_substitutions(process *p)
 {
-    if(invite_mode)
-        /* Handler prints something, when shell waits input line. */
-        do_job_notification(0);
+    for (process *q = p->next; q; q = q->next)
+        if (q->owner == p && q->subst_fd != -1)
+        {
+            close(q->subst_fd);
+            q->subst_fd = -1;
+        }
 }
 
 /* Mark a stopped job as being running again. */
@@ -548,6 +825,21 @@ void mark_job_as_running(job *jobs)
 void put_job_in_foreground(job *jobs, int cont)
 {
     assert(jobs != NULL);
+
+    trace_job_event(jobs, "foreground");
+
+    /* Without terminal we only wait for the job. */
+    if (!shell_is_interactive)
+    {
+        if (cont && signal_job(jobs, SIGCONT) < 0)
+            perror("kill(SIGCONT)");
+        wait_for_job(jobs);
+        return;
+    }
+
+    /* Handoffs of terminal before and after waiting are recorded as one phase. */
+    unsigned long long handoff_begin = stat_now(), handoff_end;
+
     /* Put the job into the foreground. */
     tcsetpgrp(shell_terminal, jobs->pgid);
 
@@ -555,13 +847,16 @@ void put_job_in_foreground(job *jobs, int cont)
     if (cont)
     {
         tcsetattr(shell_terminal, TCSADRAIN, &jobs->tmodes);
-        if (kill(-jobs->pgid, SIGCONT) < 0)
+        if (signal_job(jobs, SIGCONT) < 0)
             perror("kill(SIGCONT)");
     }
+    handoff_end = stat_now();
 
     /* Wait for it to report. */
     wait_for_job(jobs);
 
+    unsigned long long return_begin = stat_now();
+
     /* Put the shell back in the foreground. */
     tcsetpgrp(shell_terminal, shell_pgid);
 
@@ -569,6 +864,10 @@ void put_job_in_foreground(job *jobs, int cont)
     tcgetattr(shell_terminal, &jobs->tmodes);
     tcsetattr(shell_terminal, TCSADRAIN, &shell_tmodes);
     tcflush(shell_terminal, TCIFLUSH);
+
+    unsigned long long return_end = stat_now();
+    if (handoff_begin && handoff_end && return_begin && return_end)
+        stat_record(STAT_TERMINAL, handoff_end - handoff_begin + return_end - return_begin);
 }
 
 /* Put a job in the background. If the cont argument is true, send
@@ -578,9 +877,11 @@ void put_job_in_background(job *jobs, int cont)
 {
     assert(jobs != NULL);
 
+    trace_job_event(jobs, "background");
+
     /* Send the job a continue signal, if necessary. */
     if (cont)
-        if (kill(-jobs->pgid, SIGCONT) < 0)
+        if (signal_job(jobs, SIGCONT) < 0)
             perror("kill (SIGCONT)");
 }
 
@@ -593,15 +894,42 @@ void wait_for_job(job *jobs)
 
     int status;
     pid_t pid;
+    unsigned long long wait_begin;
 
     /* Return, because of we haven't child processes, if condition is true. */
     if(!get_job_list_head() || job_list_is_inner())
         return;
 
+    wait_begin = stat_now();
+
     /* Wait all child, also we close zombie processes. */
-    do
-        pid = waitpid(WAIT_ANY, &status, WUNTRACED);
-    while (!mark_process_status(pid, status) && !job_is_stopped(jobs) && !job_is_completed(jobs));
+    while (!job_is_stopped(jobs) && !job_is_completed(jobs))
+    {
+        pid = wait_child(&status);
+
+        if (pid > 0)
+            mark_process_status(pid, status);
+        /* Only threads of the job are left, so wait for their completion. */
+        else if (pid < 0 && errno == ECHILD && job_has_workers(jobs))
+        {
+            if (wait_for_children(-1) < 0)
+                break;
+        }
+        else if (pid < 0 && errno != EINTR)
+        {
+            if (errno != ECHILD)
+                perror("waitpid");
+            break;
+        }
+        /* Nothing to reap now, so sleep until SIGCHLD. */
+        else if (pid == 0 && wait_for_children(-1) < 0)
+            break;
+
+        /* Threads of utilities aren't children, they are joined separately. */
+        reap_workers();
+    }
+
+    stat_since(STAT_WAIT, wait_begin);
 }
 
 /* Continue the job to work. Terminal will switch to this job, if foreground = 1. */
@@ -609,7 +937,16 @@ void continue_job(job *jobs, int foreground)
 {
     assert(jobs != NULL);
 
+    /* Stopped processes run again, so they get new slices in trace. */
+    if (trace_active())
+    {
+        trace_job_event(jobs, "continue");
+        for (process *p = jobs->first_process; p; p = p->next)
+            if (p->stopped && !p->completed)
+                trace_process_begin(p, "continued");
+    }
     mark_job_as_running(jobs);
+    job_changed(jobs);
     if (foreground)
     {
         put_job_in_foreground(jobs, 1);
@@ -619,3 +956,278 @@ void continue_job(job *jobs, int foreground)
     else
         put_job_in_background(jobs, 1);
 }
+
+/* Find slot of pid in map. Return index of slot with key or of free slot. */
+static size_t pid_map_slot(pid_map *map, pid_t pid)
+{
+    size_t mask = map->capacity - 1;
+    size_t i = ((size_t) pid * 2654435761u) & mask;
+    size_t removed = map->capacity;
+
+    /* Linear probing. Removed slots may be reused for new keys. */
+    while (map->keys[i] != PID_MAP_EMPTY)
+    {
+        if (map->keys[i] == pid)
+            return i;
+        if (map->keys[i] == PID_MAP_REMOVED && removed == map->capacity)
+            removed = i;
+        i = (i + 1) & mask;
+    }
+
+    return removed != map->capacity ? removed : i;
+}
+
+/* Find value of pid in map. Return NULL, if not found. */
+static void *pid_map_get(pid_map *map, pid_t pid)
+{
+    if (!map->capacity || pid <= 0)
+        return NULL;
+
+    size_t i = pid_map_slot(map, pid);
+    return map->keys[i] == pid ? map->values[i] : NULL;
+}
+
+/* Put value of pid to map. Return 0, if success. */
+static int pid_map_put(pid_map *map, pid_t pid, void *value)
+{
+    assert(pid > 0);
+
+    /* Keep load factor under 1/2, rehash with removed slots dropped. Capacity depends on busy slots only:
+       table doubles, if they fill more than a quarter, and keeps its size, if removed slots are the majority. */
+    if ((map->used + 1) * 2 > map->capacity)
+    {
+        pid_map old = *map;
+        size_t capacity = PID_MAP_MIN_SIZE;
+
+        while ((old.count + 1) * 4 > capacity)
+            capacity *= 2;
+
+        map->keys = calloc(capacity, sizeof(pid_t));
+        map->values = calloc(capacity, sizeof(void *));
+        if (!map->keys || !map->values)
+        {
+            free(map->keys);
+            free(map->values);
+            *map = old;
+            return -1;
+        }
+        map->capacity = capacity;
+        map->used = 0;
+        map->count = 0;
+
+        for (size_t i = 0; i < old.capacity; ++i)
+            if (old.keys[i] > 0)
+            {
+                size_t slot = pid_map_slot(map, old.keys[i]);
+                map->keys[slot] = old.keys[i];
+                map->values[slot] = old.values[i];
+                map->used++;
+                map->count++;
+            }
+
+        pid_map_free(&old);
+    }
+
+    size_t i = pid_map_slot(map, pid);
+    if (map->keys[i] == PID_MAP_EMPTY)
+        map->used++;
+    if (map->keys[i] != pid)
+        map->count++;
+    map->keys[i] = pid;
+    map->values[i] = value;
+
+    return 0;
+}
+
+/* Remove pid from map. */
+static void pid_map_remove(pid_map *map, pid_t pid)
+{
+    if (!map->capacity || pid <= 0)
+        return;
+
+    size_t i = pid_map_slot(map, pid);
+    if (map->keys[i] == pid)
+    {
+        map->keys[i] = PID_MAP_REMOVED;
+        map->count--;
+    }
+}
+
+/* Free memory of map. */
+static void pid_map_free(pid_map *map)
+{
+    free(map->keys);
+    free(map->values);
+    memset(map, 0, sizeof(pid_map));
+}
+
+/* Create processes of substitutions of command cmd with owner and append them to *link.
+   Args of owner are copied, so their words of substitutions are replaced at launch. Return 0, if success. */
+static int fill_substitutions(job *jobs, process *owner, ast_command *cmd, process ***link)
+{
+    size_t argc = 0;
+    char **argv;
+
+    while (owner->argv[argc])
+        argc++;
+    if (!(argv = arena_alloc(jobs->mem, (argc + 1) * sizeof(char *))))
+        return -1;
+    memcpy(argv, owner->argv, (argc + 1) * sizeof(char *));
+    owner->argv = argv;
+
+    for (substitution *sub = cmd->substs; sub; sub = sub->next)
+    {
+        process *p = arena_alloc(jobs->mem, sizeof(process));
+
+        if (!p)
+            return -1;
+        memset(p, 0, sizeof(process));
+        p->job = jobs;
+        p->argv = sub->command->argv;
+        p->redirects = sub->command->redirects;
+        p->builtin = find_builtin(p->argv[0]);
+        p->owner = owner;
+        p->subst_arg = sub->arg;
+        p->subst_kind = (char) sub->kind;
+        p->subst_fd = -1;
+        if(!BUILTIN_IS_INNER(p->builtin))
+            jobs->outer_count++;
+
+        **link = p;
+        *link = &p->next;
+
+        /* Nested substitutions follow their owner. */
+        if (sub->command->substs && fill_substitutions(jobs, p, sub->command, link))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Put job and its launched processes to indexes. */
+static int index_job(job *jobs)
+{
+    if (jobs->pgid > 0 && pid_map_put(&pgid_index, jobs->pgid, jobs))
+        return -1;
+
+    for (process *p = jobs->first_process; p; p = p->next)
+    {
+        p->job = jobs;
+        if (p->pid > 0 && pid_map_put(&pid_index, p->pid, p))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Remove job with its processes from indexes and job table. */
+static void unlink_job(job *jobs)
+{
+    drop_job(jobs);
+    compact_jobs();
+    jobs->next = NULL;
+}
+
+/* Remove job with its processes from indexes and leave empty slot in job table,
+   which compact_jobs() removes. Job list isn't walked until then. */
+static void drop_job(job *jobs)
+{
+    int i = jobs->jid;
+    assert(i >= 0 && i < job_count && job_table[i] == jobs);
+
+    if (pid_map_get(&pgid_index, jobs->pgid) == jobs)
+        pid_map_remove(&pgid_index, jobs->pgid);
+    for (process *p = jobs->first_process; p; p = p->next)
+        if (pid_map_get(&pid_index, p->pid) == p)
+            pid_map_remove(&pid_index, p->pid);
+
+    if(jobs->outer_count)
+        outer_jobs--;
+
+    job_table[i] = NULL;
+    if (first_dropped == -1 || i < first_dropped)
+        first_dropped = i;
+}
+
+/* Remove empty slots of job table by one pass, renumbering and relinking next jobs. */
+static void compact_jobs()
+{
+    int k;
+
+    if (first_dropped == -1)
+        return;
+
+    /* Shift next jobs to keep indexes dense. */
+    k = first_dropped;
+    for (int i = first_dropped; i < job_count; ++i)
+        if (job_table[i])
+        {
+            job_table[k] = job_table[i];
+            job_table[k]->jid = k;
+
+            /* Slots of board show indexes of jobs, so renumbered jobs are published again. */
+            if (k != i && job_table[k]->board_slot)
+                board_job(job_table[k]);
+            k++;
+        }
+    job_count = k;
+
+    for (int i = first_dropped > 0 ? first_dropped - 1 : 0; i < job_count; ++i)
+        job_table[i]->next = i + 1 < job_count ? job_table[i + 1] : NULL;
+    first_dropped = -1;
+}
+
+/* Reap status of any child without blocking like waitpid, which is used with WUNTRACED and WNOHANG.
+   Resources of completed child are stored to its process. Return pid of child, 0 or -1 like waitpid. */
+static pid_t wait_child(int *status)
+{
+    siginfo_t info;
+    struct rusage ru;
+    process *p;
+    pid_t pid;
+
+    /* Counters of /proc/<pid>/io disappear after reaping, so the child is found without reaping at first. */
+    info.si_pid = 0;
+    if (waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WNOHANG | WNOWAIT) < 0)
+        return -1;
+    if (!info.si_pid)
+        return 0;
+
+    p = pid_map_get(&pid_index, info.si_pid);
+    if (p && info.si_code != CLD_STOPPED)
+        usage_read_process_io(&p->usage, info.si_pid);
+
+    if ((pid = wait4(info.si_pid, status, WUNTRACED | WNOHANG, &ru)) > 0 && p && !WIFSTOPPED(*status))
+        usage_end(&p->usage, &ru);
+
+    return pid;
+}
+
+/* Parse capacity of pipe from bytes with optional suffix K or M to *size. Return 0, if success. */
+static int parse_pipe_size(const char *value, long *size)
+{
+    char *end;
+    long bytes;
+
+    errno = 0;
+    bytes = strtol(value, &end, 10);
+    if (end == value || errno == ERANGE || bytes <= 0)
+        return -1;
+
+    /* Capacity of pipe is int for fcntl. */
+    if ((*end == 'K' || *end == 'k') && bytes <= INT_MAX / 1024)
+    {
+        bytes *= 1024;
+        end++;
+    }
+    else if ((*end == 'M' || *end == 'm') && bytes <= INT_MAX / (1024 * 1024))
+    {
+        bytes *= 1024 * 1024;
+        end++;
+    }
+    if (*end || bytes > INT_MAX)
+        return -1;
+
+    *size = bytes;
+    return 0;
+}
@@ -7,6 +7,12 @@
 #include <wait.h>
 #include "string.h"
 #include "cmds.h"
+#include "builtins.h"
+#include "ast.h"
+#include "usage.h"
+#include "perfstat.h"
+#include "meter.h"
+#include "fanout.h"
 
 #ifndef WAIT_ANY
 #    define WAIT_ANY -1
@@ -15,17 +21,29 @@
 typedef struct process
 {
     struct process *next;       /* next process in pipeline */
+    struct job *job;            /* job of process */
     char **argv;                /* for exec */
+    redirect *redirects;        /* redirections of process streams */
     pid_t pid;                  /* process ID */
     char completed;             /* true if process has completed */
     char stopped;               /* true if process has stopped */
+    char batch;                 /* true if process runs a batch of args of previous process */
+    const builtin *builtin;     /* builtin of command, found when job is filled, or NULL */
+    struct worker *worker;      /* thread of shell, which runs utility of process, or NULL */
     int status;                 /* reported status value */
+    proc_usage usage;           /* resources of process, they are known after completion */
+    perf_counters *perf;        /* counters of process of job with perfstat prefix, or NULL */
+    struct process *owner;      /* process, which gets pipe of this process substitution, or NULL for stage of pipeline */
+    const char *subst_arg;      /* word of substitution in argv of owner */
+    char subst_kind;            /* REDIR_IN for <(command), REDIR_OUT for >(command) */
+    int subst_fd;               /* end of pipe, which is kept for owner, or -1 */
 } process;
 
 /* A job is a pipeline of processes.  */
 typedef struct job
 {
     struct job *next;
+    int jid;                    /* index of job in job list */
     char have_pipe;             /* flag if job used pipeline */
     char *command;              /* command line, used for messages */
     process *first_process;     /* list of processes in this job */
@@ -33,13 +51,36 @@ typedef struct job
     char notified;              /* true if user told about stopped job */
     struct termios tmodes;      /* saved terminal modes */
     int stdin_file, stdout_file, stderr_file;  /* standart i/o channels */
+    arena *mem;                 /* memory of job, shared with parsed line */
+    int batch_in, batch_out;    /* streams for not launched batches, -1 if there aren't batches */
+    int outer_count;            /* count of processes, which aren't inner commands */
+    char timed;                 /* true if resources of job are reported after completion, like time prefix */
+    perf_totals *perf;          /* sums of counters of completed processes, if job has perfstat prefix, or NULL */
+    int trace_id;               /* id of job in trace, or 0 if job has no events yet */
+    char monitor_state;         /* state of job in the last record of monitor, or 0 */
+    int board_slot;             /* index of slot of job in board plus 1, or 0 */
+    pipe_meter *meters;         /* relays of pipes of pipeline, if meter or pipegrow option was set, or NULL */
+    char metered;               /* true if meters of pipes are reported after completion, like meter option */
+    char pipe_grow;             /* true if relays grow pipes, like pipegrow option or pipesize=auto prefix */
+    long pipe_size;             /* capacity of pipes from pipesize=bytes prefix, or 0 */
+    fanout *fanouts;            /* relays of commands with several targets of output, or NULL */
 } job;
 
 /* Clear job list. */
 void clear_job_list(int kill_jobs);
 
-/* Create job from command array from parsed line. */
-void fill_job(job** jobs, int ncmds);
+/* Publish changed state of job j to monitor and board. */
+void job_changed(job *j);
+
+/* Create processes of job from pipeline of parsed line.
+   Processes of substitutions follow all stages of pipeline. */
+void fill_job(job** jobs, pipeline *pl);
+
+/* Return the next stage of pipeline after process p, or NULL. Process substitutions aren't stages. */
+process *next_stage(process *p);
+
+/* Close ends of pipes of process substitutions, which are kept for owner p. */
+void close_substitutions(process *p);
 
 /* Get head of job list. */
 job *get_job_list_head();
@@ -53,8 +94,9 @@ job *find_job_jid(int index);
 /* Find the job with the indicated pgid. */
 job *find_job_pgid(pid_t pgid);
 
-/* Create job for foreground process. */
-job* create_new_job(pid_t pgid, char* name);
+/* Create job for foreground process in arena of parsed line.
+   name must be stored in mem. */
+job* create_new_job(pid_t pgid, char* name, arena *mem);
 
 /* Return true if all processes in the job have stopped or completed. */
 int job_is_stopped(job *jobs);
@@ -62,6 +104,15 @@ int job_is_stopped(job *jobs);
 /* Return true if all processes in the job have completed. */
 int job_is_completed(job *jobs);
 
+/* Return exit status of job by status of its last process. */
+int job_exit_status(job *jobs);
+
+/* Split args of process p, which are too long for exec, to batches.
+   Leading options of p are repeated in each batch.
+   Batches are added to job after p as new processes.
+   Return count of batches. */
+int split_arg_batches(job *jobs, process *p);
+
 /* Check job list on containing non inner commands. */
 int job_list_is_inner();
 
@@ -77,6 +128,15 @@ int add_job(job* jobs);
 /* Remove job from job list. Return success, if removed. */
 int remove_job(pid_t pgid);
 
+/* Record pid of launched process p of job.
+   The first process becomes the leader of process group of job. */
+void set_process_pid(job *jobs, process *p, pid_t pid);
+
+/* Send signal sig to processes of job: to its process group under job control,
+   or to each running process, which stays in group of the shell without it.
+   Return 0, if success. Or -1 with errno, if signal reached no process. */
+int signal_job(job *jobs, int sig);
+
 /* Free memory of job. */
 void free_job(job* jobs);
 
@@ -84,12 +144,18 @@ void free_job(job* jobs);
    Delete terminated jobs from the active job list. */
 void do_job_notification(int show_all);
 
-/* Used only for SIGCHLD. */
-void notify_child(int signum);
-
 /* Format information about job status for the user to look at. */
 void format_job_info(job *j, const char *status);
 
+/* Print resources of processes of job j and their sum to fd. */
+void print_job_usage(job *j, int fd);
+
+/* Print jobs with resources of their processes to fd. */
+void print_job_list_usage(int fd);
+
+/* Print reports of time and perfstat prefixes and meters of pipes of completed job j to its stderr. */
+void report_job(job *j);
+
 /* Check for processes that have status information available,
    without blocking. */
 void update_job_status();
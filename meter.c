@@ -0,0 +1,257 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include "meter.h"
+#include "stats.h"
+#include "workers.h"
+
+/* Body of relay thread. Move data of meter m until end of file or broken pipe. */
+static void *run_relay(void *arg);
+
+/* Wait for event of fd and add time of waiting to *stall, while *since shows its start.
+   Without stall only check fd without waiting. Return revents. */
+static short wait_fd(int fd, short events, atomic_ullong *stall, atomic_ullong *since);
+
+/* Return total stall with current waiting, which started at since. */
+static double stall_seconds(atomic_ullong *stall, atomic_ullong *since, unsigned long long now);
+
+/* Double capacity of pipes of meter m, which blocked on its reader. */
+static void grow_pipes(pipe_meter *m);
+
+/* Release meter m by one of its owners. The last one frees it. */
+static void release_meter(pipe_meter *m);
+
+/* Insert relay into pipe fds between stage edge and the next one and add its meter to list.
+   fds[0] is replaced by reading end of the new pipe, so the next stage reads from the relay.
+   New pipe gets capacity of size bytes, if it's positive. Relay grows pipes, if grow is true.
+   Return 0, if success. Or errno, then pipe is left as is. */
+int meter_pipe(pipe_meter **list, int edge, int fds[2], long size, int grow)
+{
+    int relay[2], err;
+    pthread_t thread;
+    pipe_meter *m = malloc(sizeof(pipe_meter));
+
+    if (!m)
+        return ENOMEM;
+    if (pipe2(relay, O_CLOEXEC) < 0)
+    {
+        err = errno;
+        free(m);
+        return err;
+    }
+
+    m->edge = edge;
+    m->in = fds[0];
+    m->out = relay[1];
+    m->grow = (char) grow;
+    if (size > 0)
+        set_pipe_size(m->out, size);
+    atomic_init(&m->capacity, fcntl(m->out, F_GETPIPE_SZ));
+    m->begin = monotonic_ns();
+    atomic_init(&m->end, 0);
+    atomic_init(&m->bytes, 0);
+    atomic_init(&m->starved, 0);
+    atomic_init(&m->blocked, 0);
+    atomic_init(&m->starved_since, 0);
+    atomic_init(&m->blocked_since, 0);
+    atomic_init(&m->refs, 2);
+
+    err = start_shell_thread(run_relay, m, &thread);
+
+    if (err)
+    {
+        close(relay[0]);
+        close(relay[1]);
+        free(m);
+        return err;
+    }
+
+    /* Relay ends itself, when stages close the pipes. */
+    pthread_detach(thread);
+    fds[0] = relay[0];
+    m->next = *list;
+    *list = m;
+
+    return 0;
+}
+
+/* Release meters of list by job. Meters of running relays are freed by their threads. */
+void release_meters(pipe_meter *list)
+{
+    pipe_meter *next;
+
+    for (; list; list = next)
+    {
+        next = list->next;
+        release_meter(list);
+    }
+}
+
+/* Set capacity of pipe fd to size bytes, but not more than PIPE_MAX_SIZE_FILE allows.
+   Return new capacity. Or -1 and errno. */
+long set_pipe_size(int fd, long size)
+{
+    static long max_size = 0;
+
+    /* Limit can be changed by administrator only, so it's read once. */
+    if (!max_size)
+    {
+        FILE *f = fopen(PIPE_MAX_SIZE_FILE, "re");
+
+        if (!f || fscanf(f, "%ld", &max_size) != 1 || max_size <= 0)
+            max_size = 1024 * 1024;
+        if (f)
+            fclose(f);
+    }
+
+    return fcntl(fd, F_SETPIPE_SZ, (int) (size < max_size ? size : max_size));
+}
+
+/* Wait up to METER_SETTLE_TIMEOUT until relays of list end, after stages of job completed. */
+void settle_meters(pipe_meter *list)
+{
+    struct timespec pause = {0, 100000};
+
+    /* Relays see end of file or broken pipe right after stages exit, so they end soon. */
+    for (int i = 0; i < METER_SETTLE_TIMEOUT * 10; ++i)
+    {
+        pipe_meter *m = list;
+
+        while (m && atomic_load(&m->end))
+            m = m->next;
+        if (!m)
+            return;
+        nanosleep(&pause, NULL);
+    }
+}
+
+/* Print bytes, throughput and stall times of each meter of list to fd. */
+void print_meters(int fd, pipe_meter *list)
+{
+    pipe_meter *m;
+    int count = 0;
+
+    for (m = list; m; m = m->next)
+        count++;
+
+    /* Meters are added to the head of list, so edges are printed from the last one. */
+    dprintf(fd, "%-8s %12s %10s %9s %9s %9s %9s\n", "pipe", "bytes", "MB/s", "time", "starved", "blocked", "capacity");
+    for (int edge = 1; count > 0; ++edge)
+        for (m = list; m; m = m->next)
+            if (m->edge == edge)
+            {
+                char name[32];
+                unsigned long long end = atomic_load(&m->end), now = end ? end : monotonic_ns();
+                double elapsed = (double) (now - m->begin) / 1e9;
+                double bytes = (double) atomic_load(&m->bytes);
+
+                /* Running relay is marked by star. */
+                snprintf(name, sizeof(name), "%d|%d%s", edge, edge + 1, end ? "" : "*");
+                dprintf(fd, "%-8s %12.0f %10.2f %9.3f %9.3f %9.3f %9ld\n", name, bytes,
+                        elapsed > 0 ? bytes / elapsed / 1e6 : 0.0, elapsed,
+                        stall_seconds(&m->starved, &m->starved_since, now),
+                        stall_seconds(&m->blocked, &m->blocked_since, now), atomic_load(&m->capacity));
+                count--;
+            }
+}
+
+/* Body of relay thread. Move data of meter m until end of file or broken pipe. */
+static void *run_relay(void *arg)
+{
+    pipe_meter *m = arg;
+    ssize_t n;
+
+    while (1)
+    {
+        n = splice(m->in, NULL, m->out, NULL, METER_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        if (n > 0)
+            atomic_fetch_add(&m->bytes, (unsigned long long) n);
+        /* Writer closed the pipe. */
+        else if (n == 0)
+            break;
+        else if (errno == EINTR)
+            continue;
+        else if (errno != EAGAIN)
+            break;
+        /* Readable input means that output is full, so the reader is the bottleneck. */
+        else if (wait_fd(m->in, POLLIN, NULL, NULL) & (POLLIN | POLLHUP))
+        {
+            if (wait_fd(m->out, POLLOUT, &m->blocked, &m->blocked_since) & POLLERR)
+                break;
+            if (m->grow)
+                grow_pipes(m);
+        }
+        else
+            wait_fd(m->in, POLLIN, &m->starved, &m->starved_since);
+    }
+
+    /* Closed ends give end of file to reader and broken pipe to writer. */
+    close(m->in);
+    close(m->out);
+    atomic_store(&m->end, monotonic_ns());
+    release_meter(m);
+
+    return NULL;
+}
+
+/* Wait for event of fd and add time of waiting to *stall, while *since shows its start.
+   Without stall only check fd without waiting. Return revents. */
+static short wait_fd(int fd, short events, atomic_ullong *stall, atomic_ullong *since)
+{
+    struct pollfd pfd = {fd, events, 0};
+    unsigned long long begin = stall ? monotonic_ns() : 0;
+
+    if (since)
+        atomic_store(since, begin);
+    while (poll(&pfd, 1, stall ? -1 : 0) < 0 && errno == EINTR);
+
+    /* Current waiting is ended before it's added to total, so readers never count it twice. */
+    if (since)
+        atomic_store(since, 0);
+    if (stall)
+        atomic_fetch_add(stall, monotonic_ns() - begin);
+
+    return pfd.revents;
+}
+
+/* Return total stall with current waiting, which started at since. */
+static double stall_seconds(atomic_ullong *stall, atomic_ullong *since, unsigned long long now)
+{
+    unsigned long long begin = atomic_load(since), total = atomic_load(stall);
+
+    /* Waiting, which ended between loads, may be in total already. */
+    if (begin && begin < now && atomic_load(since) == begin)
+        total += now - begin;
+
+    return (double) total / 1e9;
+}
+
+/* Double capacity of pipes of meter m, which blocked on its reader. */
+static void grow_pipes(pipe_meter *m)
+{
+    long capacity = atomic_load(&m->capacity), grown;
+
+    /* Pipe of writer grows too, so the writer keeps up with the reader. Limit of user stops growing. */
+    if (capacity <= 0 || (grown = set_pipe_size(m->out, capacity * 2)) <= capacity)
+    {
+        m->grow = 0;
+        return;
+    }
+    set_pipe_size(m->in, grown);
+    atomic_store(&m->capacity, grown);
+}
+
+/* Release meter m by one of its owners. The last one frees it. */
+static void release_meter(pipe_meter *m)
+{
+    if (atomic_fetch_sub(&m->refs, 1) == 1)
+        free(m);
+}
+
@@ -0,0 +1,48 @@
+#ifndef UNIX_SHELL_METER_H
+#define UNIX_SHELL_METER_H
+
+#include <stdatomic.h>
+
+#define METER_CHUNK          (64 * 1024) /* maximal bytes, moved by one splice */
+#define METER_SETTLE_TIMEOUT 10          /* milliseconds to wait for relays of completed job */
+#define PIPE_MAX_SIZE_FILE   "/proc/sys/fs/pipe-max-size"
+
+/* Relay of metered pipe between two stages of pipeline. Thread of shell moves data
+   from the pipe of writer to the pipe of reader with splice, so data isn't copied to the shell. */
+typedef struct pipe_meter
+{
+    struct pipe_meter *next;        /* next meter of job */
+    int edge;                       /* index of writing stage in pipeline, starting from 1 */
+    int in, out;                    /* end of writer's pipe and end of reader's pipe, owned by thread */
+    char grow;                      /* true if relay doubles capacity of pipes, when reader blocks it */
+    atomic_long capacity;           /* capacity of pipes of relay in bytes */
+    unsigned long long begin;       /* monotonic nanoseconds of relay start */
+    atomic_ullong end;              /* monotonic nanoseconds of relay end, or 0 while data flows */
+    atomic_ullong bytes;            /* count of passed bytes */
+    atomic_ullong starved;          /* nanoseconds of waiting for data of writer */
+    atomic_ullong blocked;          /* nanoseconds of waiting for reader to take data, backpressure */
+    atomic_ullong starved_since;    /* monotonic nanoseconds of start of current waiting for writer, or 0 */
+    atomic_ullong blocked_since;    /* monotonic nanoseconds of start of current waiting for reader, or 0 */
+    atomic_int refs;                /* count of owners: job and thread */
+} pipe_meter;
+
+/* Insert relay into pipe fds between stage edge and the next one and add its meter to list.
+   fds[0] is replaced by reading end of the new pipe, so the next stage reads from the relay.
+   New pipe gets capacity of size bytes, if it's positive. Relay grows pipes, if grow is true.
+   Return 0, if success. Or errno, then pipe is left as is. */
+int meter_pipe(pipe_meter **list, int edge, int fds[2], long size, int grow);
+
+/* Set capacity of pipe fd to size bytes, but not more than PIPE_MAX_SIZE_FILE allows.
+   Return new capacity. Or -1 and errno. */
+long set_pipe_size(int fd, long size);
+
+/* Release meters of list by job. Meters of running relays are freed by their threads. */
+void release_meters(pipe_meter *list);
+
+/* Wait up to METER_SETTLE_TIMEOUT until relays of list end, after stages of job completed. */
+void settle_meters(pipe_meter *list);
+
+/* Print bytes, throughput and stall times of each meter of list to fd. */
+void print_meters(int fd, pipe_meter *list);
+
+#endif
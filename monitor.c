@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "monitor.h"
+#include "spool.h"
+
+#define STATE_RUNNING   'r' /* state of job with running processes */
+#define STATE_STOPPED   's' /* state of job with stopped and completed processes */
+#define STATE_COMPLETED 'c' /* state of job with completed processes only */
+
+static spool *records = NULL; /* records of active monitor, or NULL */
+
+/* Return the last command of job j, which isn't a batch of args of previous one or a process substitution. */
+static process *last_command(job *j);
+
+/* Start streaming of state changes of jobs to fd as JSON lines instead of previous monitor.
+   Monitor owns fd, if success. Records are written by separate thread, so a slow reader never stalls reaping.
+   Return 0, if success. Or errno. */
+int monitor_start(int fd)
+{
+    monitor_stop();
+    return spool_open(&records, fd, MONITOR_BUFFER_SIZE);
+}
+
+/* Connect to unix stream socket path. Return its descriptor. Or -1 and errno. */
+int monitor_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd, err;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+        return -1;
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+    {
+        err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Stop monitor and close its fd. */
+void monitor_stop()
+{
+    spool_close(records);
+    records = NULL;
+}
+
+/* Send record about job j, if its state changed since the last record: started, stopped, continued,
+   completed or signaled. It's called after flags of processes of j are changed. */
+void monitor_job(job *j)
+{
+    char record[MONITOR_RECORD_SIZE], command[MONITOR_RECORD_SIZE / 2];
+    const char *event;
+    char state;
+    int len, status = 0, signal = 0;
+    struct timespec now, mono;
+    process *p;
+
+    if (!records || !j || j->monitor_state == STATE_COMPLETED)
+        return;
+
+    if (job_is_completed(j))
+    {
+        state = STATE_COMPLETED;
+        status = job_exit_status(j);
+        p = last_command(j);
+        event = p && WIFSIGNALED(p->status) ? "signaled" : "completed";
+        if (p && WIFSIGNALED(p->status))
+            signal = WTERMSIG(p->status);
+    }
+    else if (job_is_stopped(j))
+    {
+        state = STATE_STOPPED;
+        event = "stopped";
+        for (p = j->first_process; p; p = p->next)
+            if (p->stopped && !p->completed && WIFSTOPPED(p->status))
+                signal = WSTOPSIG(p->status);
+    }
+    else
+    {
+        state = STATE_RUNNING;
+        event = j->monitor_state == STATE_STOPPED ? "continued" : "started";
+    }
+
+    if (state == j->monitor_state)
+        return;
+    j->monitor_state = state;
+
+    /* Wall clock time is for the reader, elapsed time is counted from start of the first process. */
+    clock_gettime(CLOCK_REALTIME, &now);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    unsigned long long begin = j->first_process ? j->first_process->usage.begin : 0;
+    unsigned long long elapsed = (unsigned long long) mono.tv_sec * 1000000000ULL + (unsigned long long) mono.tv_nsec;
+    elapsed = begin && elapsed > begin ? elapsed - begin : 0;
+
+    len = snprintf(record, sizeof(record),
+                   "{\"event\":\"%s\",\"job\":%d,\"pgid\":%d,\"status\":%d,\"signal\":%d,"
+                   "\"time\":%lld.%06ld,\"elapsed\":%llu.%06llu,\"command\":\"%s\"}\n",
+                   event, j->jid, (int) j->pgid, status, signal, (long long) now.tv_sec, now.tv_nsec / 1000,
+                   elapsed / 1000000000ULL, elapsed % 1000000000ULL / 1000,
+                   json_escape(command, sizeof(command), j->command));
+
+    /* Command is cut to fit, so record is never longer than MONITOR_RECORD_SIZE. */
+    if (len > 0 && (size_t) len < sizeof(record))
+        spool_write(records, record, (size_t) len);
+}
+
+/* Print state of monitor to fd. */
+void print_monitor_state(int fd)
+{
+    unsigned long long written, dropped;
+
+    if (!records)
+        dprintf(fd, "monitor off\n");
+    else
+    {
+        written = spool_counts(records, &dropped);
+        dprintf(fd, "monitor on: %llu records, %llu dropped\n", written, dropped);
+    }
+}
+
+/* Return the last command of job j, which isn't a batch of args of previous one or a process substitution. */
+static process *last_command(job *j)
+{
+    process *last = NULL;
+
+    for (process *p = j->first_process; p && !p->owner; p = p->next)
+        if (!p->batch)
+            last = p;
+
+    return last;
+}
@@ -0,0 +1,27 @@
+#ifndef UNIX_SHELL_MONITOR_H
+#define UNIX_SHELL_MONITOR_H
+
+#include "jobs.h"
+
+#define MONITOR_BUFFER_SIZE (64 * 1024) /* bytes of records, which wait for writing, power of 2 */
+#define MONITOR_RECORD_SIZE 1024        /* maximal size of one record */
+
+/* Start streaming of state changes of jobs to fd as JSON lines instead of previous monitor.
+   Monitor owns fd, if success. Records are written by separate thread, so a slow reader never stalls reaping.
+   Return 0, if success. Or errno. */
+int monitor_start(int fd);
+
+/* Connect to unix stream socket path. Return its descriptor. Or -1 and errno. */
+int monitor_connect(const char *path);
+
+/* Stop monitor and close its fd. */
+void monitor_stop();
+
+/* Send record about job j, if its state changed since the last record: started, stopped, continued,
+   completed or signaled. It's called after flags of processes of j are changed. */
+void monitor_job(job *j);
+
+/* Print state of monitor to fd. */
+void print_monitor_state(int fd);
+
+#endif
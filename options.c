@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include "options.h"
+
+typedef struct shell_option
+{
+    const char *name;   /* name of option for set builtin and -o flag */
+    long value;         /* current value of option */
+} shell_option;
+
+/* Table of shell options with default values. */
+static shell_option options[OPT_COUNT] = {
+        {"spawn", 1},
+        {"argbatch", 0},
+        {"noexec", 0},
+        {"parsecache", 256},
+        {"stats", 1},
+        {"board", 0},
+        {"meter", 0},
+        {"pipesize", 0},
+        {"pipegrow", 0}
+};
+
+/* Get value of shell option. */
+long get_option(int opt)
+{
+    assert(opt >= 0 && opt < OPT_COUNT);
+    return options[opt].value;
+}
+
+/* Set shell option from string "name" or "name=value".
+   If enable = 0, option will be reset to 0.
+   Return 0, if option was set. Or -1, if option is unknown or value is invalid. */
+int set_option(const char *arg, int enable)
+{
+    assert(arg != NULL);
+
+    const char *value = strchr(arg, '=');
+    size_t len = value ? (size_t) (value - arg) : strlen(arg);
+
+    for (int i = 0; i < OPT_COUNT; ++i)
+    {
+        if (strlen(options[i].name) != len || strncmp(options[i].name, arg, len) != 0)
+            continue;
+
+        if (!enable)
+            options[i].value = 0;
+        else if (!value)
+            options[i].value = 1;
+        else
+        {
+            char *end;
+            errno = 0;
+            long val = strtol(value + 1, &end, 0);
+
+            /* Check is the parsed value correct. */
+            if (errno == ERANGE || end == value + 1 || *end != '\0')
+                return -1;
+            options[i].value = val;
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
+/* Print all shell options to fd. */
+void print_options(int fd)
+{
+    for (int i = 0; i < OPT_COUNT; ++i)
+        dprintf(fd, "%-16s %ld\n", options[i].name, options[i].value);
+}
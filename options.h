@@ -0,0 +1,27 @@
+#ifndef UNIX_SHELL_OPTIONS_H
+#define UNIX_SHELL_OPTIONS_H
+
+/* Indexes of shell options. */
+#define OPT_SPAWN      0 /* launch processes with posix_spawn instead of fork */
+#define OPT_ARGBATCH   1 /* split too long argv to batches, value is count of parallel batches */
+#define OPT_NOEXEC     2 /* read and parse commands without executing them */
+#define OPT_PARSECACHE 3 /* count of parsed lines in cache, 0 disables cache */
+#define OPT_STATS      4 /* record latency histograms of phases of the shell for stats builtin */
+#define OPT_BOARD      5 /* publish job table to shared memory board for jobboard tool */
+#define OPT_METER      6 /* connect stages of pipelines through relays, which measure throughput of pipes */
+#define OPT_PIPESIZE   7 /* capacity of pipes of pipelines in bytes, 0 keeps default of kernel */
+#define OPT_PIPEGROW   8 /* grow pipes of pipelines through relays, when readers block writers */
+#define OPT_COUNT      9 /* count of shell options */
+
+/* Get value of shell option. */
+long get_option(int opt);
+
+/* Set shell option from string "name" or "name=value".
+   If enable = 0, option will be reset to 0.
+   Return 0, if option was set. Or -1, if option is unknown or value is invalid. */
+int set_option(const char *arg, int enable);
+
+/* Print all shell options to fd. */
+void print_options(int fd);
+
+#endif
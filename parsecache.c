@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "parsecache.h"
+#include "promptline.h"
+#include "options.h"
+
+typedef struct cache_entry
+{
+    struct cache_entry *chain;  /* next entry in bucket */
+    struct cache_entry *prev;   /* more recently used entry */
+    struct cache_entry *next;   /* less recently used entry */
+    uint64_t hash;              /* hash of line */
+    size_t len;                 /* length of line */
+    const char *line;           /* copy of line in arena of list */
+    cmd_list *list;             /* parsed line, it's never changed */
+} cache_entry;
+
+static cache_entry *buckets[PARSE_CACHE_BUCKETS]; /* hash table of lines */
+static cache_entry *lru_head = NULL;  /* the most recently used entry */
+static cache_entry *lru_tail = NULL;  /* the least recently used entry */
+static long count = 0;                /* count of cached lines */
+static unsigned long hits = 0;        /* count of lines found in cache */
+static unsigned long misses = 0;      /* count of parsed lines */
+static unsigned long evictions = 0;   /* count of lines removed for new ones */
+
+/* Hash of line of len symbols. */
+static uint64_t hash_line(const char *line, size_t len);
+
+/* Find entry of line. Return NULL, if line isn't cached. */
+static cache_entry *find_entry(uint64_t hash, const char *line, size_t len);
+
+/* Move entry e to head of LRU list. */
+static void touch_entry(cache_entry *e);
+
+/* Remove entry e from cache and free it. */
+static void remove_entry(cache_entry *e);
+
+/* Add parsed list of line to cache. Its arena is owned by cache after that.
+   Return 0, if success. */
+static int add_entry(uint64_t hash, const char *line, size_t len, cmd_list *list);
+
+/* Make list for execution from cached template. Return NULL, if failed. */
+static cmd_list *instantiate(const cmd_list *tmpl);
+
+/* Parse line of len symbols with cache of recently parsed lines.
+   Cached lines aren't tokenized again, only their $ and % expansions are repeated.
+   Return list in new arena, which caller releases. Or NULL, if was syntax error.
+   line must be non null. */
+cmd_list *cached_parse_line(const char *line, size_t len)
+{
+    assert(line != NULL);
+
+    long capacity = get_option(OPT_PARSECACHE);
+    uint64_t hash;
+    cache_entry *e;
+    cmd_list *list;
+
+    /* Shrink cache, if its option was decreased. */
+    while (count > 0 && count > capacity)
+    {
+        remove_entry(lru_tail);
+        evictions++;
+    }
+
+    if (capacity <= 0)
+        return parse_line(line, len);
+
+    hash = hash_line(line, len);
+    if ((e = find_entry(hash, line, len)))
+    {
+        hits++;
+        touch_entry(e);
+        return instantiate(e->list);
+    }
+
+    misses++;
+    if (!(list = parse_line(line, len)))
+        return NULL;
+
+    /* The least recently used line gives place for new one. */
+    if (count >= capacity)
+    {
+        remove_entry(lru_tail);
+        evictions++;
+    }
+
+    /* Cache can't keep line, so it's executed as usual. */
+    if (add_entry(hash, line, len, list))
+        return list;
+
+    return instantiate(list);
+}
+
+/* Remove all lines from cache and reset its counters. */
+void clear_parse_cache()
+{
+    while (lru_head)
+        remove_entry(lru_head);
+    hits = misses = evictions = 0;
+}
+
+/* Print size and counters of cache to fd. */
+void print_parse_cache(int fd)
+{
+    dprintf(fd, "entries    %ld/%ld\n", count, get_option(OPT_PARSECACHE));
+    dprintf(fd, "hits       %lu\n", hits);
+    dprintf(fd, "misses     %lu\n", misses);
+    dprintf(fd, "evictions  %lu\n", evictions);
+}
+
+/* Hash of line of len symbols. */
+static uint64_t hash_line(const char *line, size_t len)
+{
+    /* FNV-1a by 8 bytes, so long lines are hashed faster than by bytes. */
+    uint64_t h = 14695981039346656037ULL ^ len, chunk;
+    size_t i;
+
+    for (i = 0; i + sizeof(chunk) <= len; i += sizeof(chunk))
+    {
+        memcpy(&chunk, line + i, sizeof(chunk));
+        h = (h ^ chunk) * 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    for (; i < len; ++i)
+        h = (h ^ (unsigned char) line[i]) * 1099511628211ULL;
+
+    return h ^ (h >> 32);
+}
+
+/* Find entry of line. Return NULL, if line isn't cached. */
+static cache_entry *find_entry(uint64_t hash, const char *line, size_t len)
+{
+    cache_entry *e;
+
+    for (e = buckets[hash % PARSE_CACHE_BUCKETS]; e; e = e->chain)
+        if (e->hash == hash && e->len == len && !memcmp(e->line, line, len))
+            return e;
+    return NULL;
+}
+
+/* Move entry e to head of LRU list. */
+static void touch_entry(cache_entry *e)
+{
+    if (e == lru_head)
+        return;
+
+    /* Unlink entry. */
+    e->prev->next = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        lru_tail = e->prev;
+
+    /* Insert it before head. */
+    e->prev = NULL;
+    e->next = lru_head;
+    lru_head->prev = e;
+    lru_head = e;
+}
+
+/* Remove entry e from cache and free it. */
+static void remove_entry(cache_entry *e)
+{
+    cache_entry **link;
+
+    for (link = &buckets[e->hash % PARSE_CACHE_BUCKETS]; *link != e; link = &(*link)->chain);
+    *link = e->chain;
+
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        lru_head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        lru_tail = e->prev;
+
+    /* Running jobs of line keep its arena by their own arenas. */
+    arena_release(e->list->mem);
+    free(e);
+    count--;
+}
+
+/* Add parsed list of line to cache. Its arena is owned by cache after that.
+   Return 0, if success. */
+static int add_entry(uint64_t hash, const char *line, size_t len, cmd_list *list)
+{
+    cache_entry *e = malloc(sizeof(cache_entry));
+
+    if (!e || !(e->line = arena_strndup(list->mem, line, len)))
+    {
+        free(e);
+        return -1;
+    }
+
+    e->hash = hash;
+    e->len = len;
+    e->list = list;
+
+    e->chain = buckets[hash % PARSE_CACHE_BUCKETS];
+    buckets[hash % PARSE_CACHE_BUCKETS] = e;
+
+    e->prev = NULL;
+    e->next = lru_head;
+    if (lru_head)
+        lru_head->prev = e;
+    else
+        lru_tail = e;
+    lru_head = e;
+    count++;
+
+    return 0;
+}
+
+/* Make list for execution from cached template. Return NULL, if failed. */
+static cmd_list *instantiate(const cmd_list *tmpl)
+{
+    cmd_list *list;
+    arena *mem;
+
+    /* Jobs are allocated in own arena, so cached one doesn't grow. */
+    if (!(mem = arena_create(0)))
+    {
+        perror("malloc");
+        return NULL;
+    }
+    arena_set_parent(mem, tmpl->mem);
+
+    if (!(list = expand_list(tmpl, mem)))
+        arena_release(mem);
+
+    return list;
+}
@@ -0,0 +1,21 @@
+#ifndef UNIX_SHELL_PARSECACHE_H
+#define UNIX_SHELL_PARSECACHE_H
+
+#include <stddef.h>
+#include "ast.h"
+
+#define PARSE_CACHE_BUCKETS 1024 /* count of buckets in hash table of lines */
+
+/* Parse line of len symbols with cache of recently parsed lines.
+   Cached lines aren't tokenized again, only their $ and % expansions are repeated.
+   Return list in new arena, which caller releases. Or NULL, if was syntax error.
+   line must be non null. */
+cmd_list *cached_parse_line(const char *line, size_t len);
+
+/* Remove all lines from cache and reset its counters. */
+void clear_parse_cache();
+
+/* Print size and counters of cache to fd. */
+void print_parse_cache(int fd);
+
+#endif
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include "pathcache.h"
+
+typedef struct path_entry
+{
+    struct path_entry *next; /* next entry in bucket */
+    char *name;              /* name of command */
+    char *path;              /* found path of command, NULL if not found */
+    unsigned long hits;      /* count of lookups */
+    time_t found_time;       /* time of search */
+} path_entry;
+
+typedef struct path_dir
+{
+    char *name;              /* directory from PATH */
+    struct timespec mtime;   /* modification time at moment of check */
+} path_dir;
+
+static path_entry *buckets[PATH_CACHE_BUCKETS]; /* hash table of commands */
+static char *saved_path = NULL;      /* value of PATH, for which cache was filled */
+static path_dir *dirs = NULL;        /* directories of saved_path */
+static size_t ndirs = 0;             /* count of dirs */
+static time_t last_check = 0;        /* time of last check of directories */
+
+/* Get seconds of monotonic clock. */
+static time_t now();
+
+/* Hash of command name. */
+static unsigned hash_name(const char *name);
+
+/* Drop cache, if PATH or any of its directories were changed. */
+static void validate_cache();
+
+/* Split PATH value to dirs and save their mtime. */
+static void load_dirs(const char *path);
+
+/* Free dirs. */
+static void free_dirs();
+
+/* Search command in dirs. Return allocated path or NULL. */
+static char *search_path(const char *name);
+
+/* Find path of command name in PATH directories with cache.
+   Return path or NULL, if command wasn't found.
+   Names with '/' are returned as is.
+   name must be non null. */
+const char *find_command_path(const char *name)
+{
+    assert(name != NULL);
+
+    if (strchr(name, '/'))
+        return name;
+
+    validate_cache();
+
+    unsigned h = hash_name(name);
+    path_entry *e;
+
+    for (e = buckets[h]; e; e = e->next)
+        if (!strcmp(e->name, name))
+            break;
+
+    /* Forget old misses, command may be installed already. */
+    if (e && !e->path && now() - e->found_time >= PATH_MISS_TTL)
+    {
+        e->path = search_path(name);
+        e->found_time = now();
+    }
+
+    if (!e)
+    {
+        e = malloc(sizeof(path_entry));
+        if (!e || !(e->name = strdup(name)))
+        {
+            perror("malloc");
+            free(e);
+            return NULL;
+        }
+
+        e->path = search_path(name);
+        e->hits = 0;
+        e->found_time = now();
+        e->next = buckets[h];
+        buckets[h] = e;
+    }
+
+    e->hits++;
+    return e->path;
+}
+
+/* Remove command name from cache. Return 1, if removed. */
+int forget_command_path(const char *name)
+{
+    assert(name != NULL);
+
+    path_entry **e = &buckets[hash_name(name)];
+
+    for (; *e; e = &(*e)->next)
+        if (!strcmp((*e)->name, name))
+        {
+            path_entry *old = *e;
+            *e = old->next;
+            free(old->name);
+            free(old->path);
+            free(old);
+            return 1;
+        }
+
+    return 0;
+}
+
+/* Remove all commands from cache. */
+void clear_path_cache()
+{
+    path_entry *e, *next;
+
+    for (int i = 0; i < PATH_CACHE_BUCKETS; ++i)
+    {
+        for (e = buckets[i]; e; e = next)
+        {
+            next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+        }
+        buckets[i] = NULL;
+    }
+
+    free_dirs();
+}
+
+/* Print cached commands and count of hits to fd. */
+void print_path_cache(int fd)
+{
+    path_entry *e;
+
+    dprintf(fd, "hits\tcommand\n");
+    for (int i = 0; i < PATH_CACHE_BUCKETS; ++i)
+        for (e = buckets[i]; e; e = e->next)
+            dprintf(fd, "%4lu\t%s\n", e->hits, e->path ? e->path : e->name);
+}
+
+/* Get seconds of monotonic clock. */
+static time_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/* Hash of command name. */
+static unsigned hash_name(const char *name)
+{
+    /* FNV-1a. */
+    unsigned h = 2166136261u;
+    while (*name)
+        h = (h ^ (unsigned char) *name++) * 16777619u;
+
+    return h % PATH_CACHE_BUCKETS;
+}
+
+/* Drop cache, if PATH or any of its directories were changed. */
+static void validate_cache()
+{
+    const char *path = getenv("PATH");
+    struct stat st;
+
+    if (!path)
+        path = "/bin:/usr/bin";
+
+    if (!saved_path || strcmp(saved_path, path) != 0)
+    {
+        clear_path_cache();
+        load_dirs(path);
+        last_check = now();
+        return;
+    }
+
+    if (now() - last_check < PATH_CHECK_PERIOD)
+        return;
+    last_check = now();
+
+    for (size_t i = 0; i < ndirs; ++i)
+    {
+        if (stat(dirs[i].name, &st) != 0)
+            st.st_mtim.tv_sec = st.st_mtim.tv_nsec = 0;
+
+        if (st.st_mtim.tv_sec != dirs[i].mtime.tv_sec || st.st_mtim.tv_nsec != dirs[i].mtime.tv_nsec)
+        {
+            clear_path_cache();
+            load_dirs(path);
+            return;
+        }
+    }
+}
+
+/* Split PATH value to dirs and save their mtime. */
+static void load_dirs(const char *path)
+{
+    struct stat st;
+    size_t count = 1;
+
+    for (const char *c = path; *c; ++c)
+        if (*c == ':')
+            count++;
+
+    if (!(saved_path = strdup(path)) || !(dirs = malloc(count * sizeof(path_dir))))
+    {
+        perror("malloc");
+        free_dirs();
+        return;
+    }
+
+    /* Split copy of PATH in place. Empty entry means current directory. */
+    char *begin = saved_path, *end;
+    ndirs = 0;
+    while (1)
+    {
+        end = strchr(begin, ':');
+        size_t len = end ? (size_t) (end - begin) : strlen(begin);
+
+        if (!(dirs[ndirs].name = len ? strndup(begin, len) : strdup(".")))
+        {
+            perror("malloc");
+            free_dirs();
+            return;
+        }
+
+        if (stat(dirs[ndirs].name, &st) != 0)
+            st.st_mtim.tv_sec = st.st_mtim.tv_nsec = 0;
+        dirs[ndirs++].mtime = st.st_mtim;
+
+        if (!end)
+            break;
+        begin = end + 1;
+    }
+}
+
+/* Free dirs. */
+static void free_dirs()
+{
+    for (size_t i = 0; i < ndirs; ++i)
+        free(dirs[i].name);
+
+    free(dirs);
+    free(saved_path);
+    dirs = NULL;
+    saved_path = NULL;
+    ndirs = 0;
+}
+
+/* Search command in dirs. Return allocated path or NULL. */
+static char *search_path(const char *name)
+{
+    struct stat st;
+    size_t name_len = strlen(name);
+
+    for (size_t i = 0; i < ndirs; ++i)
+    {
+        size_t dir_len = strlen(dirs[i].name);
+        char *path = malloc(dir_len + name_len + 2);
+
+        if (!path)
+        {
+            perror("malloc");
+            return NULL;
+        }
+
+        memcpy(path, dirs[i].name, dir_len);
+        path[dir_len] = '/';
+        memcpy(path + dir_len + 1, name, name_len + 1);
+
+        if (!stat(path, &st) && S_ISREG(st.st_mode) && !access(path, X_OK))
+            return path;
+
+        free(path);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef UNIX_SHELL_PATHCACHE_H
+#define UNIX_SHELL_PATHCACHE_H
+
+#define PATH_CACHE_BUCKETS 256 /* count of buckets in hash table of commands */
+#define PATH_MISS_TTL      2   /* seconds to remember commands, which weren't found */
+#define PATH_CHECK_PERIOD  1   /* seconds between checks of PATH directories mtime */
+
+/* Find path of command name in PATH directories with cache.
+   Return path or NULL, if command wasn't found.
+   Names with '/' are returned as is.
+   name must be non null. */
+const char *find_command_path(const char *name);
+
+/* Remove command name from cache. Return 1, if removed. */
+int forget_command_path(const char *name);
+
+/* Remove all commands from cache. */
+void clear_path_cache();
+
+/* Print cached commands and count of hits to fd. */
+void print_path_cache(int fd);
+
+#endif
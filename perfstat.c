@@ -0,0 +1,169 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfstat.h"
+
+#define PERF_HARDWARE_COUNT 4 /* count of hardware events in the beginning of events */
+
+/* Availability of hardware counters or kernel mode counting, checked by the first open. */
+#define PERF_UNKNOWN     0
+#define PERF_ALLOWED     1
+#define PERF_FORBIDDEN   2
+
+/* Event of counters. */
+typedef struct perf_event
+{
+    unsigned type;      /* PERF_TYPE_HARDWARE or PERF_TYPE_SOFTWARE */
+    unsigned config;    /* event of type */
+    const char *name;   /* name of event like in perf stat */
+} perf_event;
+
+static const perf_event events[PERF_EVENT_COUNT] =
+{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     "instructions"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,     "cache-misses"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,    "branch-misses"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,       "task-clock"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,      "page-faults"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,   "cpu-migrations"}
+};
+
+static int hardware = PERF_UNKNOWN; /* availability of hardware events */
+static int kernel = PERF_UNKNOWN;   /* availability of counting in kernel mode, perf_event_paranoid may forbid it */
+
+/* Open counter of event e for pid. Return descriptor or -1. */
+static int open_event(const perf_event *e, pid_t pid, int enable_on_exec, int exclude_kernel);
+
+/* Mark all counters of c as not opened. */
+void perf_clear(perf_counters *c)
+{
+    assert(c != NULL);
+
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+        c->fds[i] = -1;
+}
+
+/* Open counters of process or thread pid with inheritance by its children. pid 0 is the calling thread.
+   Counting starts after exec of pid, if enable_on_exec is true, or at once otherwise.
+   Hardware events are skipped, if they aren't supported, for example in containers.
+   Return count of opened events. */
+int perf_open(perf_counters *c, pid_t pid, int enable_on_exec)
+{
+    assert(c != NULL);
+
+    int count = 0;
+
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+    {
+        c->fds[i] = -1;
+
+        /* Failed hardware event isn't tried for next processes. */
+        if (i < PERF_HARDWARE_COUNT && hardware == PERF_FORBIDDEN)
+            continue;
+
+        if ((c->fds[i] = open_event(&events[i], pid, enable_on_exec, kernel == PERF_FORBIDDEN)) == -1
+            && (errno == EACCES || errno == EPERM) && kernel == PERF_UNKNOWN)
+        {
+            /* Unprivileged user may count only user mode. */
+            kernel = PERF_FORBIDDEN;
+            c->fds[i] = open_event(&events[i], pid, enable_on_exec, 1);
+        }
+        if (c->fds[i] != -1 && kernel == PERF_UNKNOWN)
+            kernel = PERF_ALLOWED;
+
+        if (i < PERF_HARDWARE_COUNT && hardware == PERF_UNKNOWN)
+            hardware = c->fds[i] == -1 ? PERF_FORBIDDEN : PERF_ALLOWED;
+
+        count += c->fds[i] != -1;
+    }
+
+    return count;
+}
+
+/* Read counters of c, add them to t and close them. Counters are only closed, if t is NULL. */
+void perf_collect(perf_counters *c, perf_totals *t)
+{
+    assert(c != NULL);
+
+    /* Value, time enabled and time running of counter. */
+    unsigned long long data[3];
+    int counted = 0;
+
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+    {
+        if (c->fds[i] == -1)
+            continue;
+
+        if (t && read(c->fds[i], data, sizeof(data)) == sizeof(data))
+        {
+            /* Multiplexed counter is scaled to the whole time. */
+            if (data[2] && data[2] < data[1])
+                data[0] = (unsigned long long) ((double) data[0] * (double) data[1] / (double) data[2]);
+            t->values[i] += data[0];
+            t->counted |= 1u << i;
+            counted = 1;
+        }
+        close(c->fds[i]);
+        c->fds[i] = -1;
+    }
+
+    if (counted)
+        t->tasks++;
+}
+
+/* Add sums of src to t. */
+void perf_add(perf_totals *t, const perf_totals *src)
+{
+    assert(t != NULL);
+    assert(src != NULL);
+
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+        t->values[i] += src->values[i];
+    t->counted |= src->counted;
+    t->tasks += src->tasks;
+}
+
+/* Print sums of t for job command to fd like perf stat. */
+void print_perf_totals(int fd, const perf_totals *t, const char *command)
+{
+    assert(t != NULL);
+
+    dprintf(fd, "perfstat of %d tasks: %s\n", t->tasks, command ? command : "");
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+        if (!(t->counted & (1u << i)))
+            dprintf(fd, "%18s  %s\n", "<not counted>", events[i].name);
+        else if (events[i].type == PERF_TYPE_SOFTWARE && events[i].config == PERF_COUNT_SW_TASK_CLOCK)
+            dprintf(fd, "%18.3f  %s (msec)\n", (double) t->values[i] / 1e6, events[i].name);
+        else
+            dprintf(fd, "%18llu  %s\n", t->values[i], events[i].name);
+
+    /* Instructions per cycle show, whether stages wait for memory. */
+    if ((t->counted & 3u) == 3u && t->values[0])
+        dprintf(fd, "%18.2f  insn per cycle\n", (double) t->values[1] / (double) t->values[0]);
+}
+
+/* Open counter of event e for pid. Return descriptor or -1. */
+static int open_event(const perf_event *e, pid_t pid, int enable_on_exec, int exclude_kernel)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = e->type;
+    attr.config = e->config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = exclude_kernel ? 1 : 0;
+    attr.disabled = enable_on_exec ? 1 : 0;
+    attr.enable_on_exec = enable_on_exec ? 1 : 0;
+
+    return (int) syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
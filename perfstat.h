@@ -0,0 +1,40 @@
+#ifndef UNIX_SHELL_PERFSTAT_H
+#define UNIX_SHELL_PERFSTAT_H
+
+#include <sys/types.h>
+
+#define PERF_EVENT_COUNT 8 /* count of counted events: hardware events at first, then software ones */
+
+/* Opened counters of process or thread. Descriptors of events, which weren't opened, are -1. */
+typedef struct perf_counters
+{
+    int fds[PERF_EVENT_COUNT];
+} perf_counters;
+
+/* Sum of counters of job. */
+typedef struct perf_totals
+{
+    unsigned long long values[PERF_EVENT_COUNT];  /* sums of counted events */
+    unsigned counted;                               /* bits of events, which were counted at least once */
+    int tasks;                                      /* count of summed processes and threads */
+} perf_totals;
+
+/* Mark all counters of c as not opened. */
+void perf_clear(perf_counters *c);
+
+/* Open counters of process or thread pid with inheritance by its children. pid 0 is the calling thread.
+   Counting starts after exec of pid, if enable_on_exec is true, or at once otherwise.
+   Hardware events are skipped, if they aren't supported, for example in containers.
+   Return count of opened events. */
+int perf_open(perf_counters *c, pid_t pid, int enable_on_exec);
+
+/* Read counters of c, add them to t and close them. Counters are only closed, if t is NULL. */
+void perf_collect(perf_counters *c, perf_totals *t);
+
+/* Add sums of src to t. */
+void perf_add(perf_totals *t, const perf_totals *src);
+
+/* Print sums of t for job command to fd like perf stat. */
+void print_perf_totals(int fd, const perf_totals *t, const char *command);
+
+#endif
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <assert.h>
+#include "plugins.h"
+#include "workers.h"
+
+/* Builtin, loaded from shared object. */
+typedef struct plugin
+{
+    builtin entry;              /* entry of registry, it must be the first member */
+    struct plugin *next;        /* next loaded builtin */
+    const shell_builtin *def;   /* builtin of shared object */
+    const builtin *replaced;    /* builtin, which was registered with the same name before loading */
+    void *handle;               /* handle of shared object */
+    char *path;                 /* path of shared object */
+} plugin;
+
+static plugin *plugins = NULL; /* list of loaded builtins */
+
+/* Find loaded builtin name. Return link to it in the list of loaded builtins, or NULL. */
+static plugin **find_plugin(const char *name);
+
+/* Remove plugin p from registry, restore replaced builtin and free p. */
+static void free_plugin(plugin *p);
+
+/* Load builtin name from shared object path and register it. It replaces builtin with the same name.
+   Print error and return -1, if object or its builtin can't be loaded. Or return 0. */
+int load_plugin(const char *path, const char *name)
+{
+    assert(path != NULL);
+    assert(name != NULL);
+
+    const builtin *replaced = find_builtin(name);
+    const shell_builtin *def;
+    plugin *p;
+    void *handle;
+    char *symbol;
+
+    if (find_plugin(name))
+    {
+        fprintf(stderr, "enable: %s: already loaded\n", name);
+        fflush(stderr);
+        return -1;
+    }
+    /* Inner commands change state of shell, so they aren't replaced. Also enable can't unload itself. */
+    if (BUILTIN_IS_INNER(replaced))
+    {
+        fprintf(stderr, "enable: %s: inner command can't be replaced\n", name);
+        fflush(stderr);
+        return -1;
+    }
+
+    if (!(handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)))
+    {
+        fprintf(stderr, "enable: %s\n", dlerror());
+        fflush(stderr);
+        return -1;
+    }
+
+    if (!(symbol = malloc(strlen(name) + sizeof(PLUGIN_SYMBOL_SUFFIX))))
+    {
+        perror("malloc");
+        dlclose(handle);
+        return -1;
+    }
+    strcat(strcpy(symbol, name), PLUGIN_SYMBOL_SUFFIX);
+    def = dlsym(handle, symbol);
+
+    if (!def)
+        fprintf(stderr, "enable: %s: no %s in %s\n", name, symbol, path);
+    else if (def->abi_version != SHELL_BUILTIN_ABI_VERSION)
+        fprintf(stderr, "enable: %s: ABI version %u, but shell supports %u\n",
+                name, def->abi_version, SHELL_BUILTIN_ABI_VERSION);
+    else if (!def->run || !def->name || strcmp(def->name, name))
+        fprintf(stderr, "enable: %s: invalid builtin in %s\n", name, path);
+    else if (!(p = malloc(sizeof(plugin))) || !(p->path = strdup(path)))
+    {
+        free(p);
+        perror("malloc");
+    } else
+    {
+        p->entry.name = def->name;
+        p->entry.kind = BUILTIN_PLUGIN;
+        p->entry.exec = NULL;
+        p->def = def;
+        p->replaced = replaced;
+        p->handle = handle;
+
+        if (!register_builtin(&p->entry))
+        {
+            p->next = plugins;
+            plugins = p;
+            free(symbol);
+            return 0;
+        }
+
+        perror("malloc");
+        free(p->path);
+        free(p);
+    }
+
+    fflush(stderr);
+    free(symbol);
+    dlclose(handle);
+    return -1;
+}
+
+/* Remove loaded builtin name from registry and unload its shared object.
+   Replaced builtin is registered again.
+   Print error and return -1, if builtin isn't loaded or runs on thread of shell. Or return 0. */
+int unload_plugin(const char *name)
+{
+    assert(name != NULL);
+
+    plugin **link = find_plugin(name), *p;
+
+    if (!link)
+    {
+        fprintf(stderr, "enable: %s: not loaded\n", name);
+        fflush(stderr);
+        return -1;
+    }
+
+    /* Code of shared object must not be unmapped under running thread. */
+    reap_workers();
+    if (builtin_has_workers(&(*link)->entry))
+    {
+        fprintf(stderr, "enable: %s: builtin is running\n", name);
+        fflush(stderr);
+        return -1;
+    }
+
+    p = *link;
+    *link = p->next;
+    free_plugin(p);
+
+    return 0;
+}
+
+/* Run loaded builtin b with args argv and streams io. Return exit status of builtin. */
+int run_plugin(const builtin *b, const char *argv[], const builtin_streams *io)
+{
+    assert(b != NULL && b->kind == BUILTIN_PLUGIN);
+    assert(argv != NULL);
+
+    const plugin *p = (const plugin *) b;
+    shell_builtin_call call;
+
+    for (call.argc = 0; argv[call.argc]; ++call.argc);
+    call.argv = argv;
+    call.in = io->in;
+    call.out = io->out;
+    call.err = STDERR_FILENO;
+
+    /* Status of waitpid format keeps only low byte. */
+    return p->def->run(&call) & 0xff;
+}
+
+/* Check loaded builtin b reads input, when it's called with args argv. */
+int plugin_reads_input(const builtin *b, const char *argv[])
+{
+    assert(b != NULL && b->kind == BUILTIN_PLUGIN);
+
+    unsigned flags = ((const plugin *) b)->def->flags;
+
+    if (flags & SHELL_BUILTIN_READS_INPUT)
+        return 1;
+    return (flags & SHELL_BUILTIN_READS_INPUT_WITHOUT_ARGS) && (!argv[0] || !argv[1]);
+}
+
+/* Print loaded builtins and their shared objects to fd. */
+void print_plugins(int fd)
+{
+    dprintf(fd, "builtin\tlibrary\n");
+    for (plugin *p = plugins; p; p = p->next)
+        dprintf(fd, "%s\t%s\n", p->entry.name, p->path);
+}
+
+/* Unload all builtins, which don't run on threads of shell. */
+void clear_plugins()
+{
+    plugin **link = &plugins, *p;
+
+    reap_workers();
+    while ((p = *link))
+        if (builtin_has_workers(&p->entry))
+            link = &p->next;
+        else
+        {
+            *link = p->next;
+            free_plugin(p);
+        }
+}
+
+/* Find loaded builtin name. Return link to it in the list of loaded builtins, or NULL. */
+static plugin **find_plugin(const char *name)
+{
+    for (plugin **link = &plugins; *link; link = &(*link)->next)
+        if (!strcmp((*link)->entry.name, name))
+            return link;
+
+    return NULL;
+}
+
+/* Remove plugin p from registry, restore replaced builtin and free p. */
+static void free_plugin(plugin *p)
+{
+    unregister_builtin(p->entry.name);
+    if (p->replaced && register_builtin(p->replaced))
+        perror("malloc");
+
+    dlclose(p->handle);
+    free(p->path);
+    free(p);
+}
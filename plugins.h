@@ -0,0 +1,30 @@
+#ifndef UNIX_SHELL_PLUGINS_H
+#define UNIX_SHELL_PLUGINS_H
+
+#include "builtins.h"
+#include "shell_builtin.h"
+
+#define PLUGIN_SYMBOL_SUFFIX "_builtin" /* suffix of name of variable, which shared object exports */
+
+/* Load builtin name from shared object path and register it. It replaces builtin with the same name.
+   Print error and return -1, if object or its builtin can't be loaded. Or return 0. */
+int load_plugin(const char *path, const char *name);
+
+/* Remove loaded builtin name from registry and unload its shared object.
+   Replaced builtin is registered again.
+   Print error and return -1, if builtin isn't loaded or runs on thread of shell. Or return 0. */
+int unload_plugin(const char *name);
+
+/* Run loaded builtin b with args argv and streams io. Return exit status of builtin. */
+int run_plugin(const builtin *b, const char *argv[], const builtin_streams *io);
+
+/* Check loaded builtin b reads input, when it's called with args argv. */
+int plugin_reads_input(const builtin *b, const char *argv[]);
+
+/* Print loaded builtins and their shared objects to fd. */
+void print_plugins(int fd);
+
+/* Unload all builtins, which don't run on threads of shell. */
+void clear_plugins();
+
+#endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "shell_builtin.h"
+
+/* Example of loadable builtin.
+   normpath [path...]
+   Print paths without empty, . and .. components, one per line. Paths are read by lines from input without args.
+   Build: cc -shared -fPIC -I. -o normpath.so plugins/normpath.c
+   Load:  enable -f ./normpath.so normpath */
+
+#define NORMPATH_BUFFER_SIZE 65536 /* size of input and output buffers */
+
+/* Output buffer of builtin. */
+typedef struct out_buffer
+{
+    int fd;                             /* output descriptor */
+    size_t len;                         /* count of buffered bytes */
+    char data[NORMPATH_BUFFER_SIZE];    /* buffered bytes */
+} out_buffer;
+
+/* Write buffered bytes of out to its descriptor. Return 0, if success. */
+static int flush(out_buffer *out)
+{
+    size_t written = 0;
+    ssize_t n;
+
+    while (written < out->len)
+        if ((n = write(out->fd, out->data + written, out->len - written)) >= 0)
+            written += (size_t) n;
+        else if (errno != EINTR)
+            return -1;
+
+    out->len = 0;
+    return 0;
+}
+
+/* Append normalized path of len bytes and new line to out. Return 0, if success. */
+static int print_path(out_buffer *out, const char *path, size_t len)
+{
+    /* Normalized path isn't longer than path, except "." and new line. */
+    if (out->len + len + 2 > sizeof(out->data) && flush(out))
+        return -1;
+    if (len + 2 > sizeof(out->data))
+        return -1;
+
+    char *begin = out->data + out->len, *end = begin;
+    size_t depth = 0; /* count of components, which .. may remove */
+    int absolute = len && path[0] == '/';
+
+    if (absolute)
+        *end++ = '/';
+
+    for (size_t i = 0; i < len;)
+    {
+        size_t j = i;
+        while (j < len && path[j] != '/')
+            j++;
+
+        size_t n = j - i;
+        if (n == 2 && path[i] == '.' && path[i + 1] == '.')
+        {
+            if (depth)
+            {
+                /* Remove the last component with its separator. */
+                while (end > begin && end[-1] != '/')
+                    end--;
+                if (end > begin + absolute)
+                    end--;
+                depth--;
+            } else if (!absolute)
+            {
+                if (end > begin)
+                    *end++ = '/';
+                memcpy(end, "..", 2);
+                end += 2;
+            }
+        } else if (n && !(n == 1 && path[i] == '.'))
+        {
+            if (end > begin + absolute)
+                *end++ = '/';
+            memcpy(end, path + i, n);
+            end += n;
+            depth++;
+        }
+
+        i = j + 1;
+    }
+
+    if (end == begin)
+        *end++ = '.';
+    *end++ = '\n';
+    out->len += (size_t) (end - begin);
+
+    return 0;
+}
+
+/* Print normalized lines of input to out. Return 0, if success. */
+static int print_input(int in, out_buffer *out)
+{
+    char data[NORMPATH_BUFFER_SIZE];
+    size_t len = 0;
+    ssize_t n;
+
+    while ((n = read(in, data + len, sizeof(data) - len)) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        char *line = data, *end = data + len + n, *nl;
+        while ((nl = memchr(line, '\n', (size_t) (end - line))))
+        {
+            if (print_path(out, line, (size_t) (nl - line)))
+                return -1;
+            line = nl + 1;
+        }
+
+        /* Line longer than buffer can't be normalized. */
+        if ((len = (size_t) (end - line)) == sizeof(data))
+            return -1;
+        memmove(data, line, len);
+    }
+
+    return len ? print_path(out, data, len) : 0;
+}
+
+/* Run normpath. */
+static int run_normpath(const shell_builtin_call *call)
+{
+    out_buffer out;
+    int status = 0;
+
+    errno = 0;
+    out.fd = call->out;
+    out.len = 0;
+
+    if (call->argc < 2)
+        status = print_input(call->in, &out);
+    for (int i = 1; i < call->argc && !status; ++i)
+        status = print_path(&out, call->argv[i], strlen(call->argv[i]));
+
+    if (flush(&out) || status)
+    {
+        dprintf(call->err, "normpath: %s\n", errno ? strerror(errno) : "line is too long");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Builtin of the shared object. */
+const shell_builtin normpath_builtin =
+{
+    SHELL_BUILTIN_ABI_VERSION,
+    "normpath",
+    SHELL_BUILTIN_READS_INPUT_WITHOUT_ARGS,
+    run_normpath
+};
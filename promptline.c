@@ -3,291 +3,1207 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdint.h>
 #include "shell.h"
+#include "events.h"
 
-/* Read line from input. Return count of read symbols. */
-ssize_t prompt_line(char *line, int sizeline)
+#define CLASS_BLOCK 64 /* symbols classified to one word of bitmask */
+#define SUBST_DEPTH 8  /* maximal nesting of process substitutions */
+
+#if defined(__AVX2__) && !defined(TOKENIZER_NO_SIMD)
+#    include <immintrin.h>
+#    define SIMD_WIDTH 32 /* bytes classified by one instruction of tokenizer */
+#elif defined(__SSE2__) && !defined(TOKENIZER_NO_SIMD)
+#    include <emmintrin.h>
+#    define SIMD_WIDTH 16
+#else
+#    define SIMD_WIDTH 1
+#endif
+
+#define READ_BUFFER_SIZE (64 * 1024) /* initial size of input buffer */
+#define READ_CHUNK_SIZE  4096        /* minimal free space in input buffer for read() */
+
+/* Buffered input of shell. Bytes after the returned line are kept for next lines. */
+typedef struct line_reader
+{
+    int fd;                     /* input descriptor, -1 for string */
+    char *buf;                  /* input buffer */
+    size_t size;                /* size of buffer */
+    size_t begin;               /* offset of unread bytes */
+    size_t end;                 /* offset after unread bytes */
+    int eof;                    /* true if input is closed */
+} line_reader;
+
+static line_reader input = {STDIN_FILENO, NULL, 0, 0, 0, 0};
+
+/* Read next chunk of input after unread bytes. scan is offset in them, it's updated after moving.
+   Return count of read symbols, 0 on end of input. Or -1, if reading failed. */
+static ssize_t fill_input(size_t *scan);
+
+/* Read commands from descriptor fd instead of terminal in non-interactive mode. */
+void set_input_fd(int fd)
+{
+    input.fd = fd;
+}
+
+/* Read commands from string s of len symbols in non-interactive mode.
+   Return 0, if success. */
+int set_input_string(const char *s, size_t len)
+{
+    assert(s != NULL);
+
+    /* String is copied, because continuations of lines are changed in place. */
+    if (!(input.buf = malloc(len + 1)))
+    {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(input.buf, s, len);
+    input.size = len + 1;
+    input.end = len;
+    input.fd = -1;
+    input.eof = 1;
+
+    return 0;
+}
+
+/* Return unread input to descriptor, so children of shell read STDIN from the next line.
+   It's possible only for seekable STDIN. */
+void sync_input()
+{
+    if (input.fd != STDIN_FILENO || input.begin == input.end)
+        return;
+
+    if (lseek(input.fd, -(off_t) (input.end - input.begin), SEEK_CUR) != -1)
+        input.begin = input.end = 0;
+}
+
+/* Free input buffer. */
+void close_input()
+{
+    free(input.buf);
+    input.buf = NULL;
+    input.size = input.begin = input.end = 0;
+}
+
+/* Read next chunk of input after unread bytes. scan is offset in them, it's updated after moving.
+   Return count of read symbols, 0 on end of input. Or -1, if reading failed. */
+static ssize_t fill_input(size_t *scan)
 {
-    ssize_t n = 0;
+    ssize_t r;
+
+    /* Move unread bytes to begin of buffer. Each byte is moved only when the buffer is exhausted. */
+    if (input.begin)
+    {
+        memmove(input.buf, input.buf + input.begin, input.end - input.begin);
+        *scan -= input.begin;
+        input.end -= input.begin;
+        input.begin = 0;
+    }
+
+    /* Grow buffer twice, so long lines are read in linear time. */
+    if (input.size - input.end < READ_CHUNK_SIZE + 1)
+    {
+        size_t new_size = input.size ? input.size * 2 : READ_BUFFER_SIZE;
+        char *new_buf = realloc(input.buf, new_size);
+
+        if (!new_buf)
+        {
+            perror("realloc");
+            return -1;
+        }
+        input.buf = new_buf;
+        input.size = new_size;
+    }
 
     while (1)
     {
-        n += read(0, (line + n), (size_t) (sizeline - n));
-        *(line + n) = '\0';
-         /* Check to see if command line extends on to next line.
-            If so, append next line to command line. */
+        /* Notify about jobs, until the user enters something. */
+        if (!wait_for_input(input.fd))
+            return -1;
 
-        if (*(line + n - 2) == '\\' && *(line + n - 1) == '\n')
+        if ((r = read(input.fd, input.buf + input.end, input.size - input.end - 1)) < 0)
         {
-            *(line + n) = ' ';
-            *(line + n - 1) = '\n';
-            *(line + n - 2) = ' ';
-            printf("> ");
-            fflush(stdout);
-            continue;   /* Read next line. */
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            return -1;
         }
-        return (n);      /* All done. */
+        input.end += (size_t) r;
+        return r;
     }
 }
 
-/* Skip all spaces from begin of string s. */
+/* Read next logical line of input. *line points to it in input buffer until the next call.
+   Line continuations are replaced by spaces.
+   Return count of symbols in line, 0 on end of input. Or -1, if reading failed. */
+ssize_t prompt_line(char **line)
+{
+    assert(line != NULL);
+
+    size_t scan = input.begin, len;
+    char *nl;
+    ssize_t r;
+
+    while (1)
+    {
+        /* Search the end of line only in new bytes. */
+        if (scan < input.end && (nl = memchr(input.buf + scan, '\n', input.end - scan)))
+        {
+            /* Check to see if command line extends on to next line.
+               If so, join lines in place. */
+            if (nl > input.buf + input.begin && nl[-1] == '\\')
+            {
+                nl[-1] = ' ';
+                nl[0] = ' ';
+                scan = (size_t) (nl - input.buf) + 1;
+                if (shell_is_interactive && scan == input.end)
+                {
+                    printf("> ");
+                    fflush(stdout);
+                }
+                continue;
+            }
+
+            len = (size_t) (nl - input.buf) + 1 - input.begin;
+            break;
+        }
+        scan = input.end;
+
+        /* The last line may have no newline. */
+        if (input.eof || (r = fill_input(&scan)) == 0)
+        {
+            input.eof = 1;
+            len = input.end - input.begin;
+            break;
+        }
+        if (r < 0)
+            return -1;
+    }
+
+    *line = input.buf + input.begin;
+    input.begin += len;
+
+    return (ssize_t) len;
+}
+
+#define CC_BLANK   1 /* space or tab */
+#define CC_END     2 /* symbol ends unquoted word */
+#define CC_SPECIAL 4 /* symbol is handled inside word: quote, escape, expansion or end of line */
+
+/* Classes of symbols for tokenizer. */
+static const unsigned char char_class[256] = {
+        ['\0'] = CC_END | CC_SPECIAL,
+        [' '] = CC_BLANK | CC_END,
+        ['\t'] = CC_BLANK | CC_END,
+        ['\n'] = CC_END,
+        ['|'] = CC_END,
+        ['&'] = CC_END,
+        [';'] = CC_END,
+        ['<'] = CC_END,
+        ['>'] = CC_END,
+        [')'] = CC_END,
+        ['"'] = CC_SPECIAL,
+        ['\\'] = CC_SPECIAL,
+        ['$'] = CC_SPECIAL,
+        ['`'] = CC_SPECIAL
+};
+
+/* Output of command substitution, which is kept between scans of word. */
+typedef struct subst_output
+{
+    struct subst_output *next;  /* output of the next substitution of word */
+    char *data;                 /* output of command, or NULL if it's empty */
+    size_t len;                 /* length of output */
+} subst_output;
+
+/* Parser state of one line. */
+typedef struct parser
+{
+    arena *mem;                 /* memory of parsed line */
+    char *line;                 /* copy of line, words are cut in it */
+    const char *source;         /* original line for texts of pipelines */
+    cmd_list *list;             /* result of parsing */
+    pipeline *last_pipeline;    /* last pipeline of list */
+    pipeline *pl;               /* current pipeline */
+    ast_command *cmd;           /* current command */
+    word *last_word;            /* last word of current command */
+    redirect *last_redirect;    /* last redirection of current command */
+    size_t pl_begin;            /* offset of current pipeline in line */
+    uint64_t *ends;             /* bitmask of symbols, which stop plain run of unquoted word */
+    uint64_t *specials;         /* bitmask of symbols, which stop plain run of quoted word */
+    int dynamic;                /* true if line has dynamic words */
+    ast_command *outer[SUBST_DEPTH]; /* commands, which own open process substitutions */
+    int depth;                  /* count of open process substitutions */
+    int run_commands;           /* true if command substitutions are run, it's only at expansion of pipeline */
+    subst_output *outputs;      /* outputs of command substitutions of current word from its first scan */
+    subst_output **outputs_end; /* link for the next output of first scan */
+    subst_output *next_output;  /* output for the next substitution of second scan */
+} parser;
+
+/* Check symbol ends word. */
+static int is_word_end(char c);
+
+/* Skip spaces and tabs from begin of string s. */
 static char *blank_skip(register char *s);
 
-/* Parse input line. Return -1, if was syntax error.
-   Or 1, if parsing was successful.
-   All args must be non null. */
-int parse_line(char *line, char *varline)
+/* Copy line of len symbols to arena of parser with padding and classify its symbols.
+   Return 0, if success. */
+static int load_line(parser *ps, const char *line, size_t len);
+
+/* Classify symbols of line of len symbols to bitmasks of parser.
+   Line is read by blocks, so it must be padded by zeros to CLASS_BLOCK. */
+static void classify_line(parser *ps, size_t len);
+
+/* Return length of prefix of s in line of parser without symbols of classes stop.
+   Symbols are checked by table, if line of parser isn't classified. */
+static size_t plain_run(parser *ps, const char *s, int stop);
+
+/* Scan word from s in line of parser ps. Write its value to dst, if dst isn't NULL.
+   Set *len to length of value, *expand to 1, if word has $ expansions,
+   *quoted to 1, if word has quotes or escapes. If fields isn't NULL, unquoted output
+   of command substitutions is split to fields, which are separated by '\0', and *fields is set to their count.
+   Return pointer to the end of word. Or NULL, if quotes or substitutions aren't closed. */
+static char *scan_word(parser *ps, char *s, char *dst, size_t *len, int *expand, int *quoted, int *fields);
+
+/* Find end of command substitution $(command) or `command` at s and set *output and *len to output of command.
+   Command runs at the first scan of word at expansion of pipeline, second scan gets its output, if written is true.
+   Output is empty at parsing. Return pointer after substitution. Or NULL, if it isn't closed. */
+static char *substitute(parser *ps, char *s, int written, const char **output, size_t *len);
+
+/* Write '\0' before the next symbol of value dst of *n symbols, if *split is true, and count the new field. */
+static void put_separator(char *dst, size_t *n, int *split, int *fields);
+
+/* Free outputs of command substitutions of current word. */
+static void free_outputs(parser *ps);
+
+/* Add count fields of value, which are separated by '\0', to argv from index i. Return index after them. */
+static int split_fields(char **argv, int i, char *value, int count);
+
+/* Cut word from s. Set *value to its value or NULL, if value is empty.
+   If '\0' was written over the symbol after word, it's saved to *cut.
+   Set *dynamic to 1, if word has expansions, which may change.
+   If fields isn't NULL, value is split like in scan_word and *fields is set to count of its fields.
+   Return pointer to the end of word. Or NULL, if word is invalid. */
+static char *parse_word(parser *ps, char *s, char **value, char *cut, int *dynamic, int *fields);
+
+/* Expand dynamic words and redirections of copied command cmd again.
+   Return 0, if success. */
+static int expand_command(parser *ps, ast_command *cmd);
+
+/* Start new command of current pipeline. Return 0, if success. */
+static int begin_command(parser *ps);
+
+/* Finish current command. Return 0, if success. */
+static int end_command(parser *ps);
+
+/* Finish current pipeline, which ends at offset end. Return 0, if success. */
+static int end_pipeline(parser *ps, size_t end, int background);
+
+/* Add process substitution of kind to current command and start its command.
+   Its path becomes file of redirection target, if it isn't NULL, or word of command. Return 0, if success. */
+static int begin_substitution(parser *ps, int kind, redirect *target);
+
+/* Finish command of the innermost process substitution and continue its owner. Return 0, if success. */
+static int end_substitution(parser *ps);
+
+/* Parse input line to list of pipelines in new arena.
+   Command substitutions aren't run, their words are dynamic, so expand_pipeline runs them.
+   Return NULL, if was syntax error.
+   line must be non null. */
+cmd_list *parse_line(const char *line, size_t len)
 {
     assert(line != NULL);
-    assert(varline != NULL);
-
-    int nargs, ncmds;
-    register char *s;
-    register char *envword;
-    char aflg = 0;
-    int rval;
-    int new_arg;
-    register int i;
-    static char delim[] = " \t|&<>;$\n\"\\";
-
-    bkgrnd = nargs = ncmds = rval = 0;
-    s = line;
-    infile = outfile = appfile = (char *) NULL;
-    cmds[0].cmdargs[0] = (char *) NULL;
-
-    for (i = 0; i < MAXCMDS; i++)
+
+    parser ps;
+    char *s, *value;
+    char c, cut = '\0';
+
+    memset(&ps, 0, sizeof(parser));
+    ps.source = line;
+
+    /* One allocation is enough for usual lines. */
+    if (!(ps.mem = arena_create(len * 3 + 1024)) ||
+        load_line(&ps, line, len) ||
+        !(ps.list = arena_alloc(ps.mem, sizeof(cmd_list))))
     {
-        cmds[i].cmdflag = 0;
-        for (int j = 0; j < MAXARGS; ++j)
-            cmds[i].cmdargs[j] = NULL;
+        perror("malloc");
+        arena_release(ps.mem);
+        return NULL;
     }
+    memset(ps.list, 0, sizeof(cmd_list));
+    ps.list->mem = ps.mem;
 
-    while (*s)
+    s = ps.line;
+    while (1)
     {
-        s = blank_skip(s);
-        if (!*s)
-            break;
+        /* Symbol after previous word may be replaced by '\0'. */
+        if (cut)
+            c = cut;
+        else
+        {
+            s = blank_skip(s);
+            c = *s;
+        }
+        cut = '\0';
 
-        /* Handle <, >, |, &, $, " and ; */
-        switch (*s)
+        /* Handle <, >, |, &, ;, line end and words. */
+        switch (c)
         {
+            case '\0':
+            case '\n':
+            case ';':
             case '&':
-                ++bkgrnd;
-                *s++ = '\0';
+                if (ps.depth || (ps.cmd && !ps.cmd->argc && !ps.cmd->redirects))
+                    goto syntax_error;
+                if (end_pipeline(&ps, (size_t) (s - ps.line), c == '&'))
+                    goto memory_error;
+                if (!c)
+                {
+                    /* Dynamic words are expanded from source, when line is taken from cache. */
+                    if (ps.dynamic)
+                    {
+                        if (!(ps.list->source = arena_strndup(ps.mem, line, len)))
+                            goto memory_error;
+                        ps.list->len = len;
+                    }
+                    return ps.list;
+                }
+                s++;
+                ps.pl_begin = (size_t) (s - ps.line);
+                break;
+            case '|':
+                /* Substituted command is simple, it has no pipes. */
+                if (ps.depth || !ps.cmd || (!ps.cmd->argc && !ps.cmd->redirects))
+                    goto syntax_error;
+                if (end_command(&ps) || begin_command(&ps))
+                    goto memory_error;
+                s++;
                 break;
+            case ')':
+                if (!ps.depth || !ps.cmd->argc)
+                    goto syntax_error;
+                if (end_substitution(&ps))
+                    goto memory_error;
+                s++;
+                break;
+            case '<':
             case '>':
-                if (*(s + 1) == '>')
+            {
+                redirect *r;
+
+                /* Process substitution is a word of command, which is replaced by path at launch. */
+                if (s[1] == '(')
                 {
-                    ++aflg;
-                    *s++ = '\0';
+                    if (ps.depth == SUBST_DEPTH)
+                        goto syntax_error;
+                    if (begin_substitution(&ps, c == '<' ? REDIR_IN : REDIR_OUT, NULL))
+                        goto memory_error;
+                    s += 2;
+                    break;
                 }
-                *s++ = '\0';
-                s = blank_skip(s);
-                if (!*s)
+
+                if ((!ps.cmd && begin_command(&ps)) || !(r = arena_alloc(ps.mem, sizeof(redirect))))
+                    goto memory_error;
+
+                r->next = NULL;
+                r->kind = c == '<' ? REDIR_IN : REDIR_OUT;
+                if (*++s == '>' && c == '>')
                 {
-                    fprintf(stderr, "Syntax error!\n");
-                    return (-1);
+                    r->kind = REDIR_APPEND;
+                    s++;
                 }
 
-                if (aflg)
-                    appfile = s;
+                if (ps.last_redirect)
+                    ps.last_redirect->next = r;
                 else
-                    outfile = s;
-                s = strpbrk(s, delim);
-                if (isspace(*s))
-                    *s++ = '\0';
-                break;
-            case '<':
-                *s++ = '\0';
+                    ps.cmd->redirects = r;
+                ps.last_redirect = r;
+
                 s = blank_skip(s);
-                if (!*s)
-                {
-                    fprintf(stderr, "Syntax error!\n");
-                    return (-1);
-                }
-                infile = s;
-                s = strpbrk(s, delim);
-                if (isspace(*s))
-                    *s++ = '\0';
-                break;
-            case '|':
-                if (nargs == 0)
+                r->offset = (size_t) (s - ps.line);
+                r->dynamic = 0;
+
+                /* Target may be process substitution like cmd > >(command), it's opened by path of its pipe. */
+                if ((*s == '<' || *s == '>') && s[1] == '(')
                 {
-                    fprintf(stderr, "Syntax error!\n");
-                    return (-1);
+                    if (ps.depth == SUBST_DEPTH)
+                        goto syntax_error;
+                    if (begin_substitution(&ps, *s == '<' ? REDIR_IN : REDIR_OUT, r))
+                        goto memory_error;
+                    s += 2;
+                    break;
                 }
-                cmds[ncmds++].cmdflag |= OUTPIP;
-                cmds[ncmds].cmdflag |= INPIP;
-                *s++ = '\0';
-                nargs = 0;
+
+                /* Dynamic name is known only at expansion. */
+                if (is_word_end(*s) || !(s = parse_word(&ps, s, &r->file, &cut, &r->dynamic, NULL))
+                    || (!r->file && !r->dynamic))
+                    goto syntax_error;
+                ps.cmd->dynamic |= r->dynamic;
                 break;
-            case ';':
-                *s++ = '\0';
-                ++ncmds;
-                nargs = 0;
+            }
+            default:
+            {
+                /* If we get a word, not a symbol. */
+                word *w;
+                size_t offset = (size_t) (s - ps.line);
+                int dynamic, fields;
+
+                if (!ps.cmd && begin_command(&ps))
+                    goto memory_error;
+                if (!(s = parse_word(&ps, s, &value, &cut, &dynamic, &fields)))
+                    goto syntax_error;
+
+                /* Empty expansions don't make words. Dynamic ones are kept for next expansions. */
+                if (!value && !dynamic)
+                    break;
+
+                if (!(w = arena_alloc(ps.mem, sizeof(word))))
+                    goto memory_error;
+                w->next = NULL;
+                w->text = value;
+                w->fields = fields;
+                w->dynamic = dynamic;
+                w->offset = offset;
+                ps.cmd->dynamic |= dynamic;
+
+                if (ps.last_word)
+                    ps.last_word->next = w;
+                else
+                    ps.cmd->words = w;
+                ps.last_word = w;
+                if (value)
+                    ps.cmd->argc += fields;
                 break;
-            case '$':
-                /* Replace $($) to value of variable. */
-                if (*(s + 1) == '$')
-                {
-                    /* If on this position $$. We must get PID of shell process. */
-                    *s++ = '\0';
-                    *s++ = '\0';
-                    s = strpbrk(s, delim);
-                    if (isspace(*s))
-                        *s++ = '\0';
+            }
+        }
+    }
 
-                    cmds[ncmds].cmdargs[nargs++] = varline;
-                    cmds[ncmds].cmdargs[nargs] = (char *) NULL;
+syntax_error:
+    fprintf(stderr, "Syntax error!\n");
+    fflush(stderr);
+    arena_release(ps.mem);
+    return NULL;
 
-                    char str[10];
-                    sprintf(str, "%d", getpid());
+memory_error:
+    perror("malloc");
+    arena_release(ps.mem);
+    return NULL;
+}
 
-                    int index = 0;
-                    while(!isspace(str[index]) && str[index] != '\0')
-                        *varline++ = str[index++];
+/* Check symbol ends word. */
+static int is_word_end(char c)
+{
+    return char_class[(unsigned char) c] & CC_END;
+}
 
-                    *varline++ = '\0';
-                } else
-                {
-                    /* If on this position $<VAR_NAME>. We must get value of VAR_NAME. */
-                    *s++ = '\0';
+/* Skip spaces and tabs from begin of string s. */
+static char *blank_skip(register char *s)
+{
+    while (char_class[(unsigned char) *s] & CC_BLANK) ++s;
+    return (s);
+}
 
-                    envword = s;
-                    while(!isspace(*s) && *s != '\0') ++s;
+/* Instantiate cached list tmpl in arena mem, which keeps arena of tmpl.
+   Pipelines are shared with tmpl, expand_pipeline expands their dynamic words before launch of each of them.
+   Return NULL, if failed. */
+cmd_list *expand_list(const cmd_list *tmpl, arena *mem)
+{
+    assert(tmpl != NULL);
+    assert(mem != NULL);
 
-                    s = strpbrk(s, delim);
-                    if (isspace(*s))
-                        *s++ = '\0';
+    cmd_list *list = arena_alloc(mem, sizeof(cmd_list));
 
-                    cmds[ncmds].cmdargs[nargs++] = getenv(envword);
-                    cmds[ncmds].cmdargs[nargs] = (char *) NULL;
-                }
-                break;
-            case '%':
-                /* Symbol of job list index. */
-                *s++ = '\0';
-                envword = s;
-                while(!isspace(*s) && *s != '\0') ++s;
+    if (!list)
+    {
+        perror("malloc");
+        return NULL;
+    }
+    *list = *tmpl;
+    list->mem = mem;
 
-                s = strpbrk(s, delim);
-                if (isspace(*s))
-                    *s++ = '\0';
+    /* Words are expanded by offsets in copy of source, which expansions cut. */
+    if (tmpl->source && !(list->source = arena_strndup(mem, tmpl->source, tmpl->len)))
+    {
+        perror("malloc");
+        return NULL;
+    }
 
-                cmds[ncmds].cmdargs[nargs++] = varline;
-                cmds[ncmds].cmdargs[nargs] = (char *) NULL;
+    return list;
+}
 
-                char str[10];
-                int a = (pid_t)strtol(envword, NULL, 10);
+/* Expand dynamic words of pipeline pl of list again from source of list: variables, job indexes
+   and command substitutions, which run now, so they see effects of previous pipelines of list.
+   Return copy of pl in arena of list, or pl, if it hasn't dynamic words. Or NULL, if expansion failed. */
+pipeline *expand_pipeline(cmd_list *list, pipeline *pl)
+{
+    assert(list != NULL);
+    assert(pl != NULL);
 
-                /* Check is the parsed PID correct. */
-                if(errno == ERANGE)
-                {
-                    fprintf(stderr, "%%%s: Invalid job index!\n", envword);
-                    fflush(stderr);
-                    return EXEC_FAILED;
-                }
+    parser ps;
+    pipeline *copy;
+    ast_command *cmd, *cmd_copy, *last_cmd = NULL;
 
-                /* Try to find job by parsed index. */
-                if (!find_job_jid(a))
-                {
-                    fprintf(stderr, "%%%s: no such job!\n", envword);
-                    return (-1);
-                }
+    /* Pipelines without dynamic words share all commands with template. */
+    for (cmd = pl->first_command; cmd && !cmd->dynamic; cmd = cmd->next);
+    if (!cmd || !list->source)
+        return pl;
 
-                sprintf(str, "%d", -find_job_jid(a)->pgid);
+    /* Only a few words are scanned, so line isn't classified. */
+    memset(&ps, 0, sizeof(parser));
+    ps.mem = list->mem;
+    ps.line = list->source;
+    ps.run_commands = 1;
 
-                int index = 0;
-                while(!isspace(str[index]) && str[index] != '\0')
-                    *varline++ = str[index++];
+    /* Pipeline and commands are copied for new links, argv of static commands are shared. */
+    if (!(copy = arena_alloc(ps.mem, sizeof(pipeline))))
+        goto memory_error;
+    *copy = *pl;
+    copy->next = NULL;
+    copy->first_command = NULL;
 
-                *varline++ = '\0';
-                break;
-            case '\"':
-                *s++ = '\0';
+    for (cmd = pl->first_command; cmd; cmd = cmd->next)
+    {
+        if (!(cmd_copy = arena_alloc(ps.mem, sizeof(ast_command))))
+            goto memory_error;
+        *cmd_copy = *cmd;
+        cmd_copy->next = NULL;
+        if (cmd->dynamic && expand_command(&ps, cmd_copy))
+        {
+            fprintf(stderr, "Syntax error!\n");
+            fflush(stderr);
+            return NULL;
+        }
 
-                /* Try to find second bracket. */
-                char second_bracket[2] = "\"";
-                char *entry = s;
+        if (last_cmd)
+            last_cmd->next = cmd_copy;
+        else
+            copy->first_command = cmd_copy;
+        last_cmd = cmd_copy;
+    }
 
-                while((entry = strpbrk(entry, second_bracket)) && entry > line && *(entry - 1) == '\\')
-                    if(entry > line && *(entry - 1) == '\\')
-                        strncpy(entry - 1, entry, strlen(entry));
+    return copy;
 
-                if (!entry)
-                {
-                    fprintf(stderr, "Syntax error!\n");
-                    return (-1);
-                } else
-                    *entry++ = '\0';
+memory_error:
+    perror("malloc");
+    return NULL;
+}
 
-                cmds[ncmds].cmdargs[nargs++] = s;
-                cmds[ncmds].cmdargs[nargs] = (char *) NULL;
+/* Copy line of len symbols to arena of parser with padding and classify its symbols.
+   Return 0, if success. */
+static int load_line(parser *ps, const char *line, size_t len)
+{
+    size_t blocks = len / CLASS_BLOCK + 1;
 
-                s = strpbrk(entry, delim);
-                break;
-            case '\\':
-                new_arg = s > line && (*(s - 1) == ' ' || *(s - 1) == '\0');
-                if (new_arg)
-                    *(s - 1) = '\0';
+    if (!(ps->line = arena_alloc(ps->mem, blocks * CLASS_BLOCK)) ||
+        !(ps->ends = arena_alloc(ps->mem, blocks * sizeof(uint64_t))) ||
+        !(ps->specials = arena_alloc(ps->mem, blocks * sizeof(uint64_t))))
+        return -1;
 
-                if(s + 1 <= line + READ_LINE_SIZE)
-                {
-                    strncpy(s, s + 1, strlen(s + 1));
-                    if(new_arg)
-                    {
-                        cmds[ncmds].cmdargs[nargs++] = s;
-                        cmds[ncmds].cmdargs[nargs] = (char *) NULL;
-                    }
+    memcpy(ps->line, line, len);
+    memset(ps->line + len, 0, blocks * CLASS_BLOCK - len);
+    classify_line(ps, len);
 
-                    if(*(s + 1) == ' ')
-                    {
-                        s++;
-                        *s++ = '\0';
-                        s = strpbrk(s, delim);
-                    }
-                    else
-                        s = strpbrk(++s, delim);
-                    if(!s)
-                        return (-1);
-
-                    if (isspace(*s))
-                        *s++ = '\0';
-                } else
+    return 0;
+}
+
+/* Classify symbols of line of len symbols to bitmasks of parser.
+   Line is read by blocks, so it must be padded by zeros to CLASS_BLOCK. */
+static void classify_line(parser *ps, size_t len)
+{
+#if SIMD_WIDTH > 1
+    const char *s = ps->line;
+    size_t blocks = len / CLASS_BLOCK + 1;
+
+    for (size_t b = 0; b < blocks; ++b, s += CLASS_BLOCK)
+    {
+        uint64_t ends = 0, specials = 0;
+
+        for (int i = 0; i < CLASS_BLOCK; i += SIMD_WIDTH)
+        {
+#    if SIMD_WIDTH == 32
+            /* Compare 32 symbols with each symbol of class at once. */
+            __m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+            __m256i sp = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()),
+                                                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')),
+                                                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$'))));
+            __m256i end = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                                          _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')))),
+                                          _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')),
+                                                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';'))),
+                                                          _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')),
+                                                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')))));
+            end = _mm256_or_si256(end, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')));
+            sp = _mm256_or_si256(sp, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('`')));
+            uint64_t sp_bits = (uint32_t) _mm256_movemask_epi8(sp);
+            uint64_t end_bits = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(sp, end));
+#    else
+            /* Compare 16 symbols with each symbol of class at once. */
+            __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+            __m128i sp = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                                                   _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))),
+                                      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')),
+                                                   _mm_cmpeq_epi8(v, _mm_set1_epi8('$'))));
+            __m128i end = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('|')))),
+                                       _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('&')),
+                                                                 _mm_cmpeq_epi8(v, _mm_set1_epi8(';'))),
+                                                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('<')),
+                                                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('>')))));
+            end = _mm_or_si128(end, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+            sp = _mm_or_si128(sp, _mm_cmpeq_epi8(v, _mm_set1_epi8('`')));
+            uint64_t sp_bits = (uint16_t) _mm_movemask_epi8(sp);
+            uint64_t end_bits = (uint16_t) _mm_movemask_epi8(_mm_or_si128(sp, end));
+#    endif
+            specials |= sp_bits << i;
+            ends |= end_bits << i;
+        }
+        ps->specials[b] = specials;
+        ps->ends[b] = ends;
+    }
+#else
+    /* Without SIMD symbols are classified by table in plain_run(). */
+    (void) ps;
+    (void) len;
+#endif
+}
+
+/* Return length of prefix of s in line of parser without symbols of classes stop.
+   Symbols are checked by table, if line of parser isn't classified. */
+static size_t plain_run(parser *ps, const char *s, int stop)
+{
+    size_t n = 0;
+
+#if SIMD_WIDTH > 1
+    if (ps->ends)
+    {
+        const uint64_t *mask = stop & CC_END ? ps->ends : ps->specials;
+        size_t begin = (size_t) (s - ps->line), i = begin / CLASS_BLOCK;
+        uint64_t bits = mask[i] & (~(uint64_t) 0 << (begin % CLASS_BLOCK));
+
+        /* The end of line is always in mask, so search is finished. */
+        while (!bits)
+            bits = mask[++i];
+
+        return i * CLASS_BLOCK + (size_t) __builtin_ctzll(bits) - begin;
+    }
+#endif
+
+    /* Line isn't classified, if only a few words of it are scanned. */
+    (void) ps;
+    while (!(char_class[(unsigned char) s[n]] & stop))
+        n++;
+    return n;
+}
+
+/* Scan word from s in line of parser ps. Write its value to dst, if dst isn't NULL.
+   Set *len to length of value, *expand to 1, if word has $ expansions,
+   *quoted to 1, if word has quotes or escapes. If fields isn't NULL, unquoted output
+   of command substitutions is split to fields, which are separated by '\0', and *fields is set to their count.
+   Return pointer to the end of word. Or NULL, if quotes or substitutions aren't closed. */
+static char *scan_word(parser *ps, char *s, char *dst, size_t *len, int *expand, int *quoted, int *fields)
+{
+    char pid[16];
+    int in_quotes = 0, split = 0, separators = 0;
+    size_t n = 0;
+
+    *expand = *quoted = 0;
+    while (1)
+    {
+        /* Plain symbols are copied by runs. Value is written by single cursor behind s. */
+        size_t run = plain_run(ps, s, in_quotes ? CC_SPECIAL : CC_END | CC_SPECIAL);
+        if (run)
+        {
+            put_separator(dst, &n, &split, &separators);
+            if (dst && dst + n != s)
+                memmove(dst + n, s, run);
+            n += run;
+            s += run;
+        }
+
+        if (!*s || (!in_quotes && is_word_end(*s)))
+            break;
+
+        if (*s == '"')
+        {
+            in_quotes = !in_quotes;
+            *quoted = 1;
+            s++;
+        } else if (*s == '\\' && s[1] && (!in_quotes || s[1] == '"' || s[1] == '\\' || s[1] == '$' || s[1] == '`'))
+        {
+            /* Escaped symbol. */
+            put_separator(dst, &n, &split, &separators);
+            if (dst)
+                dst[n] = s[1];
+            n++;
+            s += 2;
+            *quoted = 1;
+        } else if ((*s == '$' && s[1] == '(') || *s == '`')
+        {
+            const char *output;
+            size_t output_len;
+
+            *expand = 1;
+            if (!(s = substitute(ps, s, dst != NULL, &output, &output_len)))
+                return NULL;
+
+            /* Blanks of unquoted output separate fields, zero bytes can't be in args. */
+            for (size_t i = 0; i < output_len; ++i)
+                if (fields && !in_quotes && (output[i] == ' ' || output[i] == '\t' || output[i] == '\n'))
+                    split |= n > 0;
+                else if (output[i])
                 {
-                    fprintf(stderr, "Syntax error!\n");
-                    return (-1);
+                    put_separator(dst, &n, &split, &separators);
+                    if (dst)
+                        dst[n] = output[i];
+                    n++;
                 }
-                break;
-            default:
-                /* If we get a word, not a symbol. */
-                if (nargs == 0)
-                    rval = ncmds + 1;
-                cmds[ncmds].cmdargs[nargs++] = s;
-                cmds[ncmds].cmdargs[nargs] = (char *) NULL;
+        } else if (*s == '$' && (s[1] == '$' || isalnum((unsigned char) s[1]) || s[1] == '_'))
+        {
+            const char *value;
+            size_t value_len;
+
+            *expand = 1;
+            if (s[1] == '$')
+            {
+                /* If on this position $$. We must get PID of shell process. */
+                snprintf(pid, sizeof(pid), "%d", getpid());
+                value = pid;
+                s += 2;
+            } else
+            {
+                /* If on this position $<VAR_NAME>. We must get value of VAR_NAME. */
+                char *name = ++s;
+                while (isalnum((unsigned char) *s) || *s == '_')
+                    s++;
+
+                char saved = *s;
+                *s = '\0';
+                value = getenv(name);
+                *s = saved;
+            }
 
-                s = strpbrk(s, delim);
+            value_len = value ? strlen(value) : 0;
+            if (value_len)
+                put_separator(dst, &n, &split, &separators);
+            if (dst && value_len)
+                memcpy(dst + n, value, value_len);
+            n += value_len;
+        } else
+        {
+            put_separator(dst, &n, &split, &separators);
+            if (dst)
+                dst[n] = *s;
+            n++;
+            s++;
+        }
+    }
 
-                if(!s)
-                    return (-1);
+    /* Blanks at the end of word don't make empty field. */
+    if (fields)
+        *fields = n || *quoted ? separators + 1 : 0;
+    *len = n;
+    return in_quotes ? NULL : s;
+}
 
-                if (isspace(*s))
-                    *s++ = '\0';
+/* Find end of command substitution $(command) or `command` at s and set *output and *len to output of command.
+   Command runs at the first scan of word at expansion of pipeline, second scan gets its output, if written is true.
+   Output is empty at parsing. Return pointer after substitution. Or NULL, if it isn't closed. */
+static char *substitute(parser *ps, char *s, int written, const char **output, size_t *len)
+{
+    char *body;
+    int depth = 1, in_quotes = 0;
+    subst_output *out;
+
+    if (*s == '`')
+    {
+        for (body = ++s; *s && *s != '`'; ++s)
+            if (*s == '\\' && s[1])
+                s++;
+    } else
+    {
+        /* Nested substitutions and quoted parentheses are skipped. */
+        for (body = s += 2; *s; ++s)
+            if (*s == '\\' && s[1])
+                s++;
+            else if (*s == '"')
+                in_quotes = !in_quotes;
+            else if (!in_quotes && *s == '(')
+                depth++;
+            else if (!in_quotes && *s == ')' && !--depth)
                 break;
+    }
+    if (!*s)
+        return NULL;
+
+    /* Output of the first scan is kept for the second one, which writes value. */
+    if (written)
+    {
+        if ((out = ps->next_output))
+            ps->next_output = out->next;
+    } else if ((out = arena_alloc(ps->mem, sizeof(subst_output))))
+    {
+        out->next = NULL;
+        out->data = NULL;
+        out->len = ps->run_commands ? command_output(body, (size_t) (s - body), &out->data) : 0;
+        *ps->outputs_end = out;
+        ps->outputs_end = &out->next;
+    }
+
+    *output = out ? out->data : NULL;
+    *len = out ? out->len : 0;
+    return s + 1;
+}
+
+/* Write '\0' before the next symbol of value dst of *n symbols, if *split is true, and count the new field. */
+static void put_separator(char *dst, size_t *n, int *split, int *fields)
+{
+    if (!*split)
+        return;
+
+    if (dst)
+        dst[*n] = '\0';
+    (*n)++;
+    (*fields)++;
+    *split = 0;
+}
+
+/* Free outputs of command substitutions of current word. */
+static void free_outputs(parser *ps)
+{
+    for (subst_output *out = ps->outputs; out; out = out->next)
+        free(out->data);
+    ps->outputs = ps->next_output = NULL;
+    ps->outputs_end = &ps->outputs;
+}
+
+/* Add count fields of value, which are separated by '\0', to argv from index i. Return index after them. */
+static int split_fields(char **argv, int i, char *value, int count)
+{
+    /* Fields stay in value, so splitting doesn't copy them. */
+    for (; count > 0; --count, value += strlen(value) + 1)
+        argv[i++] = value;
+
+    return i;
+}
+
+/* Cut word from s. Set *value to its value or NULL, if value is empty.
+   If '\0' was written over the symbol after word, it's saved to *cut.
+   Set *dynamic to 1, if word has expansions, which may change.
+   If fields isn't NULL, value is split like in scan_word and *fields is set to count of its fields.
+   Return pointer to the end of word. Or NULL, if word is invalid. */
+static char *parse_word(parser *ps, char *s, char **value, char *cut, int *dynamic, int *fields)
+{
+    char *end;
+    size_t len;
+    int expand, quoted;
+
+    *dynamic = 0;
+    if (fields)
+        *fields = 1;
+    if (*s == '%')
+    {
+        /* Symbol of job list index. It's replaced by negative pgid of job. */
+        char *index_end;
+        errno = 0;
+        long index = strtol(s + 1, &index_end, 10);
+
+        if (errno == ERANGE || index_end == s + 1 || !is_word_end(*index_end))
+        {
+            fprintf(stderr, "Invalid job index!\n");
+            return NULL;
         }
+
+        /* Try to find job by parsed index. */
+        job *j = find_job_jid((int) index);
+        if (!j)
+        {
+            fprintf(stderr, "%%%ld: no such job!\n", index);
+            return NULL;
+        }
+
+        char str[16];
+        snprintf(str, sizeof(str), "%d", -j->pgid);
+        *dynamic = ps->dynamic = 1;
+        *value = arena_strndup(ps->mem, str, strlen(str));
+        return *value ? index_end : NULL;
+    }
+
+    /* Commands of substitutions run at the first scan, their outputs are written at the second one. */
+    free_outputs(ps);
+    end = scan_word(ps, s, NULL, &len, &expand, &quoted, fields);
+    if (!end)
+    {
+        free_outputs(ps);
+        return NULL;
     }
-    if ((cmds[ncmds - 1].cmdflag & OUTPIP) && nargs == 0)
+    if (expand)
+        *dynamic = ps->dynamic = 1;
+
+    if (!len && !quoted)
     {
-        fprintf(stderr, "Syntax error!\n");
-        return (-1);
+        free_outputs(ps);
+        *value = NULL;
+        return end;
     }
 
-    return (rval);
+    if (expand)
+    {
+        /* Expanded value may be longer than word, so it's written to arena. */
+        if ((*value = arena_alloc(ps->mem, len + 1)))
+        {
+            ps->next_output = ps->outputs;
+            scan_word(ps, s, *value, &len, &expand, &quoted, fields);
+            (*value)[len] = '\0';
+        }
+        free_outputs(ps);
+        return *value ? end : NULL;
+    }
+
+    /* Value isn't longer than word, so it's written in place. */
+    if (quoted)
+        scan_word(ps, s, s, &len, &expand, &quoted, fields);
+    *value = s;
+
+    /* Spaces after word aren't needed, other symbols are saved. */
+    if (s + len == end && *end != ' ' && *end != '\t')
+        *cut = *end;
+    else if (s + len == end && *end)
+        end++;
+    s[len] = '\0';
+
+    return end;
 }
 
-/* Skip all spaces from begin of string s. */
-static char *blank_skip(register char *s)
+/* Start new command of current pipeline. Return 0, if success. */
+static int begin_command(parser *ps)
 {
-    while (isspace(*s) && *s) ++s;
-    return (s);
+    ast_command *cmd = arena_alloc(ps->mem, sizeof(ast_command));
+
+    if (!cmd)
+        return -1;
+    memset(cmd, 0, sizeof(ast_command));
+
+    if (!ps->pl)
+    {
+        if (!(ps->pl = arena_alloc(ps->mem, sizeof(pipeline))))
+            return -1;
+        memset(ps->pl, 0, sizeof(pipeline));
+        ps->pl->first_command = cmd;
+    } else
+        ps->cmd->next = cmd;
+
+    ps->cmd = cmd;
+    ps->last_word = NULL;
+    ps->last_redirect = NULL;
+
+    return 0;
+}
+
+/* Finish current command. Return 0, if success. */
+static int end_command(parser *ps)
+{
+    ast_command *cmd = ps->cmd;
+    word *w;
+    int i = 0;
+
+    if (!(cmd->argv = arena_alloc(ps->mem, (size_t) (cmd->argc + 1) * sizeof(char *))))
+        return -1;
+
+    for (w = cmd->words; w; w = w->next)
+        if (w->text)
+            i = split_fields(cmd->argv, i, w->text, w->fields);
+    cmd->argv[i] = NULL;
+
+    return 0;
+}
+
+/* Expand dynamic words and redirections of copied command cmd again.
+   Return 0, if success. */
+static int expand_command(parser *ps, ast_command *cmd)
+{
+    word *w;
+    redirect *r, *r_copy, *last = NULL;
+    substitution *sub, *sub_copy, *last_sub = NULL;
+    char **values, cut;
+    int count = 0, dynamic, *fields, i, argc = 0;
+
+    for (w = cmd->words; w; w = w->next)
+        count++;
+    if (!(values = arena_alloc(ps->mem, (size_t) (count + 1) * sizeof(char *))) ||
+        !(fields = arena_alloc(ps->mem, (size_t) (count + 1) * sizeof(int))))
+        return -1;
+
+    /* Words of copy stay ones of template, only argv is new. Its size is known after splitting. */
+    cmd->argc = 0;
+    for (w = cmd->words, i = 0; w; w = w->next, ++i)
+    {
+        values[i] = w->text;
+        fields[i] = w->fields;
+        if (w->dynamic && !parse_word(ps, ps->line + w->offset, &values[i], &cut, &dynamic, &fields[i]))
+            return -1;
+        if (values[i])
+            cmd->argc += fields[i];
+    }
+
+    if (!(cmd->argv = arena_alloc(ps->mem, (size_t) (cmd->argc + 1) * sizeof(char *))))
+        return -1;
+    for (i = 0; i < count; ++i)
+        if (values[i])
+            argc = split_fields(cmd->argv, argc, values[i], fields[i]);
+    cmd->argv[argc] = NULL;
+
+    /* Substituted commands are copied with their expansions, their words stay in argv of copy. */
+    for (sub = cmd->substs, cmd->substs = NULL; sub; sub = sub->next)
+    {
+        if (!(sub_copy = arena_alloc(ps->mem, sizeof(substitution))))
+            return -1;
+        *sub_copy = *sub;
+        sub_copy->next = NULL;
+        if (sub->command->dynamic)
+        {
+            if (!(sub_copy->command = arena_alloc(ps->mem, sizeof(ast_command))))
+                return -1;
+            *sub_copy->command = *sub->command;
+            if (expand_command(ps, sub_copy->command))
+                return -1;
+        }
+
+        if (last_sub)
+            last_sub->next = sub_copy;
+        else
+            cmd->substs = sub_copy;
+        last_sub = sub_copy;
+    }
+
+    /* Redirections are copied, only if they have expansions. */
+    for (r = cmd->redirects; r && !r->dynamic; r = r->next);
+    if (!r)
+        return 0;
+
+    for (r = cmd->redirects, cmd->redirects = NULL; r; r = r->next)
+    {
+        if (!(r_copy = arena_alloc(ps->mem, sizeof(redirect))))
+            return -1;
+        *r_copy = *r;
+        r_copy->next = NULL;
+        if (r->dynamic && (!parse_word(ps, ps->line + r->offset, &r_copy->file, &cut, &dynamic, NULL) || !r_copy->file))
+            return -1;
+
+        if (last)
+            last->next = r_copy;
+        else
+            cmd->redirects = r_copy;
+        last = r_copy;
+    }
+
+    return 0;
+}
+
+/* Finish current pipeline, which ends at offset end. Return 0, if success. */
+static int end_pipeline(parser *ps, size_t end, int background)
+{
+    size_t begin = ps->pl_begin;
+
+    /* Skip empty pipelines. */
+    if (!ps->pl)
+        return 0;
+
+    if (end_command(ps))
+        return -1;
+
+    /* Text of pipeline without spaces around. */
+    while (begin < end && isspace((unsigned char) ps->source[begin]))
+        begin++;
+    while (end > begin && isspace((unsigned char) ps->source[end - 1]))
+        end--;
+    if (!(ps->pl->text = arena_strndup(ps->mem, ps->source + begin, end - begin)))
+        return -1;
+    ps->pl->background = background;
+
+    /* Append pipeline to list. */
+    if (ps->last_pipeline)
+        ps->last_pipeline->next = ps->pl;
+    else
+        ps->list->first_pipeline = ps->pl;
+    ps->last_pipeline = ps->pl;
+
+    ps->pl = NULL;
+    ps->cmd = NULL;
+
+    return 0;
+}
+
+/* Add process substitution of kind to current command and start its command.
+   Its path becomes file of redirection target, if it isn't NULL, or word of command. Return 0, if success. */
+static int begin_substitution(parser *ps, int kind, redirect *target)
+{
+    substitution *sub, **link;
+    ast_command *cmd;
+    word *w;
+
+    if ((!ps->cmd && begin_command(ps)) ||
+        !(sub = arena_alloc(ps->mem, sizeof(substitution))) ||
+        !(cmd = arena_alloc(ps->mem, sizeof(ast_command))))
+        return -1;
+
+    /* Word of substitution is unique string, so it's found in argv or redirections by pointer after expansions. */
+    if (!(sub->arg = arena_strndup(ps->mem, kind == REDIR_IN ? "<()" : ">()", 3)))
+        return -1;
+    if (target)
+        target->file = sub->arg;
+    else
+    {
+        if (!(w = arena_alloc(ps->mem, sizeof(word))))
+            return -1;
+        w->next = NULL;
+        w->text = sub->arg;
+        w->fields = 1;
+        w->dynamic = 0;
+        w->offset = 0;
+        if (ps->last_word)
+            ps->last_word->next = w;
+        else
+            ps->cmd->words = w;
+        ps->last_word = w;
+        ps->cmd->argc++;
+    }
+
+    memset(cmd, 0, sizeof(ast_command));
+    sub->next = NULL;
+    sub->kind = kind;
+    sub->command = cmd;
+    for (link = &ps->cmd->substs; *link; link = &(*link)->next);
+    *link = sub;
+
+    /* Words of substituted command are added to it until the closing parenthesis. */
+    ps->outer[ps->depth++] = ps->cmd;
+    ps->cmd = cmd;
+    ps->last_word = NULL;
+    ps->last_redirect = NULL;
+
+    return 0;
+}
+
+/* Finish command of the innermost process substitution and continue its owner. Return 0, if success. */
+static int end_substitution(parser *ps)
+{
+    ast_command *cmd = ps->cmd;
+
+    if (end_command(ps))
+        return -1;
+
+    ps->cmd = ps->outer[--ps->depth];
+    ps->cmd->dynamic |= cmd->dynamic;
+
+    for (ps->last_word = ps->cmd->words; ps->last_word && ps->last_word->next; ps->last_word = ps->last_word->next);
+    for (ps->last_redirect = ps->cmd->redirects; ps->last_redirect && ps->last_redirect->next;
+         ps->last_redirect = ps->last_redirect->next);
+
+    return 0;
 }
@@ -4,13 +4,41 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include "ast.h"
 
-/* Parse input line. Return -1, if was syntax error.
-   Or 1, if parsing was successful.
-   All args must be non null. */
-int parse_line(char *line, char *varline);
+/* Parse input line to list of pipelines in new arena.
+   Command substitutions aren't run, their words are dynamic, so expand_pipeline runs them.
+   Return NULL, if was syntax error.
+   line must be non null. */
+cmd_list *parse_line(const char *line, size_t len);
 
-/* Read line from input. Return count of read symbols. */
-ssize_t prompt_line(char *line, int sizeline);
+/* Instantiate cached list tmpl in arena mem, which keeps arena of tmpl.
+   Pipelines are shared with tmpl, expand_pipeline expands their dynamic words before launch of each of them.
+   Return NULL, if failed. */
+cmd_list *expand_list(const cmd_list *tmpl, arena *mem);
+
+/* Expand dynamic words of pipeline pl of list again from source of list: variables, job indexes
+   and command substitutions, which run now, so they see effects of previous pipelines of list.
+   Return copy of pl in arena of list, or pl, if it hasn't dynamic words. Or NULL, if expansion failed. */
+pipeline *expand_pipeline(cmd_list *list, pipeline *pl);
+
+/* Read next logical line of input. *line points to it in input buffer until the next call.
+   Line continuations are replaced by spaces.
+   Return count of symbols in line, 0 on end of input. Or -1, if reading failed. */
+ssize_t prompt_line(char **line);
+
+/* Read commands from descriptor fd instead of terminal in non-interactive mode. */
+void set_input_fd(int fd);
+
+/* Read commands from string s of len symbols in non-interactive mode.
+   Return 0, if success. */
+int set_input_string(const char *s, size_t len);
+
+/* Return unread input to descriptor, so children of shell read STDIN from the next line.
+   It's possible only for seekable STDIN. */
+void sync_input();
+
+/* Free input buffer. */
+void close_input();
 
 #endif
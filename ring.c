@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ring.h"
+
+#define RING_LINE 64   /* size of cache line, counters of different threads are kept on separate lines */
+#define RING_SPIN 128  /* checks of ring before the thread falls asleep */
+
+struct ring
+{
+    _Alignas(RING_LINE) atomic_size_t head;    /* count of written bytes, changed by writer only */
+    _Alignas(RING_LINE) atomic_size_t tail;    /* count of read bytes, changed by reader only */
+    _Alignas(RING_LINE) atomic_int closed;     /* RING_READER and RING_WRITER bits of closed ends */
+    atomic_int sleepers;                       /* count of threads, which wait on cond */
+    pthread_mutex_t lock;                      /* lock of cond */
+    pthread_cond_t cond;                       /* signalled, when waiting thread may continue */
+    size_t size;                               /* capacity of data, power of 2 */
+    char *data;                                /* buffered bytes */
+};
+
+/* Return true if end of ring r may continue: writer has free space or reader has data,
+   or the other end is closed. */
+static int ring_ready(ring *r, int end);
+
+/* Wait until end of ring r is ready. Spin at first, because the other end is usually running. */
+static void ring_wait(ring *r, int end);
+
+/* Wake the other end of ring r, if it sleeps. */
+static void ring_wake(ring *r);
+
+/* Create ring buffer of size bytes with both ends opened. size must be power of 2.
+   Return NULL, if memory wasn't allocated. */
+ring *ring_create(size_t size)
+{
+    assert(size && !(size & (size - 1)));
+
+    ring *r = aligned_alloc(RING_LINE, (sizeof(ring) + RING_LINE - 1) / RING_LINE * RING_LINE);
+    if (!r)
+        return NULL;
+
+    if (!(r->data = malloc(size)))
+    {
+        free(r);
+        return NULL;
+    }
+    if (pthread_mutex_init(&r->lock, NULL) || pthread_cond_init(&r->cond, NULL))
+    {
+        free(r->data);
+        free(r);
+        return NULL;
+    }
+
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->closed, 0);
+    atomic_init(&r->sleepers, 0);
+    r->size = size;
+
+    return r;
+}
+
+/* Wait for free space of ring r and set *data to it.
+   Return size of continuous free space. Or 0, if reader closed its end. */
+size_t ring_write_begin(ring *r, char **data)
+{
+    ring_wait(r, RING_WRITER);
+    if (atomic_load(&r->closed) & RING_READER)
+        return 0;
+
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    size_t offset = head & (r->size - 1);
+    size_t free_size = r->size - (head - tail);
+
+    *data = r->data + offset;
+    return free_size < r->size - offset ? free_size : r->size - offset;
+}
+
+/* Pass len bytes, written to space of ring_write_begin, to reader. */
+void ring_write_end(ring *r, size_t len)
+{
+    if (!len)
+        return;
+    atomic_fetch_add(&r->head, len);
+    ring_wake(r);
+}
+
+/* Write all len bytes of data to ring r. Return 0, if success. Or EPIPE, if reader closed its end. */
+int ring_write(ring *r, const char *data, size_t len)
+{
+    char *space;
+    size_t n;
+
+    while (len)
+    {
+        if (!(n = ring_write_begin(r, &space)))
+            return EPIPE;
+        if (n > len)
+            n = len;
+        memcpy(space, data, n);
+        ring_write_end(r, n);
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Write all len bytes of data to ring r without waiting.
+   Return 0, if success. Or EAGAIN, if free space is less than len, or EPIPE, if reader closed its end. */
+int ring_try_write(ring *r, const char *data, size_t len)
+{
+    if (atomic_load(&r->closed) & RING_READER)
+        return EPIPE;
+
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    size_t offset = head & (r->size - 1);
+
+    if (r->size - (head - tail) < len)
+        return EAGAIN;
+
+    /* Data may wrap around the end of buffer. */
+    size_t first = len < r->size - offset ? len : r->size - offset;
+    memcpy(r->data + offset, data, first);
+    memcpy(r->data, data + first, len - first);
+    ring_write_end(r, len);
+
+    return 0;
+}
+
+/* Wait for data of ring r and set *data to it.
+   Return size of continuous data. Or 0, if writer closed its end and all data was read. */
+size_t ring_read_begin(ring *r, const char **data)
+{
+    ring_wait(r, RING_READER);
+
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t offset = tail & (r->size - 1);
+    size_t used = head - tail;
+
+    /* Data, written before closing, is read anyway. */
+    *data = r->data + offset;
+    return used < r->size - offset ? used : r->size - offset;
+}
+
+/* Free len bytes, read from data of ring_read_begin, for writer. */
+void ring_read_end(ring *r, size_t len)
+{
+    if (!len)
+        return;
+    atomic_fetch_add(&r->tail, len);
+    ring_wake(r);
+}
+
+/* Close end (RING_READER or RING_WRITER) of ring r. Ring is freed after both ends are closed. */
+void ring_close(ring *r, int end)
+{
+    assert(end == RING_READER || end == RING_WRITER);
+
+    /* The other end may free the ring right after its close, so this end
+       doesn't touch the ring after unlock. */
+    pthread_mutex_lock(&r->lock);
+    int closed = atomic_fetch_or(&r->closed, end) | end;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+
+    if (closed != (RING_READER | RING_WRITER))
+        return;
+
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    free(r->data);
+    free(r);
+}
+
+/* Return true if end of ring r may continue: writer has free space or reader has data,
+   or the other end is closed. */
+static int ring_ready(ring *r, int end)
+{
+    size_t used = atomic_load(&r->head) - atomic_load(&r->tail);
+
+    if (atomic_load(&r->closed) & (end == RING_WRITER ? RING_READER : RING_WRITER))
+        return 1;
+    return end == RING_WRITER ? used < r->size : used > 0;
+}
+
+/* Wait until end of ring r is ready. Spin at first, because the other end is usually running. */
+static void ring_wait(ring *r, int end)
+{
+    for (int i = 0; i < RING_SPIN; ++i)
+        if (ring_ready(r, end))
+            return;
+
+    /* The other end checks sleepers after its change, so the change isn't missed:
+       either it sees sleepers, or ring_ready sees the change. */
+    pthread_mutex_lock(&r->lock);
+    atomic_fetch_add(&r->sleepers, 1);
+    while (!ring_ready(r, end))
+        pthread_cond_wait(&r->cond, &r->lock);
+    atomic_fetch_sub(&r->sleepers, 1);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* Wake the other end of ring r, if it sleeps. */
+static void ring_wake(ring *r)
+{
+    if (!atomic_load(&r->sleepers))
+        return;
+
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
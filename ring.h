@@ -0,0 +1,42 @@
+#ifndef UNIX_SHELL_RING_H
+#define UNIX_SHELL_RING_H
+
+#include <stddef.h>
+
+#define RING_SIZE   (256 * 1024) /* capacity of ring buffer between utilities, power of 2 */
+#define RING_READER 1            /* reading end of ring buffer */
+#define RING_WRITER 2            /* writing end of ring buffer */
+
+/* Buffer in memory, which passes data from one writer thread to one reader thread
+   like a pipe. Threads wait for each other only, when the buffer is empty or full. */
+typedef struct ring ring;
+
+/* Create ring buffer of size bytes with both ends opened. size must be power of 2.
+   Return NULL, if memory wasn't allocated. */
+ring *ring_create(size_t size);
+
+/* Wait for free space of ring r and set *data to it.
+   Return size of continuous free space. Or 0, if reader closed its end. */
+size_t ring_write_begin(ring *r, char **data);
+
+/* Pass len bytes, written to space of ring_write_begin, to reader. */
+void ring_write_end(ring *r, size_t len);
+
+/* Write all len bytes of data to ring r. Return 0, if success. Or EPIPE, if reader closed its end. */
+int ring_write(ring *r, const char *data, size_t len);
+
+/* Write all len bytes of data to ring r without waiting.
+   Return 0, if success. Or EAGAIN, if free space is less than len, or EPIPE, if reader closed its end. */
+int ring_try_write(ring *r, const char *data, size_t len);
+
+/* Wait for data of ring r and set *data to it.
+   Return size of continuous data. Or 0, if writer closed its end and all data was read. */
+size_t ring_read_begin(ring *r, const char **data);
+
+/* Free len bytes, read from data of ring_read_begin, for writer. */
+void ring_read_end(ring *r, size_t len);
+
+/* Close end (RING_READER or RING_WRITER) of ring r. Ring is freed after both ends are closed. */
+void ring_close(ring *r, int end);
+
+#endif
@@ -1,96 +1,208 @@
 #include "shell.h"
+#include "spawn.h"
+#include "options.h"
+#include "pathcache.h"
+#include "events.h"
+#include "parsecache.h"
+#include "coreutils.h"
+#include "workers.h"
+#include "plugins.h"
+#include "stats.h"
+#include "trace.h"
+#include "monitor.h"
+#include "board.h"
+#include "capture.h"
 
 /* Initialize shell process. */
 void init_shell(char *argv[]);
 
+/* Parse shell arguments. Exit from shell, if arguments are invalid. */
+void parse_args(int argc, char *argv[]);
+
 /* Prints invite_string to STDOUT.
    Return 1, if print was successful.
    Or 0, if print failed. After fail shell will be closed. */
 int get_invite();
 
+/* Expand and run pipelines of list one by one, so expansions of each see effects of previous ones. */
+void run_list(cmd_list *list);
+
+/* Create, launch and wait, if necessary, job of pipeline. */
+void run_pipeline(pipeline *pl, arena *mem);
+
 /* Launch and wait, if necessary, new job. */
 void launch_job(int foreground);
 
-/* Used for executing command in forked process. */
-void launch_process(process *p, pid_t pgid, int infile_local, int outfile_local, int errfile_local, int foreground);
+/* Open redirections of process p. Replace *infile_local and *outfile_local by opened files.
+   Several targets of output, including pipe to the next command, get it through fanout of current_job.
+   Return 0, if success. Or -1, if file can't be opened. */
+int open_redirects(process *p, int *infile_local, int *outfile_local);
+
+/* Launch process substitutions of process p of job j before p and replace their words in args of p
+   by paths of their pipes. Utilities run on threads, if threads is true. Return true if some of them run in child processes. */
+int launch_substitutions(job *j, process *p, int foreground, int threads);
+
+/* Let children of process p inherit ends of pipes of its substitutions, if inherit is true. */
+void inherit_substitutions(process *p, int inherit);
+
+/* Check process p has redirection of input, if input is true, or of output otherwise. */
+int redirects_stream(process *p, int input);
+
+/* Check utility of process p would wait for terminal input from infile_local. */
+int utility_reads_terminal(process *p, int infile_local);
+
+/* Check utility of process p completes without waiting for a writer or a device, when it reads infile_local. */
+int utility_is_bounded(process *p, int infile_local);
+
+/* Start process p of job j from executable path with given streams.
+   Utility of shell is started, if path is NULL. */
+void start_process(job *j, process *p, const char *path, int infile_local, int outfile_local, int foreground);
+
+/* Used for executing command from executable path in forked process.
+   Utility of shell is executed, if path is NULL. */
+void launch_process(process *p, const char *path, pid_t pgid, int infile_local, int outfile_local, int errfile_local, int foreground);
+
+/* Close descriptors of shell, which are closed on exec, in forked child, which runs utility without exec. */
+void close_exec_descriptors();
+
+extern char **environ;
 
 char hostname[HOST_NAME_MAX];  /* name of host */
 char username[LOGIN_NAME_MAX]; /* user name */
 char invite_string[HOST_NAME_MAX + LOGIN_NAME_MAX + MAX_DIRECTORY_SIZE + 5]; /* invite string */
-char line[READ_LINE_SIZE]; /* line reading buffer */
-char varline[READ_LINE_SIZE * 4]; /* buffer line for values of variables from parsing input string */
 char dir[MAX_DIRECTORY_SIZE]; /* directory string buffer for printing to invite_string */
+static int batch_input = 0;    /* true if commands are read from script or string of shell arguments */
+static int launch_gate[2] = {-1, -1}; /* pipe, which holds forked child until its counters are opened */
+static unsigned long long launch_begin = 0; /* time of the end of fill_job for stats of launch_job */
+static int capture_fd = -1;    /* pipe of running command substitution, which its jobs write instead of STDOUT, or -1 */
 
-int main(__attribute__((unused)) int argc, char *argv[])
+int main(int argc, char *argv[])
 {
     /* INIT SHELL */
+    parse_args(argc, argv);
     init_shell(argv);
 
-    int ncmds;
+    char *line;
+    ssize_t len;
+    cmd_list *list;
+    arena *mem;
+    unsigned long long phase_begin;
 
     /* Main cycle. First, shell makes an invitation, then waits for the line to be entered. */
-    while (get_invite() && prompt_line(line, sizeof(line)) > 0)
+    while (get_invite() && (phase_begin = stat_now(), len = prompt_line(&line)) > 0)
     {
         /* End of waiting for input from the terminal. */
         invite_mode = 0;
+        phase_begin = stat_since(STAT_PROMPT, phase_begin);
 
-        /* Parse line to cmds[] array. */
-        if ((ncmds = parse_line(line, varline)) <= 0)
-            continue;
-
-        /* Create new job. */
-        if (!(current_job = create_new_job(0, line)))
+        /* Parse line to list of pipelines. */
+        list = cached_parse_line(line, (size_t) len);
+        stat_since(STAT_PARSE, phase_begin);
+        if (!list)
         {
-            fprintf(stderr, "Can't create job!");
-            fflush(stderr);
-            shell_exit(EXIT_FAILURE);
+            last_status = EXIT_FAILURE;
+            continue;
         }
 
-        /* Parse cmds[] data to current_job. */
-        fill_job(&current_job, ncmds);
+        /* Jobs share memory of line, so it's freed after the last of them. */
+        mem = list->mem;
+        run_list(list);
+        arena_release(mem);
+    }
+    shell_exit(last_status);
+
+    return 0;
+}
 
-        /* If parsing was failed. */
-        if(!current_job)
-            continue;
+/* Expand and run pipelines of list one by one, so expansions of each see effects of previous ones. */
+void run_list(cmd_list *list)
+{
+    pipeline *pl, *expanded;
 
-        /* Add new current_job to job list. */
-        add_job(current_job);
+    for (pl = get_option(OPT_NOEXEC) ? NULL : list->first_pipeline; pl; pl = pl->next)
+        if ((expanded = expand_pipeline(list, pl)))
+            run_pipeline(expanded, list->mem);
+        else
+            last_status = EXIT_FAILURE;
+}
 
-        /* Run current_job with set bkgrnd flag.
-           The bkgrnd value was obtained when parsing the input line. */
-        launch_job(!bkgrnd);
+/* Create, launch and wait, if necessary, job of pipeline. */
+void run_pipeline(pipeline *pl, arena *mem)
+{
+    bkgrnd = pl->background;
 
-        /* Current job may be removed, if job contains inner commands. */
-        if(current_job)
+    /* Create new job. */
+    if (!(current_job = create_new_job(0, pl->text, mem)))
+    {
+        fprintf(stderr, "Can't create job!");
+        fflush(stderr);
+        shell_exit(EXIT_FAILURE);
+    }
+    if (capture_fd != -1)
+        current_job->stdout_file = capture_fd;
+
+    /* Create processes of current_job from pipeline. */
+    unsigned long long fill_begin = stat_now();
+    fill_job(&current_job, pl);
+    launch_begin = stat_since(STAT_FILL, fill_begin);
+
+    /* If parsing was failed. */
+    if(!current_job)
+    {
+        last_status = EXIT_FAILURE;
+        return;
+    }
+
+    /* Add new current_job to job list. */
+    add_job(current_job);
+
+    /* Run current_job with set bkgrnd flag.
+       The bkgrnd value was obtained when parsing the input line. */
+    launch_job(!bkgrnd);
+
+    /* Current job may be removed, if job contains inner commands. */
+    if(current_job)
+    {
+        /* Check state of job after waiting. */
+        if(!bkgrnd && job_is_completed(current_job))
         {
-            /* Check state of job after waiting. */
-            if(!bkgrnd && job_is_completed(current_job))
-            {
-                /* Notify all completed or stopped jobs after executing current_job. */
-                do_job_notification(0);
+            last_status = job_exit_status(current_job);
 
-                /* We no longer need this job. */
-                remove_job(current_job->pgid);
-            }else if(!bkgrnd && job_is_stopped(current_job))
-            {
-                /* Notify if current_job is stopped. */
-                current_job->notified = 1;
-                format_job_info(current_job, "stopped");
-                fprintf(stdout, "\n");
-                fflush(stdout);
-            }else if(bkgrnd)
-            {
-                /* Show index of new background task. */
-                current_job->notified = 1;
-                format_job_info(current_job, NULL);
-                fprintf(stdout, "\n");
-                fflush(stdout);
-            }
+            /* Files of several redirections get all output before the next command. */
+            wait_fanouts(current_job->fanouts);
+
+            /* Resources of job with time or perfstat prefix and meters of its pipes are reported after its completion. */
+            report_job(current_job);
+
+            /* Notify all completed or stopped jobs after executing current_job. */
+            do_job_notification(0);
+
+            /* We no longer need this job. */
+            remove_job(current_job->pgid);
+        }else if(!bkgrnd && job_is_stopped(current_job))
+        {
+            last_status = 128 + SIGTSTP;
+
+            /* Notify if current_job is stopped. */
+            current_job->notified = 1;
+            format_job_info(current_job, "stopped");
+            fprintf(stdout, "\n");
+            fflush(stdout);
+        }else if(bkgrnd && shell_is_interactive)
+        {
+            /* Show index of new background task. */
+            current_job->notified = 1;
+            format_job_info(current_job, NULL);
+            fprintf(stdout, "\n");
+            fflush(stdout);
         }
+
+        if(bkgrnd)
+            last_status = EXIT_SUCCESS;
     }
-    shell_exit(EXIT_SUCCESS);
 
-    return 0;
+    /* No foreground job now, so event loop may notify about any job. */
+    current_job = NULL;
 }
 
 /* Prints invite_string to STDOUT.
@@ -98,6 +210,10 @@ int main(__attribute__((unused)) int argc, char *argv[])
    Or 0, if print failed. After fail shell will be closed. */
 int get_invite()
 {
+    /* Scripts don't need invitation. */
+    if (!shell_is_interactive)
+        return 1;
+
     /* Begin to wait input.
        At this moment SIGCHLD may print notifications of stopped or terminated processes. */
     invite_mode = 1;
@@ -106,13 +222,63 @@ int get_invite()
     return flag && (fflush(stdout) != EOF);
 }
 
+/* Parse shell arguments. Exit from shell, if arguments are invalid. */
+void parse_args(int argc, char *argv[])
+{
+    int fd;
+
+    for (int i = 1; i < argc && !batch_input; ++i)
+    {
+        /* -o name[=value] sets option, +o name resets it. */
+        if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "+o")) && i + 1 < argc)
+        {
+            if (set_option(argv[i + 1], argv[i][0] == '-'))
+            {
+                fprintf(stderr, "%s: Invalid option!\n", argv[i + 1]);
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+        {
+            /* Execute commands from string. */
+            if (set_input_string(argv[i + 1], strlen(argv[i + 1])))
+                exit(EXIT_FAILURE);
+            batch_input = 1;
+        } else if (argv[i][0] != '-' && argv[i][0] != '+')
+        {
+            /* Execute commands from script file. */
+            if ((fd = open(argv[i], O_RDONLY | O_CLOEXEC)) == -1)
+            {
+                perror(argv[i]);
+                exit(127);
+            }
+            set_input_fd(fd);
+            batch_input = 1;
+        } else
+        {
+            fprintf(stderr, "Usage: %s [-o option[=value]] [+o option] [-c command | script]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
 /* Initialize shell process. */
 void init_shell(char *argv[])
 {
     shell_terminal = STDIN_FILENO;
 
+    /* Commands of jobs are looked up in registry of builtins. */
+    if (register_builtins(inner_builtins) || register_builtins(util_builtins))
+    {
+        perror("malloc");
+        shell_exit(EXIT_FAILURE);
+    }
+
     /* See if we are running interactively. */
-    int shell_is_interactive = isatty(shell_terminal);
+    shell_is_interactive = !batch_input && isatty(shell_terminal);
+
+    /* Utilities on threads of shell get EPIPE instead of killing the shell, when their reader exits. */
+    set_signal_handler(SIGPIPE, SIG_IGN);
     if (shell_is_interactive)
     {
         /* Loop until we are in the foreground. */
@@ -126,7 +292,10 @@ void init_shell(char *argv[])
         set_signal_handler(SIGTTIN, SIG_IGN);
         set_signal_handler(SIGTTOU, SIG_IGN);
         set_signal_handler(SIGTERM, SIG_IGN);
-        set_signal_handler(SIGCHLD, notify_child);
+
+        /* Children are reaped in main loop, not in signal handler. */
+        if (init_event_loop())
+            shell_exit(EXIT_FAILURE);
 
         /* Put ourselves in our own process group. */
         shell_pgid = getpid();
@@ -141,7 +310,7 @@ void init_shell(char *argv[])
         tcgetattr(shell_terminal, &shell_tmodes);
 
         /* Init home location of shell. */
-        init_home(argv[0]);
+        init_home(argv[0], 1);
 
         /* Init invite_string. */
         if(gethostname(hostname, HOST_NAME_MAX))
@@ -156,18 +325,24 @@ void init_shell(char *argv[])
             strncpy(username, "unknown", strlen("unknown"));
             username[strlen("unknown")] = '\0';
         }
-        get_dir_prompt(dir);
-        sprintf(invite_string, "%s@%s:%s$ ", username, hostname, dir);
+        update_invite_string();
     } else
     {
-        fprintf(stderr, "Can't run shell: shell not in foreground!\n");
-        fflush(stderr);
-        shell_exit(EXIT_FAILURE);
+        /* Run commands from script, string or STDIN without terminal and job control.
+           Jobs stay in the shell process group, so they don't need the terminal. */
+        shell_pgid = getpgrp();
+
+        if (init_event_loop())
+            shell_exit(EXIT_FAILURE);
+
+        /* Shell stays in working directory. */
+        init_home(argv[0], 0);
     }
 }
 
-/* Used for executing command in forked process. */
-void launch_process(process *p, pid_t pgid, int infile_local, int outfile_local, int errfile_local, int foreground)
+/* Used for executing command from executable path in forked process.
+   Utility of shell is executed, if path is NULL. */
+void launch_process(process *p, const char *path, pid_t pgid, int infile_local, int outfile_local, int errfile_local, int foreground)
 {
     /* Put the process into the process group and give the process group
        the terminal, if appropriate.
@@ -176,10 +351,13 @@ void launch_process(process *p, pid_t pgid, int infile_local, int outfile_local,
     pid_t pid = getpid();
     if (pgid == 0)
         pgid = pid;
-    setpgid(pid, pgid);
 
-    if (foreground)
-        tcsetpgrp(shell_terminal, pgid);
+    if (shell_is_interactive)
+    {
+        setpgid(pid, pgid);
+        if (foreground)
+            tcsetpgrp(shell_terminal, pgid);
+    }
 
     /* Set the handling for job control signals back to the default. */
     set_signal_handler(SIGINT, SIG_DFL);
@@ -191,6 +369,13 @@ void launch_process(process *p, pid_t pgid, int infile_local, int outfile_local,
     set_signal_handler(SIGPIPE, SIG_DFL);
     set_signal_handler(SIGTERM, SIG_DFL);
 
+    board_detach();
+
+    /* Unblock SIGCHLD, which is blocked for event loop of shell. */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+
     /* Set the standard input/output channels of the new process. */
     if (infile_local != STDIN_FILENO)
     {
@@ -226,6 +411,24 @@ void launch_process(process *p, pid_t pgid, int infile_local, int outfile_local,
         close(errfile_local);
     }
 
+    /* Wait until the shell opens counters of perfstat. */
+    if (launch_gate[0] != -1)
+    {
+        char byte;
+
+        close(launch_gate[1]);
+        while (read(launch_gate[0], &byte, 1) < 0 && errno == EINTR);
+        close(launch_gate[0]);
+    }
+
+    /* Utilities of shell don't need exec. Stdio of shell isn't flushed, as after failed exec.
+       Pipes of workers and substitutions aren't kept by child, so their readers get end of file. */
+    if (!path)
+    {
+        close_exec_descriptors();
+        _exit(exec_builtin(p->builtin, (const char **) p->argv, STDIN_FILENO, STDOUT_FILENO));
+    }
+
     /* Save only argv for child. So copy it. */
     unsigned size = 0;
     while (p->argv[size] != NULL)
@@ -261,37 +464,247 @@ void launch_process(process *p, pid_t pgid, int infile_local, int outfile_local,
     free_dir();
 
     /* Exec the new process. Make sure we exit. */
-    execvp(argv[0], argv);
-    fprintf(stderr, "\nexecvp: %s: ", argv[0]);
+    execve(path, argv, environ);
+    fprintf(stderr, "\nexecve: %s: ", argv[0]);
 
     for(unsigned j = 0; j < size; j++)
         free(argv[j]);
 
     free(argv);
 
+    /* Don't flush stdio of shell, because it may move offset of script shared with the shell. */
     perror(NULL);
-    exit(EXIT_FAILURE);
+    _exit(EXIT_FAILURE);
+}
+
+/* Start process p of job j from executable path with given streams.
+   Utility of shell is started, if path is NULL. */
+void start_process(job *j, process *p, const char *path, int infile_local, int outfile_local, int foreground)
+{
+    pid_t pid;
+    int backend;
+    struct timespec spawn_begin;
+    unsigned long long phase_begin;
+
+    /* Child reading commands of shell from STDIN starts after the current line. */
+    if (infile_local == STDIN_FILENO)
+        sync_input();
+
+    clock_gettime(CLOCK_MONOTONIC, &spawn_begin);
+    usage_begin(&p->usage);
+    phase_begin = stat_now();
+
+    /* Counters of perfstat are opened, while forked child waits before exec. */
+    if (j->perf && !(p->perf = arena_alloc(j->mem, sizeof(perf_counters))))
+        perror("malloc");
+    else if (p->perf)
+        perf_clear(p->perf);
+    if (p->perf && pipe(launch_gate) < 0)
+    {
+        perror("pipe");
+        launch_gate[0] = launch_gate[1] = -1;
+    }
+
+    /* Try to launch the child process without copying of shell memory.
+       Utilities of shell have no path, so they need fork. */
+    backend = SPAWN_POSIX;
+    pid = get_option(OPT_SPAWN) && path && !p->perf ? spawn_process(p, path, j->pgid, infile_local, outfile_local,
+                                                                   j->stderr_file, foreground) : -1;
+
+    /* Fork the child processes, if it's needed. */
+    if (pid < 0)
+    {
+        backend = SPAWN_FORK;
+        pid = fork();
+    }
+
+    if (pid == 0)
+        /* This is the child process. */
+        launch_process(p, path, j->pgid, infile_local, outfile_local, j->stderr_file, foreground);
+    else if (pid < 0)
+    {
+        /* The fork failed. */
+        perror("fork");
+        shell_exit(EXIT_FAILURE);
+    } else
+    {
+        /* This is the parent process. */
+        stat_since(STAT_SPAWN, phase_begin);
+        record_spawn_latency(backend, &spawn_begin);
+        set_process_pid(j, p, pid);
+        trace_process_begin(p, backend == SPAWN_POSIX ? "posix_spawn" : "fork");
+        if (shell_is_interactive)
+            setpgid(pid, j->pgid);
+
+        /* Executed program is counted from its exec, utility of shell from opening. */
+        if (p->perf)
+            perf_open(p->perf, pid, path != NULL);
+    }
+
+    /* Closed gate lets child continue. */
+    if (launch_gate[0] != -1)
+    {
+        close(launch_gate[0]);
+        close(launch_gate[1]);
+        launch_gate[0] = launch_gate[1] = -1;
+    }
+}
+
+/* Launch not started batches of job j, while count of running batches is less than argbatch option. */
+void launch_pending_batches(job *j, int foreground)
+{
+    process *p;
+    const char *path;
+    long running = 0;
+
+    for (p = j->first_process; p; p = p->next)
+        if (p->pid && !p->completed)
+            running++;
+
+    for (p = j->first_process; p && running < get_option(OPT_ARGBATCH); p = p->next)
+        if (!p->pid && !p->completed)
+        {
+            /* PATH may be changed by batches, so look up the command again. */
+            if (!(path = find_command_path(p->argv[0])))
+            {
+                p->completed = 1;
+                p->status = 127 << 8;
+                continue;
+            }
+
+            /* Only the first batch creates process group and takes the terminal. */
+            start_process(j, p, path, j->batch_in, j->batch_out, foreground && !j->pgid);
+            running++;
+        }
+
+    /* All batches are launched, so streams aren't needed anymore. */
+    for (p = j->first_process; p; p = p->next)
+        if (!p->pid && !p->completed)
+            return;
+    close(j->batch_in);
+    close(j->batch_out);
+    j->batch_in = j->batch_out = -1;
+}
+
+/* Run commands of text of len symbols and set *data to their output without trailing newlines,
+   which caller frees, or NULL if it's empty. Return length of output.
+   Single utility runs inside shell and writes to memory, other commands write to pipe. */
+size_t command_output(const char *text, size_t len, char **data)
+{
+    cmd_list *list;
+    pipeline *pl;
+    ast_command *cmd;
+    capture *c;
+    process p;
+    int fd, saved, err, single;
+    size_t size;
+
+    *data = NULL;
+    memset(&p, 0, sizeof(process));
+    if (!(list = parse_line(text, len)))
+    {
+        last_status = EXIT_FAILURE;
+        return 0;
+    }
+
+    /* Single pipeline is expanded before the choice, how to get its output. */
+    pl = list->first_pipeline;
+    single = pl && !pl->next && !get_option(OPT_NOEXEC);
+    if (single && !(pl = expand_pipeline(list, pl)))
+    {
+        last_status = EXIT_FAILURE;
+        size = 0;
+    }
+    /* Utility without redirections and background doesn't need a thread or a child to get its output. */
+    else if (single && !pl->background && (cmd = pl->first_command) && !cmd->next && cmd->argc
+             && !cmd->redirects && !cmd->substs && BUILTIN_IS_UTIL(p.builtin = find_builtin(cmd->argv[0]))
+             && (p.argv = cmd->argv, utility_is_bounded(&p, STDIN_FILENO)) && (fd = capture_memory_fd()) != -1)
+    {
+        last_status = exec_builtin(p.builtin, (const char **) cmd->argv, STDIN_FILENO, fd);
+        size = capture_memory(data);
+    } else if ((err = capture_start(&c, &fd)))
+    {
+        fprintf(stderr, "command substitution: %s\n", strerror(err));
+        fflush(stderr);
+        last_status = EXIT_FAILURE;
+        size = 0;
+    } else
+    {
+        /* Jobs of substitution write to pipe of capture, messages of shell go to its STDOUT. */
+        saved = capture_fd;
+        capture_fd = fd;
+        if (single)
+            run_pipeline(pl, list->mem);
+        else
+            run_list(list);
+        capture_fd = saved;
+
+        close(fd);
+        size = capture_finish(c, data);
+    }
+    arena_release(list->mem);
+
+    /* Trailing newlines aren't part of value. */
+    while (size && (*data)[size - 1] == '\n')
+        size--;
+    if (!size)
+    {
+        free(*data);
+        *data = NULL;
+    }
+
+    return size;
 }
 
 /* Launch and wait, if necessary, new job. */
 void launch_job(int foreground)
 {
     process *p, *p_next = NULL;
-    pid_t pid;
     int mypipe[2], infile_local, outfile_local;
-    int inner_cmd_stat;
+    int infile_pipe, outfile_pipe;
+    int inner_cmd_stat, err, edge = 1, single, threads;
+    long pipe_size;
+    unsigned long long run_begin;
+    ring *in_ring = NULL, *out_ring = NULL, *next_ring = NULL;
+    const char *path;
 
     /* Flag for checking the job for inner commands only. */
     int exec_only_inner = 1;
 
     infile_local = current_job->stdin_file;
+    current_job->metered = get_option(OPT_METER) != 0;
+
+    /* Threads have no process group, so they can't be stopped or interrupted by job control
+       and the shell waits for them. Utilities of background jobs and of interactive shell run in child processes. */
+    threads = foreground && !shell_is_interactive;
+    if (get_option(OPT_PIPEGROW))
+        current_job->pipe_grow = 1;
 
     for (p = current_job->first_process;p;)
     {
-        p_next = p->next;
+        p_next = next_stage(p);
+        single = !p_next && p == current_job->first_process;
+
+        /* Substituted commands start before their owner, which gets paths of their pipes. */
+        if (launch_substitutions(current_job, p, foreground, threads))
+            exec_only_inner = 0;
 
+        /* Adjacent utilities on threads of shell pass data through ring buffer instead of pipe. */
+        if (p_next && threads && BUILTIN_USES_RINGS(p->builtin) && BUILTIN_USES_RINGS(p_next->builtin)
+            && (in_ring || !utility_reads_terminal(p, infile_local))
+            && !redirects_stream(p, 0) && !redirects_stream(p_next, 1))
+        {
+            current_job->have_pipe = 1;
+            if (!(out_ring = next_ring = ring_create(RING_SIZE)))
+            {
+                perror("malloc");
+                shell_exit(EXIT_FAILURE);
+            }
+            mypipe[0] = -1;
+            outfile_local = -1;
+        }
         /* Set up pipes, if necessary. */
-        if (p_next)
+        else if (p_next)
         {
             current_job->have_pipe = 1;
             if (pipe(mypipe) < 0)
@@ -299,66 +712,177 @@ void launch_job(int foreground)
                 perror("pipe");
                 shell_exit(EXIT_FAILURE);
             }
+
+            /* Children get only their own ends of the pipe, so the last reader
+               closing its end gives SIGPIPE to the writer. */
+            fcntl(mypipe[0], F_SETFD, FD_CLOEXEC);
+            fcntl(mypipe[1], F_SETFD, FD_CLOEXEC);
             outfile_local = mypipe[1];
+
+            /* Capacity of pipe is set by pipesize= prefix or pipesize option. */
+            pipe_size = current_job->pipe_size ? current_job->pipe_size : get_option(OPT_PIPESIZE);
+            if (pipe_size > 0 && set_pipe_size(mypipe[1], pipe_size) < 0)
+                perror("pipesize");
+
+            /* Metered or growing pipe passes data through relay, which counts it. */
+            if ((current_job->metered || current_job->pipe_grow)
+                && (err = meter_pipe(&current_job->meters, edge, mypipe, pipe_size, current_job->pipe_grow)))
+            {
+                fprintf(stderr, "meter: %s\n", strerror(err));
+                fflush(stderr);
+            }
         } else
             outfile_local = current_job->stdout_file;
 
+        /* Files of redirections replace pipes of process. */
+        infile_pipe = infile_local;
+        outfile_pipe = outfile_local;
+        inherit_substitutions(p, 1);
+        if (open_redirects(p, &infile_local, &outfile_local))
+        {
+            p->stopped = 0;
+            p->completed = 1;
+            p->status = EXIT_FAILURE << 8;
+        }
+        /* Single utility of foreground job runs inside shell, if it can't block on terminal, pipe or device.
+           The shell ignores SIGINT and SIGTSTP, so other utilities run in child processes like programs. */
+        else if (BUILTIN_IS_UTIL(p->builtin) && single && foreground && utility_is_bounded(p, infile_local))
+        {
+            p->stopped = 0;
+            p->completed = 1;
+            usage_begin(&p->usage);
+            run_begin = trace_now();
+            if (current_job->perf && (p->perf = arena_alloc(current_job->mem, sizeof(perf_counters))))
+                perf_open(p->perf, 0, 0);
+            p->status = exec_builtin(p->builtin, (const char **) p->argv, infile_local, outfile_local) << 8;
+            if (p->perf)
+                perf_collect(p->perf, current_job->perf);
+            usage_end(&p->usage, NULL);
+            if (current_job)
+                trace_process_ran(p, run_begin, p->status);
+            if (!current_job)
+                last_status = WEXITSTATUS(p->status);
+        }
+        /* Utilities of pipeline run on threads, so the shell doesn't block on pipes. */
+        else if (BUILTIN_IS_UTIL(p->builtin) && !single && threads
+                 && (in_ring || out_ring || !utility_reads_terminal(p, infile_local)))
+        {
+            if ((err = start_worker(p, infile_local, outfile_local, in_ring, out_ring)))
+            {
+                fprintf(stderr, "%s: can't start thread: %s\n", p->argv[0], strerror(err));
+                fflush(stderr);
+                p->stopped = 0;
+                p->completed = 1;
+                p->status = EXIT_FAILURE << 8;
+            } else
+            {
+                trace_process_begin(p, "thread");
+                in_ring = out_ring = NULL;
+            }
+        } else if (BUILTIN_IS_UTIL(p->builtin))
+        {
+            /* Utility waits for next command of pipeline or the user, or it's a single utility or a job,
+               which may be stopped or interrupted, so it runs in child process. */
+            exec_only_inner = 0;
+            start_process(current_job, p, NULL, infile_local, outfile_local, foreground);
+        } else if (BUILTIN_IS_INNER(p->builtin) && capture_fd != -1)
+        {
+            /* Inner command of command substitution runs in child process, so it can't change the shell. */
+            exec_only_inner = 0;
+            start_process(current_job, p, NULL, infile_local, outfile_local, foreground);
+        }
         /* Check for the internal implementation of the command. */
-        if(command_is_inner(p->argv[0]))
+        else if(BUILTIN_IS_INNER(p->builtin))
         {
             /* Set flags that this inner process completed. */
             p->stopped = 0;
             p->completed = 1;
 
-            if ((inner_cmd_stat = exec_inner(p->argv[0], (const char **) p->argv, infile_local, outfile_local)) == MAY_EXIT)
+            usage_begin(&p->usage);
+            run_begin = trace_now();
+            if ((inner_cmd_stat = exec_builtin(p->builtin, (const char **) p->argv, infile_local, outfile_local)) == MAY_EXIT)
                 /* We get MAY_EXIT code, so we can exit from shell. */
-                shell_exit(EXIT_SUCCESS);
-            else if (inner_cmd_stat != NOT_INNER_COMMAND)
-            {
-                /* Update invite_string, because of we can launch cd command. */
-                get_dir_prompt(dir);
-                sprintf(invite_string, "%s@%s:%s$ ", username, hostname, dir);
-            }
+                shell_exit(p->argv[1] ? (int) strtol(p->argv[1], NULL, 10) : last_status);
+            usage_end(&p->usage, NULL);
+
+            /* Exit status of inner command in format of waitpid. */
+            p->status = (inner_cmd_stat == EXEC_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE) << 8;
+            if (current_job)
+                trace_process_ran(p, run_begin, p->status);
+            if (!current_job)
+                last_status = inner_cmd_stat == EXEC_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+        } else if (!(path = find_command_path(p->argv[0])))
+        {
+            /* Command wasn't found in PATH, so we don't need a process for it. */
+            fprintf(stderr, "%s: command not found\n", p->argv[0]);
+            fflush(stderr);
+            p->stopped = 0;
+            p->completed = 1;
+            p->status = 127 << 8;
         } else
         {
             /* We have non-internal command, so set exec_only_inner to 0. */
             exec_only_inner = 0;
 
-            /* Fork the child processes. */
-            pid = fork();
-            if (pid == 0)
-                /* This is the child process. */
-                launch_process(p, current_job->pgid, infile_local, outfile_local, current_job->stderr_file, foreground);
-            else if (pid < 0)
+            /* Too long args of single command are run by batches like in xargs. */
+            if (p == current_job->first_process && !p_next && get_option(OPT_ARGBATCH) > 0
+                && split_arg_batches(current_job, p) > 1)
             {
-                /* The fork failed. */
-                perror("fork");
-                shell_exit(EXIT_FAILURE);
+                /* Streams are kept until the last batch is launched. */
+                current_job->batch_in = fcntl(infile_local, F_DUPFD_CLOEXEC, 0);
+                current_job->batch_out = fcntl(outfile_local, F_DUPFD_CLOEXEC, 0);
+                if (current_job->batch_in == -1 || current_job->batch_out == -1)
+                {
+                    perror("fcntl");
+                    shell_exit(EXIT_FAILURE);
+                }
+                launch_pending_batches(current_job, foreground);
             } else
-            {
-                /* This is the parent process. */
-                p->pid = pid;
-                if (!current_job->pgid)
-                    current_job->pgid = pid;
-                setpgid(pid, current_job->pgid);
-            }
+                start_process(current_job, p, path, infile_local, outfile_local, foreground);
         }
 
+        /* Clean up after redirections. */
+        if (infile_local != infile_pipe)
+            close(infile_local);
+        if (outfile_local != outfile_pipe)
+            close(outfile_local);
+
         /* Current job may be removed, if job contains inner commands. */
         if(current_job)
         {
+            /* Thread opens pipes of substitutions by paths, so they are kept until it completes. */
+            if (p->worker)
+                inherit_substitutions(p, 0);
+            else
+                close_substitutions(p);
+
             /* Clean up after pipes. */
-            if (infile_local != current_job->stdin_file)
-                close(infile_local);
-            if (outfile_local != current_job->stdout_file)
-                close(outfile_local);
+            if (infile_pipe != current_job->stdin_file && infile_pipe != -1)
+                close(infile_pipe);
+            if (outfile_pipe != current_job->stdout_file && outfile_pipe != -1)
+                close(outfile_pipe);
         }
 
+        /* Ends of ring buffers, which weren't passed to thread, give end of file and broken pipe. */
+        if (in_ring)
+            ring_close(in_ring, RING_READER);
+        if (out_ring)
+            ring_close(out_ring, RING_WRITER);
+        in_ring = next_ring;
+        out_ring = next_ring = NULL;
+
         infile_local = mypipe[0];
 
         p = p_next;
+        edge++;
     }
 
+    stat_since(STAT_LAUNCH, launch_begin);
+
+    /* Jobs of inner commands only have completed already, so monitor gets jobs with processes or threads. */
+    if(!exec_only_inner || (current_job && job_has_workers(current_job)))
+        job_changed(current_job);
+
     /* Inner commands don't run in forked processes, so we don't have to wait for them. */
     if(!exec_only_inner)
     {
@@ -367,6 +891,238 @@ void launch_job(int foreground)
         else
             put_job_in_background(current_job, 0);
     }
+    /* Threads of foreground pipeline without processes have no process group, so they are waited like foreground job. */
+    else if (current_job && job_has_workers(current_job))
+        wait_for_job(current_job);
+}
+
+/* Launch process substitutions of process p of job j before p and replace their words in args of p
+   by paths of their pipes. Utilities run on threads, if threads is true. Return true if some of them run in child processes. */
+int launch_substitutions(job *j, process *p, int foreground, int threads)
+{
+    process *q;
+    int mypipe[2], infile_local, outfile_local, infile_pipe, outfile_pipe, err, forked = 0;
+    char fd_path[32], *arg;
+    const char *path;
+
+    for (q = p->next; q; q = q->next)
+    {
+        if (q->owner != p)
+            continue;
+
+        /* Nested substitutions start before their owner too. */
+        forked |= launch_substitutions(j, q, foreground, threads);
+
+        if (pipe(mypipe) < 0)
+        {
+            perror("pipe");
+            shell_exit(EXIT_FAILURE);
+        }
+        fcntl(mypipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(mypipe[1], F_SETFD, FD_CLOEXEC);
+
+        /* Command of <(command) writes to pipe, command of >(command) reads it. Other stream is one of job. */
+        if (q->subst_kind == REDIR_IN)
+        {
+            q->subst_fd = mypipe[0];
+            infile_pipe = j->stdin_file;
+            outfile_pipe = mypipe[1];
+        } else
+        {
+            q->subst_fd = mypipe[1];
+            infile_pipe = mypipe[0];
+            outfile_pipe = j->stdout_file;
+        }
+
+        /* Owner opens the pipe by path, the shell keeps its end until owner is launched. */
+        snprintf(fd_path, sizeof(fd_path), "/dev/fd/%d", q->subst_fd);
+        for (char **word = p->argv; *word; ++word)
+            if (*word == q->subst_arg && (arg = arena_strndup(j->mem, fd_path, strlen(fd_path))))
+                *word = arg;
+
+        infile_local = infile_pipe;
+        outfile_local = outfile_pipe;
+        inherit_substitutions(q, 1);
+        if (open_redirects(q, &infile_local, &outfile_local))
+        {
+            q->stopped = 0;
+            q->completed = 1;
+            q->status = EXIT_FAILURE << 8;
+        }
+        /* Utility runs on thread, if it can't block on terminal and job control doesn't need its process. */
+        else if (BUILTIN_IS_UTIL(q->builtin) && threads && !utility_reads_terminal(q, infile_local))
+        {
+            if ((err = start_worker(q, infile_local, outfile_local, NULL, NULL)))
+            {
+                fprintf(stderr, "%s: can't start thread: %s\n", q->argv[0], strerror(err));
+                fflush(stderr);
+                q->stopped = 0;
+                q->completed = 1;
+                q->status = EXIT_FAILURE << 8;
+            } else
+                trace_process_begin(q, "thread");
+        }
+        /* Inner command of substitution runs in child process like utility, so it can't change the shell. */
+        else if (BUILTIN_IS_UTIL(q->builtin) || BUILTIN_IS_INNER(q->builtin))
+        {
+            forked = 1;
+            start_process(j, q, NULL, infile_local, outfile_local, foreground);
+        } else if (!(path = find_command_path(q->argv[0])))
+        {
+            fprintf(stderr, "%s: command not found\n", q->argv[0]);
+            fflush(stderr);
+            q->stopped = 0;
+            q->completed = 1;
+            q->status = 127 << 8;
+        } else
+        {
+            forked = 1;
+            start_process(j, q, path, infile_local, outfile_local, foreground);
+        }
+
+        if (q->worker)
+            inherit_substitutions(q, 0);
+        else
+            close_substitutions(q);
+        if (infile_local != infile_pipe)
+            close(infile_local);
+        if (outfile_local != outfile_pipe)
+            close(outfile_local);
+        close(q->subst_kind == REDIR_IN ? mypipe[1] : mypipe[0]);
+    }
+
+    return forked;
+}
+
+/* Let children of process p inherit ends of pipes of its substitutions, if inherit is true. */
+void inherit_substitutions(process *p, int inherit)
+{
+    for (process *q = p->next; q; q = q->next)
+        if (q->owner == p && q->subst_fd != -1)
+            fcntl(q->subst_fd, F_SETFD, inherit ? 0 : FD_CLOEXEC);
+}
+
+/* Check process p has redirection of input, if input is true, or of output otherwise. */
+int redirects_stream(process *p, int input)
+{
+    for (redirect *r = p->redirects; r; r = r->next)
+        if ((r->kind == REDIR_IN) == !!input)
+            return 1;
+
+    return 0;
+}
+
+/* Check utility of process p would wait for terminal input from infile_local. */
+int utility_reads_terminal(process *p, int infile_local)
+{
+    if (p->builtin->kind == BUILTIN_PLUGIN)
+        return plugin_reads_input(p->builtin, (const char **) p->argv) && isatty(infile_local);
+
+    return util_reads_terminal((const char **) p->argv, infile_local);
+}
+
+/* Check utility of process p completes without waiting for a writer or a device, when it reads infile_local. */
+int utility_is_bounded(process *p, int infile_local)
+{
+    struct stat st;
+
+    if (p->builtin->kind == BUILTIN_PLUGIN)
+        return !plugin_reads_input(p->builtin, (const char **) p->argv)
+               || (!fstat(infile_local, &st) && (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)));
+
+    return util_is_bounded((const char **) p->argv, infile_local);
+}
+
+/* Open redirections of process p. Replace *infile_local and *outfile_local by opened files.
+   Several targets of output, including pipe to the next command, get it through fanout of current_job.
+   Return 0, if success. Or -1, if file can't be opened. */
+int open_redirects(process *p, int *infile_local, int *outfile_local)
+{
+    redirect *r;
+    int fd, err, outputs = 0, *targets = NULL;
+    int infile_pipe = *infile_local, outfile_pipe = *outfile_local;
+    char fd_path[32];
+    const char *file;
+
+    /* Files of all output redirections are kept for fanout, if there are several targets. */
+    for (r = p->redirects; r; r = r->next)
+        if (r->kind != REDIR_IN)
+            outputs++;
+    if (outputs && outputs + (next_stage(p) ? 1 : 0) > 1
+        && !(targets = arena_alloc(current_job->mem, (size_t) (outputs + 1) * sizeof(int))))
+    {
+        perror("malloc");
+        return -1;
+    }
+    outputs = 0;
+
+    for (r = p->redirects; r; r = r->next)
+    {
+        /* Process substitution, which is target of redirection, is opened by path of its pipe like its word. */
+        file = r->file;
+        for (process *q = p->next; q; q = q->next)
+            if (q->owner == p && q->subst_arg == r->file && q->subst_fd != -1)
+            {
+                snprintf(fd_path, sizeof(fd_path), "/dev/fd/%d", q->subst_fd);
+                file = fd_path;
+            }
+
+        if (r->kind == REDIR_IN)
+            fd = open(file, O_RDONLY | O_CLOEXEC);
+        else if (r->kind == REDIR_OUT)
+            /* Rewrite file. READ-WRITE-NOT_EXECUTE */
+            fd = open(file, O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, (mode_t) 0644);
+        else
+            /* Append to end of file. */
+            fd = open(file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, (mode_t) 0644);
+
+        if (fd == -1)
+        {
+            fprintf(stderr, "%s: ", file);
+            perror(r->kind == REDIR_IN ? "Couldn't open input file" : "Couldn't open output file");
+            break;
+        }
+
+        if (targets && r->kind != REDIR_IN)
+        {
+            targets[outputs++] = fd;
+            continue;
+        }
+
+        /* The last redirection of stream wins. */
+        int *target = r->kind == REDIR_IN ? infile_local : outfile_local;
+        if (*target != (r->kind == REDIR_IN ? infile_pipe : outfile_pipe))
+            close(*target);
+        *target = fd;
+    }
+
+    /* Pipe to the next command is the last target, which consumes data after files got their copies. */
+    if (!r && targets && next_stage(p) && (targets[outputs++] = fcntl(outfile_pipe, F_DUPFD_CLOEXEC, 0)) == -1)
+    {
+        perror("fcntl");
+        outputs--;
+    }
+    else if (!r && targets)
+    {
+        if (!(err = start_fanout(&current_job->fanouts, targets, outputs, outfile_local)))
+            return 0;
+        fprintf(stderr, "fanout: %s\n", strerror(err));
+        fflush(stderr);
+    }
+    else if (!r)
+        return 0;
+
+    /* Close opened files on fail. */
+    for (int i = 0; i < outputs; ++i)
+        close(targets[i]);
+    if (*infile_local != infile_pipe)
+        close(*infile_local);
+    if (*outfile_local != outfile_pipe)
+        close(*outfile_local);
+    *infile_local = infile_pipe;
+    *outfile_local = outfile_pipe;
+
+    return -1;
 }
 
 /* Exit from shell. */
@@ -374,8 +1130,46 @@ void shell_exit(int stat)
 {
     /* Free memory. */
     clear_job_list(1);
+    trace_stop();
+    monitor_stop();
+    board_close();
     free_dir();
+    clear_path_cache();
+    clear_parse_cache();
+    clear_plugins();
+    clear_builtins();
+    close_event_loop();
+    close_input();
 
     /* Rest in peace, my victim of g***ocoding. */
     exit(stat);
 }
+
+/* Print user, host and current directory to invite string. */
+void update_invite_string()
+{
+    get_dir_prompt(dir);
+    sprintf(invite_string, "%s@%s:%s$ ", username, hostname, dir);
+}
+
+/* Close descriptors of shell, which are closed on exec, in forked child, which runs utility without exec. */
+void close_exec_descriptors()
+{
+    DIR *fds = opendir("/proc/self/fd");
+    struct dirent *entry;
+    int fd, flags;
+
+    /* Without /proc only descriptors of substitutions, which are inherited, are known. */
+    if (!fds)
+        return;
+
+    while ((entry = readdir(fds)))
+    {
+        fd = atoi(entry->d_name);
+        if (fd <= STDERR_FILENO || fd == dirfd(fds))
+            continue;
+        if ((flags = fcntl(fd, F_GETFD)) != -1 && flags & FD_CLOEXEC)
+            close(fd);
+    }
+    closedir(fds);
+}
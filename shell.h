@@ -3,12 +3,12 @@
 
 #include <fcntl.h>
 #include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "jobs.h"
 #include "signals.h"
 #include "promptline.h"
 
-#define READ_LINE_SIZE 1024
-
 #ifndef HOST_NAME_MAX
 #    define HOST_NAME_MAX 64
 #endif
@@ -17,12 +17,12 @@
 #    define LOGIN_NAME_MAX 256
 #endif
 
-command cmds[MAXCMDS]; /* current set of parsed commands from line */
-char *infile, *outfile, *appfile; /* files for redirect streams of new job */
 job* current_job; /* current foreground working job */
 int bkgrnd;      /* flag for the process in the background */
 int invite_mode;  /* flag for waiting for input from the terminal.
-                     Used in SIGCHLD handler and do_job_notification() */
+                     Used in do_job_notification() for line breaks after invite */
+int shell_is_interactive; /* flag for running with terminal and job control */
+int last_status;  /* exit status of last foreground job */
 
 pid_t shell_pgid; /* shell process group ID */
 struct termios shell_tmodes; /* saved attributes of shell terminal */
@@ -31,4 +31,15 @@ int shell_terminal;          /* descriptor of shell STDIN */
 /* Exit from shell. */
 void shell_exit(int stat);
 
+/* Print user, host and current directory to invite string. */
+void update_invite_string();
+
+/* Launch not started batches of job j, while count of running batches is less than argbatch option. */
+void launch_pending_batches(job *j, int foreground);
+
+/* Run commands of text of len symbols and set *data to their output without trailing newlines,
+   which caller frees, or NULL if it's empty. Return length of output.
+   Single utility runs inside shell and writes to memory, other commands write to pipe. */
+size_t command_output(const char *text, size_t len, char **data);
+
 #endif
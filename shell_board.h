@@ -0,0 +1,49 @@
+#ifndef UNIX_SHELL_SHELL_BOARD_H
+#define UNIX_SHELL_SHELL_BOARD_H
+
+#include <stdatomic.h>
+
+/* Layout of job board, which the shell publishes with set -o board.
+   Board is file BOARD_DIR/BOARD_PREFIX<pid of shell>, mapped to memory by the shell and its readers.
+   Each slot is changed under its own seqlock: seq is odd while the shell writes the slot,
+   so reader copies slot and retries, if seq was odd or changed during the copy. */
+
+#define BOARD_DIR          "/dev/shm"
+#define BOARD_PREFIX       "unix_shell."
+#define BOARD_MAGIC        0x4a4f4253u /* "JOBS" */
+#define BOARD_VERSION      1
+#define BOARD_SLOTS        64          /* count of slots of board */
+#define BOARD_COMMAND_SIZE 112         /* bytes of command line in slot with terminating zero */
+
+/* States of slot. */
+#define BOARD_FREE      0   /* slot has no job */
+#define BOARD_RUNNING   1   /* some processes of job run */
+#define BOARD_STOPPED   2   /* processes of job are stopped or completed */
+#define BOARD_COMPLETED 3   /* all processes of job completed */
+
+/* Job of the shell. */
+typedef struct board_slot
+{
+    atomic_uint seq;                    /* seqlock of slot, odd while slot is written */
+    int state;                          /* BOARD_* state */
+    int jid;                            /* index of job in job list */
+    int pgid;                           /* process group of job, 0 if job has only threads */
+    int status;                         /* exit status of completed job */
+    int processes;                      /* count of processes of job */
+    long long start;                    /* wall clock time of job start, nanoseconds since epoch */
+    long long cpu;                      /* CPU time of completed processes in user and kernel mode, nanoseconds */
+    char command[BOARD_COMMAND_SIZE];   /* command line, cut to fit */
+} board_slot;
+
+/* Mapped file of board. */
+typedef struct shell_board
+{
+    unsigned magic;                     /* BOARD_MAGIC */
+    unsigned version;                   /* BOARD_VERSION */
+    int pid;                            /* pid of shell */
+    unsigned slot_count;                /* BOARD_SLOTS */
+    atomic_uint overflows;              /* count of jobs, which got no free slot */
+    board_slot slots[BOARD_SLOTS];      /* jobs of shell */
+} shell_board;
+
+#endif
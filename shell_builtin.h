@@ -0,0 +1,36 @@
+#ifndef UNIX_SHELL_SHELL_BUILTIN_H
+#define UNIX_SHELL_SHELL_BUILTIN_H
+
+/* ABI of builtins, which are loaded by enable -f library name.
+   Shared object exports variable <name>_builtin of type shell_builtin.
+   The shell refuses builtins with other abi_version. */
+
+#define SHELL_BUILTIN_ABI_VERSION 1
+
+#define SHELL_BUILTIN_READS_INPUT 1 /* flag of builtin, which reads its input: it runs in child process
+                                       instead of the shell, when input is terminal */
+#define SHELL_BUILTIN_READS_INPUT_WITHOUT_ARGS 2 /* flag of builtin, which reads its input only, when
+                                                    it's called without args, like cat */
+
+/* Call of loadable builtin. */
+typedef struct shell_builtin_call
+{
+    int argc;                   /* count of args */
+    const char *const *argv;    /* args, argv[0] is name of command and argv[argc] is NULL */
+    int in, out, err;           /* input, output and error descriptors */
+} shell_builtin_call;
+
+/* Loadable builtin. */
+typedef struct shell_builtin
+{
+    unsigned abi_version;       /* SHELL_BUILTIN_ABI_VERSION, which builtin was built with */
+    const char *name;           /* name of command */
+    unsigned flags;             /* SHELL_BUILTIN_* flags */
+
+    /* Run builtin and return exit status. Builtin may run on any thread of the shell
+       or in child process, so it must not change state of process: current directory,
+       signal handlers, standard streams. Descriptors of call stay opened after return. */
+    int (*run)(const shell_builtin_call *call);
+} shell_builtin;
+
+#endif
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include <spawn.h>
+#include <assert.h>
+#include "spawn.h"
+#include "shell.h"
+
+/* Check support of posix_spawn_file_actions_addtcsetpgrp_np(). */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#    define HAVE_SPAWN_TCSETPGRP 1
+#else
+#    define HAVE_SPAWN_TCSETPGRP 0
+#endif
+
+extern char **environ;
+
+typedef struct spawn_stat
+{
+    unsigned long count;     /* count of launched processes */
+    unsigned long long total; /* summary latency in nanoseconds */
+    unsigned long long max;   /* maximal latency in nanoseconds */
+} spawn_stat;
+
+/* Latency counters for each backend. */
+static spawn_stat stats[2];
+
+/* Add file actions for redirect of fd to target. */
+static int add_redirect(posix_spawn_file_actions_t *actions, int fd, int target);
+
+/* Launch process p from executable path with posix_spawn.
+   Process group, terminal, signal dispositions and i/o channels are set
+   by spawn attributes and file actions, so the shell memory isn't copied.
+   Return pid of new process. Or -1, if process must be launched by fork(). */
+pid_t spawn_process(process *p, const char *path, pid_t pgid, int infile_local, int outfile_local, int errfile_local, int foreground)
+{
+    assert(p != NULL);
+    assert(path != NULL);
+
+    /* Only interactive shell gives terminal and process groups to jobs. */
+    foreground = foreground && shell_is_interactive;
+
+    /* We can't give terminal to child without support of libc. */
+    if (foreground && !HAVE_SPAWN_TCSETPGRP)
+        return -1;
+
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t sigdefault, sigmask;
+    pid_t pid = -1;
+    int err;
+
+    if (posix_spawnattr_init(&attr))
+        return -1;
+    if (posix_spawn_file_actions_init(&actions))
+    {
+        posix_spawnattr_destroy(&attr);
+        return -1;
+    }
+
+    /* Set the handling for job control signals back to the default. */
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGINT);
+    sigaddset(&sigdefault, SIGQUIT);
+    sigaddset(&sigdefault, SIGTSTP);
+    sigaddset(&sigdefault, SIGTTIN);
+    sigaddset(&sigdefault, SIGTTOU);
+    sigaddset(&sigdefault, SIGCHLD);
+    sigaddset(&sigdefault, SIGPIPE);
+    sigaddset(&sigdefault, SIGTERM);
+    sigemptyset(&sigmask);
+
+    err = posix_spawnattr_setflags(&attr, (short) ((shell_is_interactive ? POSIX_SPAWN_SETPGROUP : 0) |
+                                                   POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK));
+    err = err ? err : posix_spawnattr_setpgroup(&attr, pgid);
+    err = err ? err : posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    err = err ? err : posix_spawnattr_setsigmask(&attr, &sigmask);
+
+#if HAVE_SPAWN_TCSETPGRP
+    /* Give the process group the terminal. */
+    if (!err && foreground)
+        err = posix_spawn_file_actions_addtcsetpgrp_np(&actions, shell_terminal);
+#endif
+
+    /* Set the standard input/output channels of the new process. */
+    err = err ? err : add_redirect(&actions, infile_local, STDIN_FILENO);
+    err = err ? err : add_redirect(&actions, outfile_local, STDOUT_FILENO);
+    err = err ? err : add_redirect(&actions, errfile_local, STDERR_FILENO);
+
+    /* The child process will report about failed exec itself, so fork() is used in that case. */
+    if (!err && posix_spawn(&pid, path, &actions, &attr, p->argv, environ))
+        pid = -1;
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    return pid;
+}
+
+/* Add file actions for redirect of fd to target. */
+static int add_redirect(posix_spawn_file_actions_t *actions, int fd, int target)
+{
+    if (fd == target)
+        return 0;
+
+    int err = posix_spawn_file_actions_adddup2(actions, fd, target);
+    if (!err && fd > STDERR_FILENO)
+        err = posix_spawn_file_actions_addclose(actions, fd);
+
+    return err;
+}
+
+/* Add latency of process launch, started at begin, to counters of backend. */
+void record_spawn_latency(int backend, const struct timespec *begin)
+{
+    assert(backend == SPAWN_POSIX || backend == SPAWN_FORK);
+    assert(begin != NULL);
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    unsigned long long ns = (unsigned long long) (end.tv_sec - begin->tv_sec) * 1000000000ULL
+                            + (unsigned long long) end.tv_nsec - (unsigned long long) begin->tv_nsec;
+
+    stats[backend].count++;
+    stats[backend].total += ns;
+    if (ns > stats[backend].max)
+        stats[backend].max = ns;
+}
+
+/* Print spawn latency counters to fd. */
+void print_spawn_stats(int fd)
+{
+    static const char *names[2] = {"posix_spawn", "fork"};
+
+    for (int i = 0; i < 2; ++i)
+        dprintf(fd, "%-12s %lu spawns, avg %llu us, max %llu us\n", names[i], stats[i].count,
+                stats[i].count ? stats[i].total / stats[i].count / 1000 : 0, stats[i].max / 1000);
+}
+
+/* Reset spawn latency counters. */
+void reset_spawn_stats()
+{
+    memset(stats, 0, sizeof(stats));
+}
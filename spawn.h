@@ -0,0 +1,26 @@
+#ifndef UNIX_SHELL_SPAWN_H
+#define UNIX_SHELL_SPAWN_H
+
+#include <time.h>
+#include "jobs.h"
+
+/* Backends for launching of processes. */
+#define SPAWN_POSIX 0
+#define SPAWN_FORK  1
+
+/* Launch process p from executable path with posix_spawn.
+   Process group, terminal, signal dispositions and i/o channels are set
+   by spawn attributes and file actions, so the shell memory isn't copied.
+   Return pid of new process. Or -1, if process must be launched by fork(). */
+pid_t spawn_process(process *p, const char *path, pid_t pgid, int infile_local, int outfile_local, int errfile_local, int foreground);
+
+/* Add latency of process launch, started at begin, to counters of backend. */
+void record_spawn_latency(int backend, const struct timespec *begin);
+
+/* Print spawn latency counters to fd. */
+void print_spawn_stats(int fd);
+
+/* Reset spawn latency counters. */
+void reset_spawn_stats();
+
+#endif
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "spool.h"
+#include "workers.h"
+#include "ring.h"
+
+struct spool
+{
+    ring *records;                  /* buffered records, main thread is writer of ring */
+    pthread_t thread;               /* thread, which writes records to fd */
+    int fd;                         /* descriptor, owned by thread */
+    unsigned long long written;     /* count of buffered records */
+    unsigned long long dropped;     /* count of records, which didn't fit to buffer */
+};
+
+/* Body of writer thread. Write records from ring to fd until the ring is closed. */
+static void *write_spool(void *arg);
+
+/* Start spool of size bytes (power of 2) to fd and set *s to it. Spool owns fd, if success.
+   Return 0, if success. Or errno. */
+int spool_open(spool **s, int fd, size_t size)
+{
+    int err;
+    spool *sp = malloc(sizeof(spool));
+
+    if (!sp)
+        return ENOMEM;
+    if (!(sp->records = ring_create(size)))
+    {
+        free(sp);
+        return ENOMEM;
+    }
+    sp->fd = fd;
+    sp->written = sp->dropped = 0;
+
+    err = start_shell_thread(write_spool, sp, &sp->thread);
+
+    if (err)
+    {
+        ring_close(sp->records, RING_READER);
+        ring_close(sp->records, RING_WRITER);
+        free(sp);
+        return err;
+    }
+
+    *s = sp;
+    return 0;
+}
+
+/* Add len bytes of record to spool s without waiting. Record is dropped, if it doesn't fit to buffer
+   or the reader closed fd. Return 0, if record was added. */
+int spool_write(spool *s, const char *record, size_t len)
+{
+    if (ring_try_write(s->records, record, len))
+    {
+        s->dropped++;
+        return -1;
+    }
+
+    s->written++;
+    return 0;
+}
+
+/* Return count of added records of spool s and set *dropped to count of dropped ones. */
+unsigned long long spool_counts(const spool *s, unsigned long long *dropped)
+{
+    *dropped = s->dropped;
+    return s->written;
+}
+
+/* Close spool s and its fd. Buffered records are written, if fd accepts them in SPOOL_CLOSE_TIMEOUT. */
+void spool_close(spool *s)
+{
+    struct timespec deadline;
+
+    if (!s)
+        return;
+
+    ring_close(s->records, RING_WRITER);
+
+    /* Reader may be stuck, then the thread is left to finish alone. */
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += SPOOL_CLOSE_TIMEOUT;
+    if (pthread_timedjoin_np(s->thread, NULL, &deadline))
+    {
+        /* Detached thread may not have read s yet, so it's left allocated. */
+        pthread_detach(s->thread);
+        return;
+    }
+
+    free(s);
+}
+
+/* Copy s to buf of size bytes as JSON string without quotes. Return buf. */
+const char *json_escape(char *buf, size_t size, const char *s)
+{
+    size_t i = 0;
+
+    /* Escaped character takes up to 6 bytes. */
+    for (; *s && i + 7 < size; ++s)
+        if (*s == '"' || *s == '\\')
+        {
+            buf[i++] = '\\';
+            buf[i++] = *s;
+        }
+        else if ((unsigned char) *s < 0x20)
+            i += (size_t) snprintf(buf + i, size - i, "\\u%04x", (unsigned char) *s);
+        else
+            buf[i++] = *s;
+    buf[i] = '\0';
+
+    return buf;
+}
+
+/* Body of writer thread. Write records from ring to fd until the ring is closed. */
+static void *write_spool(void *arg)
+{
+    spool *s = arg;
+    ring *records = s->records;
+    int fd = s->fd;
+    const char *data;
+    size_t len;
+    ssize_t n;
+    struct timespec interval = {0, SPOOL_FLUSH_INTERVAL * 1000000L};
+
+    /* Spool may be freed by the main thread after close, so only the ring and fd are used. */
+    while ((len = ring_read_begin(records, &data)))
+    {
+        if ((n = write(fd, data, len)) < 0 && errno != EINTR)
+            break;
+        ring_read_end(records, n < 0 ? 0 : (size_t) n);
+
+        /* Records are collected for a while, so the shell doesn't wake the thread for each one. */
+        nanosleep(&interval, NULL);
+    }
+
+    /* Main thread drops records after reader is closed. */
+    ring_close(records, RING_READER);
+    close(fd);
+
+    return NULL;
+}
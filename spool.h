@@ -0,0 +1,30 @@
+#ifndef UNIX_SHELL_SPOOL_H
+#define UNIX_SHELL_SPOOL_H
+
+#include <stddef.h>
+
+#define SPOOL_FLUSH_INTERVAL 10 /* milliseconds between writes of collected records */
+#define SPOOL_CLOSE_TIMEOUT  1  /* seconds to wait for writing of buffered records at close */
+
+/* Stream of records from the main thread to descriptor. Records are buffered in memory
+   and written by separate thread, so a slow reader of descriptor never blocks the shell. */
+typedef struct spool spool;
+
+/* Start spool of size bytes (power of 2) to fd and set *s to it. Spool owns fd, if success.
+   Return 0, if success. Or errno. */
+int spool_open(spool **s, int fd, size_t size);
+
+/* Add len bytes of record to spool s without waiting. Record is dropped, if it doesn't fit to buffer
+   or the reader closed fd. Return 0, if record was added. */
+int spool_write(spool *s, const char *record, size_t len);
+
+/* Return count of added records of spool s and set *dropped to count of dropped ones. */
+unsigned long long spool_counts(const spool *s, unsigned long long *dropped);
+
+/* Close spool s and its fd. Buffered records are written, if fd accepts them in SPOOL_CLOSE_TIMEOUT. */
+void spool_close(spool *s);
+
+/* Copy s to buf of size bytes as JSON string without quotes. Return buf. */
+const char *json_escape(char *buf, size_t size, const char *s);
+
+#endif
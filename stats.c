@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include "stats.h"
+#include "options.h"
+
+/* Log-linear histogram of durations in nanoseconds. */
+typedef struct histogram
+{
+    unsigned long long counts[STAT_BUCKETS];  /* counts of values of buckets */
+    unsigned long long count;                 /* count of all values */
+    unsigned long long max;                   /* maximal value */
+} histogram;
+
+static histogram phases[STAT_COUNT];    /* histograms of phases, fixed memory */
+static const char *phase_names[STAT_COUNT] =
+{
+    "prompt", "parse", "fill", "spawn", "launch", "wait", "terminal"
+};
+
+/* Return index of bucket of value. */
+static unsigned bucket_of(unsigned long long value);
+
+/* Return the lowest value of bucket. */
+static unsigned long long bucket_low(unsigned bucket);
+
+/* Return the highest value of bucket. */
+static unsigned long long bucket_high(unsigned bucket);
+
+/* Return value of quantile q of histogram h. Upper bound of bucket is returned, but not above max. */
+static unsigned long long quantile(const histogram *h, double q);
+
+/* Get nanoseconds of monotonic clock. */
+unsigned long long monotonic_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+}
+
+/* Get nanoseconds of monotonic clock for stat_since. Return 0, if stats are disabled by option. */
+unsigned long long stat_now()
+{
+    return get_option(OPT_STATS) ? monotonic_ns() : 0;
+}
+
+/* Record nanoseconds since begin of stat_now to histogram of phase. Zero begin isn't recorded.
+   Return the current time, which may begin the next phase without another reading of clock, or 0. */
+unsigned long long stat_since(int phase, unsigned long long begin)
+{
+    unsigned long long end = stat_now();
+
+    if (begin && end)
+        stat_record(phase, end - begin);
+    return end;
+}
+
+/* Record duration of ns nanoseconds to histogram of phase. */
+void stat_record(int phase, unsigned long long ns)
+{
+    assert(phase >= 0 && phase < STAT_COUNT);
+
+    histogram *h = &phases[phase];
+
+    h->counts[bucket_of(ns)]++;
+    h->count++;
+    if (ns > h->max)
+        h->max = ns;
+}
+
+/* Print count, p50, p99 and max of each phase to fd. */
+void print_stats(int fd)
+{
+    dprintf(fd, "%-10s %10s %12s %12s %12s\n", "phase", "count", "p50 us", "p99 us", "max us");
+    for (int i = 0; i < STAT_COUNT; ++i)
+        dprintf(fd, "%-10s %10llu %12.1f %12.1f %12.1f\n", phase_names[i], phases[i].count,
+                (double) quantile(&phases[i], 0.5) / 1e3, (double) quantile(&phases[i], 0.99) / 1e3,
+                (double) phases[i].max / 1e3);
+}
+
+/* Print histograms of phases with their percentiles to fd as JSON. */
+void print_stats_json(int fd)
+{
+    dprintf(fd, "{");
+    for (int i = 0; i < STAT_COUNT; ++i)
+    {
+        const histogram *h = &phases[i];
+        int first = 1;
+
+        dprintf(fd, "%s\"%s\":{\"count\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,\"buckets\":[",
+                i ? "," : "", phase_names[i], h->count, quantile(h, 0.5), quantile(h, 0.99), h->max);
+
+        /* Only filled buckets are dumped as [lowest value, count]. */
+        for (unsigned b = 0; b < STAT_BUCKETS; ++b)
+            if (h->counts[b])
+            {
+                dprintf(fd, "%s[%llu,%llu]", first ? "" : ",", bucket_low(b), h->counts[b]);
+                first = 0;
+            }
+        dprintf(fd, "]}");
+    }
+    dprintf(fd, "}\n");
+}
+
+/* Clear all histograms. */
+void reset_stats()
+{
+    memset(phases, 0, sizeof(phases));
+}
+
+/* Return index of bucket of value. */
+static unsigned bucket_of(unsigned long long value)
+{
+    if (value < (1ULL << STAT_SUB_BITS))
+        return (unsigned) value;
+
+    /* Power of 2 selects the group, the next bits select the linear bucket in it. */
+    unsigned exponent = 63u - (unsigned) __builtin_clzll(value);
+    unsigned sub = (unsigned) (value >> (exponent - STAT_SUB_BITS)) & ((1u << STAT_SUB_BITS) - 1);
+
+    return ((exponent - STAT_SUB_BITS + 1) << STAT_SUB_BITS) + sub;
+}
+
+/* Return the lowest value of bucket. */
+static unsigned long long bucket_low(unsigned bucket)
+{
+    if (bucket < (1u << STAT_SUB_BITS))
+        return bucket;
+
+    unsigned exponent = (bucket >> STAT_SUB_BITS) + STAT_SUB_BITS - 1;
+    unsigned long long sub = bucket & ((1u << STAT_SUB_BITS) - 1);
+
+    return ((1ULL << STAT_SUB_BITS) + sub) << (exponent - STAT_SUB_BITS);
+}
+
+/* Return the highest value of bucket. */
+static unsigned long long bucket_high(unsigned bucket)
+{
+    return bucket + 1 < STAT_BUCKETS ? bucket_low(bucket + 1) - 1 : ~0ULL;
+}
+
+/* Return value of quantile q of histogram h. Upper bound of bucket is returned, but not above max. */
+static unsigned long long quantile(const histogram *h, double q)
+{
+    unsigned long long rank = (unsigned long long) ((double) h->count * q + 0.5), seen = 0;
+
+    if (!h->count)
+        return 0;
+    if (!rank)
+        rank = 1;
+
+    for (unsigned b = 0; b < STAT_BUCKETS; ++b)
+        if ((seen += h->counts[b]) >= rank)
+            return bucket_high(b) < h->max ? bucket_high(b) : h->max;
+
+    return h->max;
+}
@@ -0,0 +1,39 @@
+#ifndef UNIX_SHELL_STATS_H
+#define UNIX_SHELL_STATS_H
+
+/* Phases of the shell between input of line and running of its job. */
+#define STAT_PROMPT    0 /* prompt_line: reading of line, with waiting for the user */
+#define STAT_PARSE     1 /* cached_parse_line */
+#define STAT_FILL      2 /* fill_job */
+#define STAT_SPAWN     3 /* fork or posix_spawn in the shell, posix_spawn returns after exec of child */
+#define STAT_LAUNCH    4 /* launch_job until all processes of job are started */
+#define STAT_WAIT      5 /* wait_for_job */
+#define STAT_TERMINAL  6 /* handoff of terminal to foreground job and back in put_job_in_foreground */
+#define STAT_COUNT     7 /* count of phases */
+
+#define STAT_SUB_BITS  4 /* each power of 2 is split to 2^STAT_SUB_BITS linear buckets, error is below 1/16 */
+#define STAT_BUCKETS   ((64 - STAT_SUB_BITS + 1) << STAT_SUB_BITS) /* buckets of histogram of 64-bit values */
+
+/* Get nanoseconds of monotonic clock. */
+unsigned long long monotonic_ns();
+
+/* Get nanoseconds of monotonic clock for stat_since. Return 0, if stats are disabled by option. */
+unsigned long long stat_now();
+
+/* Record nanoseconds since begin of stat_now to histogram of phase. Zero begin isn't recorded.
+   Return the current time, which may begin the next phase without another reading of clock, or 0. */
+unsigned long long stat_since(int phase, unsigned long long begin);
+
+/* Record duration of ns nanoseconds to histogram of phase. */
+void stat_record(int phase, unsigned long long ns);
+
+/* Print count, p50, p99 and max of each phase to fd. */
+void print_stats(int fd);
+
+/* Print histograms of phases with their percentiles to fd as JSON. */
+void print_stats_json(int fd);
+
+/* Clear all histograms. */
+void reset_stats();
+
+#endif
@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shell_board.h"
+
+/* Reader of job boards of shells, started with set -o board.
+   jobboard [-w seconds]
+   Print jobs of all shells from their boards in shared memory. Refresh the table every seconds with -w flag.
+   Boards are read without any calls into the shells. */
+
+#define JOBBOARD_RETRIES 1000 /* attempts to read slot, which is changed by the shell */
+
+/* Copy slot to *copy under its seqlock. Return 0, if consistent copy was read. */
+static int read_slot(const board_slot *slot, board_slot *copy)
+{
+    for (int i = 0; i < JOBBOARD_RETRIES; ++i)
+    {
+        unsigned begin = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        /* Odd seq means that the shell writes the slot now. */
+        if (begin & 1)
+            continue;
+        memcpy((char *) copy + offsetof(board_slot, state), (const char *) slot + offsetof(board_slot, state),
+               sizeof(board_slot) - offsetof(board_slot, state));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == begin)
+            return 0;
+    }
+
+    return -1;
+}
+
+/* Print jobs of board of path. Return count of printed jobs. */
+static int print_board(const char *path, long long now)
+{
+    static const char *states[] = {"free", "running", "stopped", "done"};
+    struct stat st;
+    const shell_board *board;
+    board_slot slot;
+    int fd, count = 0;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return 0;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(shell_board)
+        || (board = mmap(NULL, sizeof(shell_board), PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return 0;
+    }
+    close(fd);
+
+    if (board->magic != BOARD_MAGIC || board->version != BOARD_VERSION || board->slot_count != BOARD_SLOTS)
+    {
+        munmap((void *) board, sizeof(shell_board));
+        return 0;
+    }
+
+    /* Board of killed shell isn't removed, so it's marked. */
+    int dead = kill(board->pid, 0) == -1 && errno == ESRCH;
+    unsigned overflows = atomic_load(&board->overflows);
+
+    for (unsigned i = 0; i < BOARD_SLOTS; ++i)
+    {
+        if (read_slot(&board->slots[i], &slot) || slot.state == BOARD_FREE || slot.state > BOARD_COMPLETED)
+            continue;
+
+        slot.command[BOARD_COMMAND_SIZE - 1] = '\0';
+        printf("%-8d%s %-5d %-8d %-8s %10.3f %10.3f %5d  %s\n", board->pid, dead ? "x" : " ", slot.jid, slot.pgid,
+               slot.state == BOARD_COMPLETED && slot.status ? "failed" : states[slot.state],
+               (double) (now - slot.start) / 1e9, (double) slot.cpu / 1e9, slot.processes, slot.command);
+        count++;
+    }
+    if (overflows)
+        printf("%-8d%s %u jobs didn't fit to board\n", board->pid, dead ? "x" : " ", overflows);
+
+    munmap((void *) board, sizeof(shell_board));
+    return count;
+}
+
+/* Print jobs of all boards. Return count of printed jobs. */
+static int print_boards()
+{
+    char path[512];
+    struct timespec now;
+    struct dirent *entry;
+    DIR *dir;
+    int count = 0;
+
+    if (!(dir = opendir(BOARD_DIR)))
+    {
+        perror(BOARD_DIR);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    printf("%-9s %-5s %-8s %-8s %10s %10s %5s  %s\n", "SHELL", "JOB", "PGID", "STATE", "TIME", "CPU", "PROCS", "COMMAND");
+    while ((entry = readdir(dir)))
+        if (!strncmp(entry->d_name, BOARD_PREFIX, strlen(BOARD_PREFIX)))
+        {
+            snprintf(path, sizeof(path), "%s/%s", BOARD_DIR, entry->d_name);
+            count += print_board(path, (long long) now.tv_sec * 1000000000LL + now.tv_nsec);
+        }
+    closedir(dir);
+
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    double interval = 0;
+    char *end = NULL;
+
+    if (argc == 3 && !strcmp(argv[1], "-w"))
+        interval = strtod(argv[2], &end);
+    if ((argc != 1 && argc != 3) || (argc == 3 && (!end || *end || interval <= 0)))
+    {
+        fprintf(stderr, "usage: jobboard [-w seconds]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!interval)
+        return print_boards() < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    struct timespec pause = {(time_t) interval, (long) ((interval - (double) (time_t) interval) * 1e9)};
+    while (1)
+    {
+        /* Clear terminal before the next table. */
+        printf("\033[H\033[2J");
+        if (print_boards() < 0)
+            return EXIT_FAILURE;
+        fflush(stdout);
+        nanosleep(&pause, NULL);
+    }
+}
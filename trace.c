@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include "trace.h"
+#include "stats.h"
+#include "spool.h"
+
+/* State of trace. */
+typedef struct tracer
+{
+    spool *events;                  /* events, which are written to fd */
+    unsigned long long begin;       /* monotonic nanoseconds of trace start, zero of timestamps */
+    int first_job_id;               /* the first id of job in this trace, jobs with less ids are described again */
+    char separator;                 /* separator before the next event: '[' for the first one, then ',' */
+} tracer;
+
+static tracer *trace = NULL;    /* active trace, or NULL */
+static int next_job_id = 1;     /* id of the next traced job, it's pid of job in trace */
+
+/* Add formatted event to spool without waiting. Event is dropped, if buffer is full. */
+static void emit(const char *format, ...);
+
+/* Return id of job j in trace. Describe job and its pipeline, if it's new for the trace. */
+static int job_track(job *j);
+
+/* Return index of process p in pipeline of its job, starting from 1.
+   Process substitutions get indexes after all stages. */
+static int stage_of(process *p);
+
+/* Print escaped name of process p to buf of size bytes, process substitution is named like <(command). */
+static void process_name(char *buf, size_t size, process *p);
+
+/* Start streaming of events of jobs to fd as Chrome trace-event JSON instead of previous trace. Trace owns fd, if success.
+   Events are written by separate thread, so the shell never waits for fd.
+   Return 0, if success. Or errno. */
+int trace_start(int fd)
+{
+    int err;
+
+    if (trace)
+        trace_stop();
+
+    if (!(trace = malloc(sizeof(tracer))))
+        return ENOMEM;
+    if ((err = spool_open(&trace->events, fd, TRACE_BUFFER_SIZE)))
+    {
+        free(trace);
+        trace = NULL;
+        return err;
+    }
+
+    trace->begin = monotonic_ns();
+    trace->first_job_id = next_job_id;
+    trace->separator = '[';
+
+    return 0;
+}
+
+/* Stop tracing and close its fd. Buffered events are written, if fd accepts them in SPOOL_CLOSE_TIMEOUT. */
+void trace_stop()
+{
+    if (!trace)
+        return;
+
+    /* Array of events is closed, if it fits. Otherwise viewers accept it without the bracket. */
+    spool_write(trace->events, trace->separator == '[' ? "[]\n" : "\n]\n", 3);
+    spool_close(trace->events);
+
+    free(trace);
+    trace = NULL;
+}
+
+/* Return true if events are traced. */
+int trace_active()
+{
+    return trace != NULL;
+}
+
+/* Trace start of running of process p: launch, if how is backend like "fork", or continue. */
+void trace_process_begin(process *p, const char *how)
+{
+    char name[TRACE_EVENT_SIZE / 4];
+
+    if (!trace || !p->job)
+        return;
+
+    int id = job_track(p->job), stage = stage_of(p);
+    double ts = (double) (monotonic_ns() - trace->begin) / 1e3;
+
+    /* Process got pid at launch, so its track is named by it. */
+    process_name(name, sizeof(name), p);
+    if (strcmp(how, "continued"))
+    {
+        if (p->pid)
+            emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%d: %s (%s, pid %d)\"}}",
+                 id, stage, stage, name, how, (int) p->pid);
+        else
+            emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%d: %s (%s)\"}}",
+                 id, stage, stage, name, how);
+        emit("{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+             id, stage, stage);
+    }
+    emit("{\"name\":\"%s\",\"cat\":\"process\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+         "\"args\":{\"pid\":%d,\"start\":\"%s\"}}", name, ts, id, stage, (int) p->pid, how);
+}
+
+/* Trace stop or completion of process p with status of waitpid. It's called before flags of p are changed. */
+void trace_process_end(process *p, int status)
+{
+    if (!trace || !p->job || p->completed)
+        return;
+
+    int id = job_track(p->job), stage = stage_of(p);
+    double ts = (double) (monotonic_ns() - trace->begin) / 1e3;
+
+    /* Stopped process has no running slice, so its completion is instant. */
+    if (p->stopped)
+    {
+        if (!WIFSTOPPED(status))
+            emit("{\"name\":\"reaped\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+                 "\"args\":{\"status\":%d}}", ts, id, stage, status);
+        return;
+    }
+
+    if (WIFSTOPPED(status))
+        emit("{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"stopped\":%d}}",
+             ts, id, stage, WSTOPSIG(status));
+    else if (WIFSIGNALED(status))
+        emit("{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"signal\":%d}}",
+             ts, id, stage, WTERMSIG(status));
+    else
+        emit("{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"exit\":%d}}",
+             ts, id, stage, WEXITSTATUS(status));
+}
+
+/* Get time for trace_process_ran, or 0 if events aren't traced. */
+unsigned long long trace_now()
+{
+    return trace ? monotonic_ns() : 0;
+}
+
+/* Trace process p, which ran inside the shell from time begin of trace_now and completed with status of waitpid. */
+void trace_process_ran(process *p, unsigned long long begin, int status)
+{
+    char name[TRACE_EVENT_SIZE / 4];
+
+    /* Trace may be started or stopped by the process itself. */
+    if (!trace || !begin || begin < trace->begin || !p->job)
+        return;
+
+    int id = job_track(p->job), stage = stage_of(p);
+
+    process_name(name, sizeof(name), p);
+    emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%d: %s (shell)\"}}",
+         id, stage, stage, name);
+    emit("{\"name\":\"%s\",\"cat\":\"process\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+         "\"args\":{\"start\":\"shell\",\"exit\":%d}}", name, (double) (begin - trace->begin) / 1e3,
+         (double) (monotonic_ns() - begin) / 1e3, id, stage, WEXITSTATUS(status));
+}
+
+/* Trace event name of whole job j, like foreground or background. */
+void trace_job_event(job *j, const char *name)
+{
+    if (!trace)
+        return;
+
+    int id = job_track(j);
+    emit("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,\"pid\":%d,\"tid\":0}",
+         name, (double) (monotonic_ns() - trace->begin) / 1e3, id);
+}
+
+/* Print state of tracing to fd. */
+void print_trace_state(int fd)
+{
+    if (!trace)
+        dprintf(fd, "trace off\n");
+    else
+    {
+        unsigned long long dropped, written = spool_counts(trace->events, &dropped);
+        dprintf(fd, "trace on: %llu events, %llu dropped\n", written, dropped);
+    }
+}
+
+/* Add formatted event to spool without waiting. Event is dropped, if buffer is full. */
+static void emit(const char *format, ...)
+{
+    char event[TRACE_EVENT_SIZE];
+    va_list args;
+    int len;
+
+    /* The first event opens array, others are separated by comma. */
+    event[0] = trace->separator;
+    event[1] = '\n';
+
+    va_start(args, format);
+    len = vsnprintf(event + 2, sizeof(event) - 2, format, args);
+    va_end(args);
+
+    /* Strings of events are cut to fit, so event is never longer than TRACE_EVENT_SIZE. */
+    if (len >= 0 && (size_t) len < sizeof(event) - 2 && !spool_write(trace->events, event, (size_t) len + 2))
+        trace->separator = ',';
+}
+
+/* Return id of job j in trace. Describe job and its pipeline, if it's new for the trace. */
+static int job_track(job *j)
+{
+    char command[TRACE_EVENT_SIZE / 2];
+    int stages = 0, substitutions = 0;
+
+    if (j->trace_id >= trace->first_job_id)
+        return j->trace_id;
+
+    j->trace_id = next_job_id++;
+    for (process *p = j->first_process; p; p = p->next)
+        if (p->owner)
+            substitutions++;
+        else
+            stages++;
+
+    emit("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"[%d] %s\"}}",
+         j->trace_id, j->jid, json_escape(command, sizeof(command), j->command));
+    emit("{\"name\":\"process_labels\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"labels\":\"stages: %d, substitutions: %d\"}}",
+         j->trace_id, stages, substitutions);
+
+    return j->trace_id;
+}
+
+/* Return index of process p in pipeline of its job, starting from 1.
+   Process substitutions get indexes after all stages. */
+static int stage_of(process *p)
+{
+    int stage = 1;
+    process *q;
+
+    for (q = p->job->first_process; q && q != p; q = q->next)
+        if (!q->owner == !p->owner)
+            stage++;
+
+    if (p->owner)
+        for (q = p->job->first_process; q; q = q->next)
+            if (!q->owner)
+                stage++;
+
+    return stage;
+}
+
+/* Print escaped name of process p to buf of size bytes, process substitution is named like <(command). */
+static void process_name(char *buf, size_t size, process *p)
+{
+    char command[TRACE_EVENT_SIZE / 4];
+
+    if (!p->owner)
+        json_escape(buf, size, p->argv[0]);
+    else
+        snprintf(buf, size, "%c(%s)", p->subst_kind == REDIR_IN ? '<' : '>',
+                 json_escape(command, sizeof(command), p->argv[0]));
+}
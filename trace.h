@@ -0,0 +1,38 @@
+#ifndef UNIX_SHELL_TRACE_H
+#define UNIX_SHELL_TRACE_H
+
+#include "jobs.h"
+
+#define TRACE_BUFFER_SIZE (1024 * 1024) /* bytes of events, which wait for writing, power of 2 */
+#define TRACE_EVENT_SIZE  1024          /* maximal size of one event */
+
+/* Start streaming of events of jobs to fd as Chrome trace-event JSON instead of previous trace. Trace owns fd, if success.
+   Events are written by separate thread, so the shell never waits for fd.
+   Return 0, if success. Or errno. */
+int trace_start(int fd);
+
+/* Stop tracing and close its fd. Buffered events are written, if fd accepts them in SPOOL_CLOSE_TIMEOUT. */
+void trace_stop();
+
+/* Return true if events are traced. */
+int trace_active();
+
+/* Trace start of running of process p: launch, if how is backend like "fork", or continue. */
+void trace_process_begin(process *p, const char *how);
+
+/* Trace stop or completion of process p with status of waitpid. It's called before flags of p are changed. */
+void trace_process_end(process *p, int status);
+
+/* Get time for trace_process_ran, or 0 if events aren't traced. */
+unsigned long long trace_now();
+
+/* Trace process p, which ran inside the shell from time begin of trace_now and completed with status of waitpid. */
+void trace_process_ran(process *p, unsigned long long begin, int status);
+
+/* Trace event name of whole job j, like foreground or background. */
+void trace_job_event(job *j, const char *name);
+
+/* Print state of tracing to fd. */
+void print_trace_state(int fd);
+
+#endif
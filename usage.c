@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include "usage.h"
+#include "stats.h"
+
+#define USAGE_IO_SIZE    1024 /* size of buffer for contents of /proc/<pid>/io */
+#define USAGE_FIELD_SIZE 24   /* size of formatted field of usage table */
+
+/* Convert tv to nanoseconds. */
+static long long timeval_ns(const struct timeval *tv);
+
+/* Return sum of counters a and b, which may be USAGE_UNKNOWN. */
+static long long add_counter(long long a, long long b);
+
+/* Read counters of read and write calls from io file path to u. Return 0, if success. */
+static int read_io_file(proc_usage *u, const char *path);
+
+/* Format nanoseconds ns as seconds to buf. */
+static const char *format_time(char *buf, long long ns);
+
+/* Format size of bytes with binary suffix to buf. */
+static const char *format_size(char *buf, long long bytes);
+
+/* Format counter n to buf. */
+static const char *format_count(char *buf, long long n);
+
+/* Reset all counters of u to USAGE_UNKNOWN and times to 0. */
+void usage_clear(proc_usage *u)
+{
+    assert(u != NULL);
+
+    u->begin = u->end = 0;
+    u->user = u->sys = u->max_rss = USAGE_UNKNOWN;
+    u->minor_faults = u->major_faults = USAGE_UNKNOWN;
+    u->voluntary_switches = u->involuntary_switches = USAGE_UNKNOWN;
+    u->read_bytes = u->write_bytes = USAGE_UNKNOWN;
+}
+
+/* Reset counters of u and record start of process. */
+void usage_begin(proc_usage *u)
+{
+    usage_clear(u);
+    u->begin = monotonic_ns();
+}
+
+/* Record completion of process with resources ru to u.
+   ru may be NULL for builtins, which run inside shell, then counters stay unknown. */
+void usage_end(proc_usage *u, const struct rusage *ru)
+{
+    assert(u != NULL);
+
+    u->end = monotonic_ns();
+    if (!ru)
+        return;
+
+    u->user = timeval_ns(&ru->ru_utime);
+    u->sys = timeval_ns(&ru->ru_stime);
+    u->max_rss = ru->ru_maxrss;
+    u->minor_faults = ru->ru_minflt;
+    u->major_faults = ru->ru_majflt;
+    u->voluntary_switches = ru->ru_nvcsw;
+    u->involuntary_switches = ru->ru_nivcsw;
+}
+
+/* Record completion of the calling thread of shell with its own resources to u. */
+void usage_end_thread(proc_usage *u)
+{
+    struct rusage ru;
+
+    usage_end(u, getrusage(RUSAGE_THREAD, &ru) ? NULL : &ru);
+
+    /* Resident set is shared by all threads of shell, so it isn't resource of the thread. */
+    u->max_rss = USAGE_UNKNOWN;
+    read_io_file(u, "/proc/thread-self/io");
+}
+
+/* Read byte counters of process pid, which isn't reaped yet, to u. Return 0, if success. */
+int usage_read_process_io(proc_usage *u, pid_t pid)
+{
+    char path[32];
+
+    snprintf(path, sizeof(path), "/proc/%d/io", (int) pid);
+    return read_io_file(u, path);
+}
+
+/* Add resources of u to sum. Time spans and maximums are merged, other counters are summed. */
+void usage_add(proc_usage *sum, const proc_usage *u)
+{
+    assert(sum != NULL);
+    assert(u != NULL);
+
+    /* Processes, which weren't started, have no resources. */
+    if (!u->begin)
+        return;
+
+    /* Span of running process isn't finished, so span of sum isn't finished too. */
+    if (!sum->begin)
+        sum->end = u->end;
+    else if (!u->end || !sum->end)
+        sum->end = 0;
+    else if (u->end > sum->end)
+        sum->end = u->end;
+    if (!sum->begin || u->begin < sum->begin)
+        sum->begin = u->begin;
+
+    sum->user = add_counter(sum->user, u->user);
+    sum->sys = add_counter(sum->sys, u->sys);
+    if (u->max_rss > sum->max_rss)
+        sum->max_rss = u->max_rss;
+    sum->minor_faults = add_counter(sum->minor_faults, u->minor_faults);
+    sum->major_faults = add_counter(sum->major_faults, u->major_faults);
+    sum->voluntary_switches = add_counter(sum->voluntary_switches, u->voluntary_switches);
+    sum->involuntary_switches = add_counter(sum->involuntary_switches, u->involuntary_switches);
+    sum->read_bytes = add_counter(sum->read_bytes, u->read_bytes);
+    sum->write_bytes = add_counter(sum->write_bytes, u->write_bytes);
+}
+
+/* Print header of usage table to fd. */
+void print_usage_header(int fd)
+{
+    dprintf(fd, "%8s %9s %9s %9s %8s %7s %7s %7s %7s %8s %8s  %s\n", "pid", "real", "user", "sys",
+            "maxrss", "majflt", "minflt", "vcsw", "ivcsw", "read", "write", "command");
+}
+
+/* Print resources of u as row of usage table with label and command to fd. */
+void print_usage(int fd, const char *label, const proc_usage *u, const char *command)
+{
+    char real[USAGE_FIELD_SIZE], user[USAGE_FIELD_SIZE], sys[USAGE_FIELD_SIZE], rss[USAGE_FIELD_SIZE];
+    char majflt[USAGE_FIELD_SIZE], minflt[USAGE_FIELD_SIZE], vcsw[USAGE_FIELD_SIZE], ivcsw[USAGE_FIELD_SIZE];
+    char rd[USAGE_FIELD_SIZE], wr[USAGE_FIELD_SIZE];
+    proc_usage unknown;
+
+    assert(label != NULL);
+    assert(u != NULL);
+
+    /* Process, which wasn't started, has no resources. */
+    if (!u->begin && !u->end)
+    {
+        usage_clear(&unknown);
+        u = &unknown;
+    }
+
+    /* Running process is shown with real time until now. */
+    long long span = !u->begin ? USAGE_UNKNOWN : (long long) ((u->end ? u->end : monotonic_ns()) - u->begin);
+
+    dprintf(fd, "%8s %9s %9s %9s %8s %7s %7s %7s %7s %8s %8s%s%s\n", label,
+            format_time(real, span), format_time(user, u->user), format_time(sys, u->sys),
+            format_size(rss, u->max_rss == USAGE_UNKNOWN ? USAGE_UNKNOWN : u->max_rss * 1024),
+            format_count(majflt, u->major_faults), format_count(minflt, u->minor_faults),
+            format_count(vcsw, u->voluntary_switches), format_count(ivcsw, u->involuntary_switches),
+            format_size(rd, u->read_bytes), format_size(wr, u->write_bytes), command ? "  " : "", command ? command : "");
+}
+
+/* Convert tv to nanoseconds. */
+static long long timeval_ns(const struct timeval *tv)
+{
+    return (long long) tv->tv_sec * 1000000000LL + (long long) tv->tv_usec * 1000LL;
+}
+
+/* Return sum of counters a and b, which may be USAGE_UNKNOWN. */
+static long long add_counter(long long a, long long b)
+{
+    if (b == USAGE_UNKNOWN)
+        return a;
+    return (a == USAGE_UNKNOWN ? 0 : a) + b;
+}
+
+/* Read counters of read and write calls from io file path to u. Return 0, if success. */
+static int read_io_file(proc_usage *u, const char *path)
+{
+    char data[USAGE_IO_SIZE];
+    const char *field;
+    ssize_t len;
+    int fd;
+
+    /* File is absent without CONFIG_TASK_IO_ACCOUNTING. */
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+    while ((len = read(fd, data, sizeof(data) - 1)) < 0 && errno == EINTR);
+    close(fd);
+    if (len <= 0)
+        return -1;
+    data[len] = '\0';
+
+    /* rchar and wchar count bytes of all read and write calls, also of pipes. */
+    if ((field = strstr(data, "rchar: ")))
+        u->read_bytes = strtoll(field + 7, NULL, 10);
+    if ((field = strstr(data, "wchar: ")))
+        u->write_bytes = strtoll(field + 7, NULL, 10);
+
+    return 0;
+}
+
+/* Format nanoseconds ns as seconds to buf. */
+static const char *format_time(char *buf, long long ns)
+{
+    if (ns == USAGE_UNKNOWN)
+        return "-";
+
+    snprintf(buf, USAGE_FIELD_SIZE, "%lld.%03llds", ns / 1000000000LL, ns / 1000000LL % 1000LL);
+    return buf;
+}
+
+/* Format size of bytes with binary suffix to buf. */
+static const char *format_size(char *buf, long long bytes)
+{
+    static const char suffixes[] = "BKMGTP";
+    double size = (double) bytes;
+    int i = 0;
+
+    if (bytes == USAGE_UNKNOWN)
+        return "-";
+    if (bytes < 1024)
+    {
+        snprintf(buf, USAGE_FIELD_SIZE, "%lldB", bytes);
+        return buf;
+    }
+
+    for (; size >= 1024 && suffixes[i + 1]; ++i)
+        size /= 1024;
+    snprintf(buf, USAGE_FIELD_SIZE, "%.1f%c", size, suffixes[i]);
+    return buf;
+}
+
+/* Format counter n to buf. */
+static const char *format_count(char *buf, long long n)
+{
+    if (n == USAGE_UNKNOWN)
+        return "-";
+
+    snprintf(buf, USAGE_FIELD_SIZE, "%lld", n);
+    return buf;
+}
@@ -0,0 +1,45 @@
+#ifndef UNIX_SHELL_USAGE_H
+#define UNIX_SHELL_USAGE_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#define USAGE_UNKNOWN -1 /* value of counters, which aren't available for process */
+
+/* Resources, used by process of job. */
+typedef struct proc_usage
+{
+    unsigned long long begin, end;      /* monotonic nanoseconds of start and completion, 0 if unknown */
+    long long user, sys;                /* CPU time in user and kernel mode, nanoseconds */
+    long long max_rss;                  /* maximum resident set size in kilobytes */
+    long long minor_faults, major_faults;
+    long long voluntary_switches, involuntary_switches;
+    long long read_bytes, write_bytes;  /* bytes of read and write calls, from /proc/<pid>/io */
+} proc_usage;
+
+/* Reset all counters of u to USAGE_UNKNOWN and times to 0. */
+void usage_clear(proc_usage *u);
+
+/* Reset counters of u and record start of process. */
+void usage_begin(proc_usage *u);
+
+/* Record completion of process with resources ru to u.
+   ru may be NULL for builtins, which run inside shell, then counters stay unknown. */
+void usage_end(proc_usage *u, const struct rusage *ru);
+
+/* Record completion of the calling thread of shell with its own resources to u. */
+void usage_end_thread(proc_usage *u);
+
+/* Read byte counters of process pid, which isn't reaped yet, to u. Return 0, if success. */
+int usage_read_process_io(proc_usage *u, pid_t pid);
+
+/* Add resources of u to sum. Time spans and maximums are merged, other counters are summed. */
+void usage_add(proc_usage *sum, const proc_usage *u);
+
+/* Print header of usage table to fd. */
+void print_usage_header(int fd);
+
+/* Print resources of u as row of usage table with label and command to fd. */
+void print_usage(int fd, const char *label, const proc_usage *u, const char *command);
+
+#endif
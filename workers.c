@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "workers.h"
+#include "coreutils.h"
+#include "events.h"
+#include "trace.h"
+
+/* Thread of shell, which runs utility of pipeline. */
+typedef struct worker
+{
+    struct worker *next;    /* next running worker */
+    process *p;             /* process of utility */
+    pthread_t thread;       /* thread of utility */
+    builtin_streams io;     /* streams of utility, owned by thread */
+    int status;             /* exit status of utility */
+    proc_usage usage;       /* resources of thread */
+    perf_totals perf;       /* counters of thread, if job has perfstat prefix */
+    atomic_int done;        /* true if utility completed */
+} worker;
+
+static worker *workers = NULL; /* list of not joined workers, used by main thread only */
+
+/* Body of worker thread. Run utility, free its streams and wake the event loop. */
+static void *run_worker(void *arg);
+
+/* Run utility of process p on new thread of shell.
+   Thread uses copies of infile_local and outfile_local, if they aren't -1,
+   and owns the reading end of in_ring and the writing end of out_ring, if they aren't NULL.
+   Return 0, if success. Or errno. */
+int start_worker(process *p, int infile_local, int outfile_local, ring *in_ring, ring *out_ring)
+{
+    int err;
+    worker *w = malloc(sizeof(worker));
+
+    if (!w)
+        return ENOMEM;
+
+    /* Descriptors of pipeline are closed by the shell after start, so thread keeps copies. */
+    w->io.in = infile_local == -1 ? -1 : fcntl(infile_local, F_DUPFD_CLOEXEC, 0);
+    w->io.out = outfile_local == -1 ? -1 : fcntl(outfile_local, F_DUPFD_CLOEXEC, 0);
+    w->io.in_ring = in_ring;
+    w->io.out_ring = out_ring;
+    w->p = p;
+    w->status = EXIT_SUCCESS;
+    usage_begin(&w->usage);
+    p->usage = w->usage;
+    memset(&w->perf, 0, sizeof(w->perf));
+    atomic_init(&w->done, 0);
+
+    if ((infile_local != -1 && w->io.in == -1) || (outfile_local != -1 && w->io.out == -1))
+        err = errno;
+    else
+        err = start_shell_thread(run_worker, w, &w->thread);
+
+    if (err)
+    {
+        if (w->io.in != -1)
+            close(w->io.in);
+        if (w->io.out != -1)
+            close(w->io.out);
+        free(w);
+        return err;
+    }
+
+    p->worker = w;
+    w->next = workers;
+    workers = w;
+
+    return 0;
+}
+
+/* Start thread, which runs fn with arg. Signals are blocked in it, so they are handled by the main thread only.
+   Return 0, if success. Or errno. */
+int start_shell_thread(void *(*fn)(void *), void *arg, pthread_t *thread)
+{
+    sigset_t all, old;
+    int err;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    err = pthread_create(thread, NULL, fn, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    return err;
+}
+
+/* Join threads of completed utilities and mark their processes completed without blocking.
+   Return count of completed utilities. */
+int reap_workers()
+{
+    worker **link = &workers, *w;
+    int count = 0;
+
+    while ((w = *link))
+    {
+        if (!atomic_load(&w->done))
+        {
+            link = &w->next;
+            continue;
+        }
+
+        pthread_join(w->thread, NULL);
+        *link = w->next;
+
+        /* Exit status in format of waitpid. */
+        trace_process_end(w->p, w->status << 8);
+        w->p->status = w->status << 8;
+        w->p->completed = 1;
+        w->p->stopped = 0;
+        w->p->worker = NULL;
+        w->p->usage = w->usage;
+
+        /* Process substitutions get end of file or broken pipe, after their owner completed. */
+        close_substitutions(w->p);
+        if (w->p->job && w->p->job->perf)
+            perf_add(w->p->job->perf, &w->perf);
+        job_changed(w->p->job);
+        free(w);
+        count++;
+    }
+
+    return count;
+}
+
+/* Return true if some processes of job run on threads of shell. */
+int job_has_workers(job *jobs)
+{
+    if (!jobs)
+        return 0;
+
+    for (process *p = jobs->first_process; p; p = p->next)
+        if (p->worker)
+            return 1;
+
+    return 0;
+}
+
+/* Return true if some thread of shell runs builtin b. */
+int builtin_has_workers(const builtin *b)
+{
+    for (worker *w = workers; w; w = w->next)
+        if (w->p->builtin == b)
+            return 1;
+
+    return 0;
+}
+
+/* Body of worker thread. Run utility, free its streams and wake the event loop. */
+static void *run_worker(void *arg)
+{
+    worker *w = arg;
+    perf_counters counters;
+    int counted = w->p->job && w->p->job->perf;
+
+    /* Counters of the thread are summed by the main thread after join. */
+    if (counted)
+        perf_open(&counters, 0, 0);
+    w->status = run_builtin(w->p->builtin, (const char **) w->p->argv, &w->io);
+    if (counted)
+        perf_collect(&counters, &w->perf);
+    usage_end_thread(&w->usage);
+
+    /* Closed streams give end of file or broken pipe to neighbours in pipeline. */
+    if (w->io.in != -1)
+        close(w->io.in);
+    if (w->io.out != -1)
+        close(w->io.out);
+    if (w->io.in_ring)
+        ring_close(w->io.in_ring, RING_READER);
+    if (w->io.out_ring)
+        ring_close(w->io.out_ring, RING_WRITER);
+
+    atomic_store(&w->done, 1);
+    wake_event_loop();
+
+    return NULL;
+}
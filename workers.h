@@ -0,0 +1,28 @@
+#ifndef UNIX_SHELL_WORKERS_H
+#define UNIX_SHELL_WORKERS_H
+
+#include <pthread.h>
+#include "jobs.h"
+#include "ring.h"
+
+/* Run utility of process p on new thread of shell.
+   Thread uses copies of infile_local and outfile_local, if they aren't -1,
+   and owns the reading end of in_ring and the writing end of out_ring, if they aren't NULL.
+   Return 0, if success. Or errno. */
+int start_worker(process *p, int infile_local, int outfile_local, ring *in_ring, ring *out_ring);
+
+/* Start thread, which runs fn with arg. Signals are blocked in it, so they are handled by the main thread only.
+   Return 0, if success. Or errno. */
+int start_shell_thread(void *(*fn)(void *), void *arg, pthread_t *thread);
+
+/* Join threads of completed utilities and mark their processes completed without blocking.
+   Return count of completed utilities. */
+int reap_workers();
+
+/* Return true if some processes of job run on threads of shell. */
+int job_has_workers(job *jobs);
+
+/* Return true if some thread of shell runs builtin b. */
+int builtin_has_workers(const builtin *b);
+
+#endif